@@ -8,11 +8,20 @@
  *   DES(..):
  *     -> Forms single DES block.
  *   F(..):
- *     -> f functions used in each DES block.
- *   encryption(..):
- *     -> Iterates DES blocks for encryption.
- *   decryption(..):
- *     -> Iterates DES blocks for decryption.
+ *     -> f functions used in each DES block (table_SP lookups).
+ *   des_ctx_init(..):
+ *     -> Key schedule, once per key (see des.h).
+ *   ecbCore(..):
+ *     -> Iterates DES blocks over a list of subkey arrays, one per stage.
+ *        Decryption passes the reversed schedule (dec_subkeys).
+ *   des_ecb_encrypt(..), des_ecb_decrypt(..):
+ *     -> ecbCore with enc_subkeys or dec_subkeys.
+ *   encryption(..), decryption(..):
+ *     -> One-shot wrappers taking the key directly (schedule from des_keycache_default()).
+ *   des3_ctx_init(..), des3_ecb_encrypt(..), des3_ecb_decrypt(..):
+ *     -> Triple-DES, three key schedules and 48 rounds per block (ecbCore with 3 stages).
+ *   Whole batches of des_bs_width() blocks go through the bitsliced engine (des_bs.c).
+ *   getIP/getFP are replaced by des_ip_bmi2/des_fp_bmi2 where des_kernel_bmi2() is set.
  * Major variables:
  *   long long unsigned *keys:
  *     -> 64-bit initial key.
@@ -33,142 +42,66 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <pthread.h>
 
 // #define PARITY_CHECK
 //#define DEBUG
 #define RESULT
 #define NUM_PARALLEL 4
 
-// Tables for IP, FP, E , PC1, PC2, S
-static int table_IP[64] = {
-    57, 49, 41, 33, 25, 17,  9,  1,
-    59, 51, 43, 35, 27, 19, 11,  3,
-    61, 53, 45, 37, 29, 21, 13,  5,
-    63, 55, 47, 39, 31, 23, 15,  7,
-    56, 48, 40, 32, 24, 16,  8,  0,
-    58, 50, 42, 34, 26, 18, 10,  2,
-    60, 52, 44, 36, 28, 20, 12,  4,
-    62, 54, 46, 38, 30, 22, 14,  6
-};
-
-static int table_FP[64] = {
-    39,  7, 47, 15, 55, 23, 63, 31,
-    38,  6, 46, 14, 54, 22, 62, 30,
-    37,  5, 45, 13, 53, 21, 61, 29,
-    36,  4, 44, 12, 52, 20, 60, 28,
-    35,  3, 43, 11, 51, 19, 59, 27,
-    34,  2, 42, 10, 50, 18, 58, 26,
-    33,  1, 41,  9, 49, 17, 57, 25,
-    32,  0, 40,  8, 48, 16, 56, 24
-};
+#include "des.h"
+#include "des_tables.h"
+#include "des_block.h"
+#include "des_perm_gen.h"
+#include "des_bs.h"
+#include "des_pool.h"
+#include "des_stream.h"
+#include "des_map.h"
+#include "des_aio.h"
+#include "des_server.h"
+#include "des_files.h"
+#include "des_keycache.h"
+#include "des_range.h"
+#include "des_search.h"
+#include "des_crypt.h"
+#include "des_rainbow.h"
+#include "des_arena.h"
+#include "des_stats.h"
 
 /*
- * Used to pre-process the key input
+ * Combined S-box and P permutation SP[0~7][0~63]
+ * Built from table_S and table_P by initSP().
+ * Indexed by the 6 expansion bits of each S-box in rotation order (see F).
  */
-static int table_PC1[56] = {
-    27, 19, 11, 31, 39, 47, 55,
-    26, 18, 10, 30, 38, 46, 54,
-    25, 17,  9, 29, 37, 45, 53,
-    24, 16,  8, 28, 36, 44, 52,
-    23, 15,  7,  3, 35, 43, 51,
-    22, 14,  6,  2, 34, 42, 50,
-    21, 13,  5,  1, 33, 41, 49,
-    20, 12,  4,  0, 32, 40, 48
-};
+static unsigned int table_SP[8][64];
 
-/*
- * Used to change 56-bit round key into a 48-bit subkey
- */
-static int table_PC2[48] = {
-    24, 27, 20,  6, 14, 10,  3, 22,
-     0, 17,  7, 12,  8, 23, 11,  5,
-    16, 26,  1,  9, 19, 25,  4, 15,
-    54, 43, 36, 29, 49, 40, 48, 30,
-    52, 44, 37, 33, 46, 35, 50, 41,
-    28, 53, 51, 55, 32, 45, 39, 42
-};
+// initDES() runs once, from the first des_ctx_init
+static pthread_once_t des_once = PTHREAD_ONCE_INIT;
 
-static int table_E[48] = {
-    31,  0,  1,  2,  3,  4,  3,  4,
-     5,  6,  7,  8,  7,  8,  9, 10,
-    11, 12, 11, 12, 13, 14, 15, 16,
-    15, 16, 17, 18, 19, 20, 19, 20,
-    21, 22, 23, 24, 23, 24, 25, 26,
-    27, 28, 27, 28, 29, 30, 31,  0
-};
-
-/*
- * Substitution table S[0~7][0~63]
- */
-static int table_S[8][64] = {
-    /* table S[0] */
-        {   13,  1,  2, 15,  8, 13,  4,  8,  6, 10, 15,  3, 11,  7,  1,  4,
-            10, 12,  9,  5,  3,  6, 14, 11,  5,  0,  0, 14, 12,  9,  7,  2,
-             7,  2, 11,  1,  4, 14,  1,  7,  9,  4, 12, 10, 14,  8,  2, 13,
-             0, 15,  6, 12, 10,  9, 13,  0, 15,  3,  3,  5,  5,  6,  8, 11  },
-    /* table S[1] */
-        {    4, 13, 11,  0,  2, 11, 14,  7, 15,  4,  0,  9,  8,  1, 13, 10,
-             3, 14, 12,  3,  9,  5,  7, 12,  5,  2, 10, 15,  6,  8,  1,  6,
-             1,  6,  4, 11, 11, 13, 13,  8, 12,  1,  3,  4,  7, 10, 14,  7,
-            10,  9, 15,  5,  6,  0,  8, 15,  0, 14,  5,  2,  9,  3,  2, 12  },
-    /* table S[2] */
-        {   12, 10,  1, 15, 10,  4, 15,  2,  9,  7,  2, 12,  6,  9,  8,  5,
-             0,  6, 13,  1,  3, 13,  4, 14, 14,  0,  7, 11,  5,  3, 11,  8,
-             9,  4, 14,  3, 15,  2,  5, 12,  2,  9,  8,  5, 12, 15,  3, 10,
-             7, 11,  0, 14,  4,  1, 10,  7,  1,  6, 13,  0, 11,  8,  6, 13  },
-    /* table S[3] */
-        {    2, 14, 12, 11,  4,  2,  1, 12,  7,  4, 10,  7, 11, 13,  6,  1,
-             8,  5,  5,  0,  3, 15, 15, 10, 13,  3,  0,  9, 14,  8,  9,  6,
-             4, 11,  2,  8,  1, 12, 11,  7, 10,  1, 13, 14,  7,  2,  8, 13,
-            15,  6,  9, 15, 12,  0,  5,  9,  6, 10,  3,  4,  0,  5, 14,  3  },
-    /* table S[4] */
-        {    7, 13, 13,  8, 14, 11,  3,  5,  0,  6,  6, 15,  9,  0, 10,  3,
-             1,  4,  2,  7,  8,  2,  5, 12, 11,  1, 12, 10,  4, 14, 15,  9,
-            10,  3,  6, 15,  9,  0,  0,  6, 12, 10, 11,  1,  7, 13, 13,  8,
-            15,  9,  1,  4,  3,  5, 14, 11,  5, 12,  2,  7,  8,  2,  4, 14  },
-    /* table S[5] */
-        {   10, 13,  0,  7,  9,  0, 14,  9,  6,  3,  3,  4, 15,  6,  5, 10,
-             1,  2, 13,  8, 12,  5,  7, 14, 11, 12,  4, 11,  2, 15,  8,  1,
-            13,  1,  6, 10,  4, 13,  9,  0,  8,  6, 15,  9,  3,  8,  0,  7,
-            11,  4,  1, 15,  2, 14, 12,  3,  5, 11, 10,  5, 14,  2,  7, 12  },
-    /* table S[6] */
-        {   15,  3,  1, 13,  8,  4, 14,  7,  6, 15, 11,  2,  3,  8,  4, 14,
-             9, 12,  7,  0,  2,  1, 13, 10, 12,  6,  0,  9,  5, 11, 10,  5,
-             0, 13, 14,  8,  7, 10, 11,  1, 10,  3,  4, 15, 13,  4,  1,  2,
-             5, 11,  8,  6, 12,  7,  6, 12,  9,  0,  3,  5,  2, 14, 15,  9  },
-    /* table S[7] */
-        {   14,  0,  4, 15, 13,  7,  1,  4,  2, 14, 15,  2, 11, 13,  8,  1,
-             3, 10, 10,  6,  6, 12, 12, 11,  5,  9,  9,  5,  0,  3,  7,  8,
-             4, 15,  1, 12, 14,  8,  8,  2, 13,  4,  6,  9,  2,  1, 11,  7,
-            15,  5, 12, 11,  9,  3,  7, 14,  3, 10, 10,  0,  5,  6,  0, 13  }
-};
-
-/*
- * Permutation table P
- */
-static int table_P[32] = {
-    11, 17,  5, 27, 25, 10, 20,  0,
-    13, 21,  3, 28, 29,  7, 18, 24,
-    31, 22, 12,  6, 26,  2, 16,  8,
-    14, 30,  4, 19,  1,  9, 15, 23
-};
+// IP or FP of one block
+typedef void (*perm_fn)(long long unsigned *out, long long unsigned in);
 
 // Bitwise functions
-void getKeyPart(long long unsigned *key_part, char *key);
+void getKeyPart(long long unsigned *key_part, const char *key);
 void getIP(long long unsigned *out, long long unsigned in);
 void getFP(long long unsigned *out, long long unsigned in);
+void getFirstKey(long long unsigned *first_key, long long unsigned key_part);
+void getSubkey(long long unsigned *subkey, long long unsigned key);
+void initSP(void);
+void initDES(void);
 
-// Major functions
-void DES(int index, long long unsigned *MD, long long unsigned *keys);
-unsigned int F(unsigned int c, long long unsigned key);
-int encryption(char *in, char *out, char *key, int input_len);
-int decryption(char *in, char *out, char *key, int input_len);
+// Major functions (the public ones are in des.h)
+void DES(int index, long long unsigned *MD, const long long unsigned *keys);
+unsigned int F(unsigned int c, long long unsigned subkey);
 
 /*********************
  * BITWISE FUNCTIONS *
  *********************/
 
-inline void getKeyPart(long long unsigned *key_part, char *key) {
+inline void getKeyPart(long long unsigned *key_part, const char *key) {
     int i;
 #ifdef PARITY_CHECK
     for(i = 0; i < 8; i++) {
@@ -188,22 +121,66 @@ inline void getKeyPart(long long unsigned *key_part, char *key) {
     }
 }
 
+/*
+ * IP and FP, one lookup per byte of in (table_IPbyte/table_FPbyte, des_gen -p)
+ */
 inline void getIP(long long unsigned *out, long long unsigned in) {
-    int i;
-    *out = 0;
-    for(i = 0; i < 64; i++) {
-        *out += ( ( ( 0x1ull << table_IP[i] ) & in ) >> table_IP[i] ) << i;
-    }
+    *out = table_IPbyte[0][in & 0xff] ^ table_IPbyte[1][(in >> 8) & 0xff]
+         ^ table_IPbyte[2][(in >> 16) & 0xff] ^ table_IPbyte[3][(in >> 24) & 0xff]
+         ^ table_IPbyte[4][(in >> 32) & 0xff] ^ table_IPbyte[5][(in >> 40) & 0xff]
+         ^ table_IPbyte[6][(in >> 48) & 0xff] ^ table_IPbyte[7][in >> 56];
 }
 
 inline void getFP(long long unsigned *out, long long unsigned in) {
-    int i;
-    *out = 0;
-    for(i = 0; i < 64; i++) {
-        *out += ( ( ( 0x1ull << table_FP[i] ) & in ) >> table_FP[i] ) << i;
+    *out = table_FPbyte[0][in & 0xff] ^ table_FPbyte[1][(in >> 8) & 0xff]
+         ^ table_FPbyte[2][(in >> 16) & 0xff] ^ table_FPbyte[3][(in >> 24) & 0xff]
+         ^ table_FPbyte[4][(in >> 32) & 0xff] ^ table_FPbyte[5][(in >> 40) & 0xff]
+         ^ table_FPbyte[6][(in >> 48) & 0xff] ^ table_FPbyte[7][in >> 56];
+}
+
+/*
+ * 56-bit key after PC1 (masked shifts generated from table_PC1)
+ */
+inline void getFirstKey(long long unsigned *first_key, long long unsigned key_part) {
+    *first_key = DES_PERM_PC1(key_part);
+}
+
+/*
+ * Convert a 56-bit round key into a subkey prepared for F
+ * PC2 is applied, then every 6-bit group is bit-reversed and moved to table_SPshift.
+ * des_gen folds all three steps into the masked shifts of DES_PERM_SUBKEY.
+ */
+inline void getSubkey(long long unsigned *subkey, long long unsigned key) {
+    *subkey = DES_PERM_SUBKEY(key);
+}
+
+/*
+ * Fill table_SP: table_S[i] followed by table_P, indexed by the bit-reversed S-box input
+ */
+void initSP(void) {
+    unsigned int sout;
+    int i, j, u, v;
+
+    for(i = 0; i < 8; i++) {
+        for(u = 0; u < 64; u++) {
+            v = 0;
+            for(j = 0; j < 6; j++) {
+                v ^= ( ( u >> j ) & 0x1 ) << (5 - j);
+            }
+            sout = table_S[i][v] << (28 - 4*i);
+            table_SP[i][u] = (unsigned int)DES_PERM_P((long long unsigned)sout);
+        }
     }
 }
 
+/*
+ * Tables shared by every context: table_SP and the bitsliced kernel choice
+ */
+void initDES(void) {
+    initSP();
+    des_bs_width();
+}
+
 /*********************
  *  MAJOR FUNCTIONS  *
  *********************/
@@ -212,10 +189,10 @@ inline void getFP(long long unsigned *out, long long unsigned in) {
  * Single DES block
  * @param index Round index
  * @param MD 64-bit data (input & output reference)
- * @param keys 56-bit round keys (input & output reference)
+ * @param keys 48-bit subkeys prepared by getSubkey
  * @return 64-bit data
  */
-void DES(int index, long long unsigned *MD, long long unsigned *keys) {
+void DES(int index, long long unsigned *MD, const long long unsigned *keys) {
     // L, R, fout: 32-bit
     unsigned int L, R, fout;
     int i;
@@ -241,168 +218,247 @@ void DES(int index, long long unsigned *MD, long long unsigned *keys) {
 
 /*
  * f function for DES block
+ * The expansion (table_E) is two rotations of c: every S-box reads 6 adjacent bits
+ * of rotl(c, 5) or rotl(c, 1), and table_SP covers table_S and table_P at once.
  * @param c 32-bit half block (R)
- * @param key 56-bit roundkey
+ * @param subkey 48-bit subkey prepared by getSubkey
  * @return 32-bit processed block
  */
-unsigned int F(unsigned int c, long long unsigned key) {
-    // expanded: 48-bit
-    // subkey: 48-bit
-    // sout: 32-bit
-    // rtn: 32-bit
-    unsigned long long expanded;
-    unsigned long long subkey;
-    unsigned int sout;
-    unsigned int rtn;
-    int i;
+unsigned int F(unsigned int c, long long unsigned subkey) {
+    // w0: S-boxes 0, 6, 4, 2 / w1: S-boxes 7, 5, 3, 1 (one per byte)
+    unsigned int w0, w1;
+
+    // (1/2) Expand c and XOR the subkey
+    w0 = ( ( c << 5 ) | ( c >> 27 ) ) ^ (unsigned int)(subkey & 0xffffffff);
+    w1 = ( ( c << 1 ) | ( c >> 31 ) ) ^ (unsigned int)(subkey >> 32);
+
+    // (2/2) Substitution and permutation
+    return table_SP[0][w0 & 0x3f] ^ table_SP[6][(w0 >> 8) & 0x3f]
+         ^ table_SP[4][(w0 >> 16) & 0x3f] ^ table_SP[2][(w0 >> 24) & 0x3f]
+         ^ table_SP[7][w1 & 0x3f] ^ table_SP[5][(w1 >> 8) & 0x3f]
+         ^ table_SP[3][(w1 >> 16) & 0x3f] ^ table_SP[1][(w1 >> 24) & 0x3f];
+}
 
-    // (1/5) Expand c to 48-bit following table_E (i = bit index)
-    expanded = 0;
-    for(i = 0; i < 48; i++) {
-        expanded ^= ( ( 0x1ull << table_E[i] ) & c) >> table_E[i];
-        if(i != 47) expanded <<= 1;
-    }
+/*
+ * Key schedule, run once per key
+ * The context is only read afterwards, so it can be shared between threads.
+ * @param ctx Context (output reference)
+ * @param key 8-byte key
+ */
+void des_ctx_init(des_ctx *ctx, const char *key) {
+    // 56-bit part of key
+    long long unsigned key_part;
+    // 56-bit round keys
+    long long unsigned keys[16];
+    // rotation_overflow: 56-bit
+    long long unsigned rotation_overflow;
+    // For calculation inside iteration
+    int round;
+    DES_STAT_DECL;
 
-    // (2/5) Convert the round key into subkey using PC2 (i = bit index)
-    subkey = 0;
-    for(i = 0; i < 48; i++) {
-        subkey ^= ( ( 0x1ull << table_PC2[i] ) & key) >> table_PC2[i];
-        if(i != 47) subkey <<= 1;
-    }
+    pthread_once(&des_once, initDES);
+    DES_STAT_START();
 
-    // (3/5) XOR the expanded block
-    expanded ^= subkey;
+    // (1/9) Generate 56-bit key_part (after parity check)
+    getKeyPart(&key_part, key);
 
-    // (4/5) 6-bit to 4-bit substitution (i is NOT a bit index)
-    sout = 0;
-    for(i = 0; i < 8; i++) {
-        sout ^= table_S[i][((expanded >> (6*i)) & 0x3f)];
-        if(i != 7) sout <<= 4;
+    // (4/9) Get first_key
+    getFirstKey(&(ctx->first_key), key_part);
+    keys[0] = ctx->first_key;
+
+    // (5/9) Pre-compute all round keys (Rotate round key 1 or 2 times to LEFT (i-th bit to (i+1)-th bit, ...))
+    for(round = 0; round < 16; round++) {
+        rotation_overflow = keys[round] & 0x0080000008000000; // 27th, 55th bit kept(0-based counting)
+        keys[round] <<= 1;
+        keys[round] &= ~(0x0000000010000001);
+        keys[round] ^= (rotation_overflow >> 27);
+        keys[round] &= 0x00ffffffffffffff; // trim
+        if(round != 0 && round != 7 && round != 14 && round != 15) {
+            rotation_overflow = keys[round] & 0x0080000008000000; // 27th, 55th bit kept(0-based counting)
+            keys[round] <<= 1;
+            keys[round] &= ~(0x0000000010000001);
+            keys[round] ^= (rotation_overflow >> 27);
+            keys[round] &= 0x00ffffffffffffff; // trim
+        }
+        if(round != 15) keys[round+1] = keys[round];
     }
-
-    // (5/5) 32-bit permutation (i = bit index)
-    rtn = 0;
-    for(i = 0; i < 32; i++) {
-        rtn ^= ( ( 0x1ull << table_P[i] ) & sout) >> table_P[i];
-        if(i != 31) rtn <<= 1;
+    // 56-bit round keys -> 48-bit subkeys for F, decryption takes them in reverse
+    for(round = 0; round < 16; round++) {
+        getSubkey(&(ctx->enc_subkeys[round]), keys[round]);
+        ctx->dec_subkeys[15 - round] = ctx->enc_subkeys[round];
     }
-    return rtn;
+    DES_STAT_LAP(DES_STAGE_KEY);
 }
 
 /*
- * encrypt in -> out
- * @param in Input plain text
- * @param out Output cipher text
- * @param key Keyphrase
- * @param input_len Length of in
+ * ECB core of DES and triple-DES, both directions
+ * Decryption is the same rounds over the reversed schedule (dec_subkeys), only
+ * the byte order of loads and stores differs. Each stage runs 16 rounds over
+ * its subkeys; FP of one stage and IP of the next cancel out, so the stages are
+ * joined by the LR swap alone. Callers pass num_stages, decrypt, ip and fp as
+ * constants and the core is inlined into each of them (ECB_DISPATCH): one copy
+ * per direction, stage count and IP/FP kernel, no branch left in the loops.
+ * @param stage_keys Subkeys of each stage, in the order the stages run
+ * @param first_keys first_key of each des_ctx, for the bitsliced engine
+ * @param num_stages 1 (DES) or 3 (triple-DES)
+ * @param decrypt 0: load big-endian and store little-endian, 1: the reverse
+ * @param ip IP of one block (getIP or des_ip_bmi2)
+ * @param fp FP of one block (getFP or des_fp_bmi2)
  */
-int encryption(char *in, char *out, char *key, int input_len) {
-    // 64-bit or 56-bit part of in, out, and key for external iteration
-    long long unsigned in_part[NUM_PARALLEL], out_part[NUM_PARALLEL], key_part;
-    // Data and round key for DES. *** these are referenced threw DES
-    long long unsigned MD[NUM_PARALLEL], first_key;
-    long long unsigned keys[16];
-    // rotation_overflow: 56-bit
-    long long unsigned rotation_overflow;
-    // temp: for swap
-    long long unsigned temp;
+static inline __attribute__((always_inline)) int ecbCore(const long long unsigned *const *stage_keys,
+        const long long unsigned *first_keys, int num_stages, int decrypt, perm_fn ip, perm_fn fp,
+        const char *in, char *out, int input_len) {
+    // 64-bit part of in and out for external iteration
+    long long unsigned in_part[NUM_PARALLEL], out_part[NUM_PARALLEL];
+    // Data for DES. *** this is referenced threw DES
+    long long unsigned MD[NUM_PARALLEL];
+    // Blocks for the bitsliced engine
+    long long unsigned bs_blocks[DES_BS_MAX_WIDTH];
+    int bs_width;
     // For cutting input char array
     int count;
+    // Blocks in this iteration (NUM_PARALLEL except at the end)
+    int num;
     // For calculation inside iteration
-    int round;
+    int round, stage;
     // General purpose index
-    int i, j;
+    int i;
+    DES_STAT_DECL;
 
-    // (1/9) Generate 56-bit key_part (after parity check)
-    getKeyPart(&key_part, key);
+    // (1/9), (4/9), (5/9) Key setup is done once by des_ctx_init
 
-    for(count = 0; count < input_len; count += 8 * NUM_PARALLEL) {
-        // (2/9) Cut input (input can be always devided with 64-bit, for convenience)
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            in_part[i] = 0;
-            for(j = 0; j < 8; j++) {
-                in_part[i] ^= in[count + (8 * i) + j] & 0xff;
-                if(j != 7) in_part[i] <<= 8;
-            }
+    // Bitsliced engine for whole batches, the loop below takes the rest
+    DES_STAT_START();
+    bs_width = des_bs_width();
+    for(count = 0; bs_width > 0 && count + 8 * bs_width <= input_len; count += 8 * bs_width) {
+        for(i = 0; i < bs_width; i++) {
+            bs_blocks[i] = des_load_block(in + count + (8 * i), !decrypt);
         }
-#ifdef DEBUG
-        printf("%d\tloaded %8llX %8llX\n", round, ((in_part >> 32) & 0x00000000ffffffff), (in_part & 0x00000000ffffffff));
-#endif
-
-        // (3/9) MD = Data after initial permutation (IP)
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            getIP(&(MD[i]), in_part[i]);
+        DES_STAT_LAP(DES_STAGE_LOAD);
+        if(num_stages == 1) des_bs_crypt(bs_blocks, bs_width, first_keys[0], decrypt);
+        else des_bs_crypt3(bs_blocks, bs_width, first_keys, decrypt);
+        DES_STAT_LAP(DES_STAGE_BITSLICED);
+        for(i = 0; i < bs_width; i++) {
+            des_store_block(out + count + (8 * i), bs_blocks[i], decrypt);
         }
+        DES_STAT_LAP(DES_STAGE_STORE);
+    }
 
-        // (4/9) Get first_key
-        first_key = 0x0;
-        for(i = 0; i < 56; i++) {
-            first_key ^= ( ( 0x1ull << table_PC1[i]) & key_part) >> table_PC1[i];
-            if(i != 55) first_key <<= 1;
+    for(; count + 8 <= input_len; count += 8 * num) {
+        num = (input_len - count) / 8;
+        if(num > NUM_PARALLEL) num = NUM_PARALLEL;
+
+        // (2/9) Cut input (input can be always devided with 64-bit, for convenience)
+        for(i = 0; i < num; i++) {
+            in_part[i] = des_load_block(in + count + (8 * i), !decrypt);
         }
-        keys[0] = first_key;
+        DES_STAT_LAP(DES_STAGE_LOAD);
 
-        // (5/9) Pre-compute all round keys (Rotate round key 1 or 2 times to LEFT (i-th bit to (i+1)-th bit, ...))
-        for(round = 0; round < 16; round++) {
-            rotation_overflow = keys[round] & 0x0080000008000000; // 27th, 55th bit kept(0-based counting)
-            keys[round] <<= 1;
-            keys[round] &= ~(0x0000000010000001);
-            keys[round] ^= (rotation_overflow >> 27);
-            keys[round] &= 0x00ffffffffffffff; // trim
-            if(round != 0 && round != 7 && round != 14 && round != 15) {
-                rotation_overflow = keys[round] & 0x0080000008000000; // 27th, 55th bit kept(0-based counting)
-                keys[round] <<= 1;
-                keys[round] &= ~(0x0000000010000001);
-                keys[round] ^= (rotation_overflow >> 27);
-                keys[round] &= 0x00ffffffffffffff; // trim
-            }
-            if(round != 15) keys[round+1] = keys[round];
+        // (3/9) MD = Data after initial permutation (IP)
+        for(i = 0; i < num; i++) {
+            ip(&(MD[i]), in_part[i]);
         }
+        DES_STAT_LAP(DES_STAGE_IP);
 
-        // (6/9) Run DES block
-        for(i = 0; i < NUM_PARALLEL; i++) {
+        // (6/9) Run DES block, 16 rounds per stage
+        for(i = 0; i < num; i++) {
             for(round = 0; round < 16; round++) {
-#ifdef DEBUG
-            printf("%d\tbefore %8llX %8llX\n", round, ((MD >> 32) & 0x00000000ffffffff), (MD & 0x00000000ffffffff));
-            //printf("%d\t w/key %8llX %8llX\n", round, ((keys >> 32) & 0x00000000ffffffff), (keys & 0x00000000ffffffff));
-#endif
-                DES(round, &(MD[i]), keys);
+                DES(round, &(MD[i]), stage_keys[0]);
+            }
+            for(stage = 1; stage < num_stages; stage++) {
+                MD[i] = (MD[i] << 32) | (MD[i] >> 32);
+                for(round = 0; round < 16; round++) {
+                    DES(round, &(MD[i]), stage_keys[stage]);
+                }
             }
         }
+        DES_STAT_LAP(DES_STAGE_ROUNDS);
 
         // (7/9) Swap LR
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            temp = (MD[i] & 0x00000000ffffffff) << 32;
-            MD[i] >>= 32;
-            MD[i] &= 0x00000000ffffffff;
-            MD[i] = MD[i] ^ temp;
+        for(i = 0; i < num; i++) {
+            MD[i] = (MD[i] << 32) | (MD[i] >> 32);
         }
+        DES_STAT_LAP(DES_STAGE_SWAP);
 
 #ifdef DEBUG
-        printf("%d\t LRfin %8llX %8llX\n", round, ((MD >> 32) & 0x00000000ffffffff), (MD & 0x00000000ffffffff));
+        for(i = 0; i < num; i++) {
+            printf("%d\t LRfin %8llX %8llX\n", i, ((MD[i] >> 32) & 0x00000000ffffffff), (MD[i] & 0x00000000ffffffff));
+        }
 #endif
 
         // (8/9) Final permutation (FP)
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            getFP(&(out_part[i]), MD[i]);
+        for(i = 0; i < num; i++) {
+            fp(&(out_part[i]), MD[i]);
         }
-
-#ifdef DEBUG
-        printf("%d\t final %8llX %8llX\n", round, ((out_part >> 32) & 0x00000000ffffffff), (out_part & 0x00000000ffffffff));
-#endif
+        DES_STAT_LAP(DES_STAGE_FP);
 
         // (9/9) Write to output array
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            for(j = 0; j < 8; j++) {
-                out[count + (8 * i) + j] = out_part[i] & 0x00ff;
-                if(j != 7) out_part[i] >>= 8;
-            }
+        for(i = 0; i < num; i++) {
+            des_store_block(out + count + (8 * i), out_part[i], decrypt);
         }
+        DES_STAT_LAP(DES_STAGE_STORE);
     }
 
+    DES_STAT_BYTES(input_len);
     return 0;
 }
 
+// ecbCore inlined once per IP/FP kernel, picked per call like des_bs_width()
+#define ECB_DISPATCH(stage_keys, first_keys, num_stages, decrypt) \
+    (des_kernel_bmi2() \
+        ? ecbCore(stage_keys, first_keys, num_stages, decrypt, des_ip_bmi2, des_fp_bmi2, in, out, input_len) \
+        : ecbCore(stage_keys, first_keys, num_stages, decrypt, getIP, getFP, in, out, input_len))
+
+/*
+ * ECB encrypt in -> out
+ * @param ctx Context from des_ctx_init
+ * @param in Input plain text
+ * @param out Output cipher text
+ * @param input_len Length of in (multiple of 8)
+ */
+int des_ecb_encrypt(const des_ctx *ctx, const char *in, char *out, int input_len) {
+    const long long unsigned *keys = ctx->enc_subkeys;
+
+    return ECB_DISPATCH(&keys, &(ctx->first_key), 1, 0);
+}
+
+/*
+ * ECB decrypt in -> out
+ * @param ctx Context from des_ctx_init
+ * @param in Input cipher text
+ * @param out Output plain text
+ * @param input_len Length of in (multiple of 8)
+ */
+int des_ecb_decrypt(const des_ctx *ctx, const char *in, char *out, int input_len) {
+    const long long unsigned *keys = ctx->dec_subkeys;
+
+    return ECB_DISPATCH(&keys, &(ctx->first_key), 1, 1);
+}
+
+/*
+ * Key schedule through the process-wide cache, or computed when it is off
+ */
+static void getCtx(des_ctx *ctx, const char *key) {
+    des_keycache *kc = des_keycache_default();
+
+    if(kc) des_keycache_get(kc, key, ctx);
+    else des_ctx_init(ctx, key);
+}
+
+/*
+ * encrypt in -> out
+ * @param in Input plain text
+ * @param out Output cipher text
+ * @param key Keyphrase
+ * @param input_len Length of in
+ */
+int encryption(char *in, char *out, char *key, int input_len) {
+    des_ctx ctx;
+
+    getCtx(&ctx, key);
+    return des_ecb_encrypt(&ctx, in, out, input_len);
+}
+
 /*
  * Decrypt in -> out
  * @param in Input cipher text
@@ -411,162 +467,377 @@ int encryption(char *in, char *out, char *key, int input_len) {
  * @param input_len Length of in
  */
 int decryption(char *in, char *out, char *key, int input_len) {
-    // 64-bit or 56-bit part of in, out, and key for external iteration
-    long long unsigned in_part[NUM_PARALLEL], out_part[NUM_PARALLEL], key_part;
-    // Data and round key for DES. *** these are referenced threw DES
-    long long unsigned MD[NUM_PARALLEL], first_key;
-    long long unsigned keys[16];
-    // rotation_overflow: 56-bit, for (/)
-    long long unsigned rotation_overflow;
-    // temp: for swap
-    long long unsigned temp;
-    // For cutting input char array
-    int count;
-    // For calculation inside iteration
-    int round;
-    // General purpose index
-    int i, j;
+    des_ctx ctx;
 
-    // (1/9) Generate 56-bit key_part (after parity check)
-    getKeyPart(&key_part, key);
+    getCtx(&ctx, key);
+    return des_ecb_decrypt(&ctx, in, out, input_len);
+}
 
-    for(count = 0; count < input_len; count += 8 * NUM_PARALLEL) {
-        // (2/9) Cut input (input can be always devided with 64-bit, for convenience)
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            in_part[i] = 0;
-            for(j = 7; j >= 0; j--) {
-                in_part[i] ^= in[count + (8 * i) + j] & 0xff;
-                if(j != 0) in_part[i] <<= 8;
-            }
-        }
-#ifdef DEBUG
-        printf("%d\tloaded %8llX %8llX\n", round, ((in_part >> 32) & 0x00000000ffffffff), (in_part & 0x00000000ffffffff));
-#endif
+/*
+ * Key schedules of a Triple-DES key
+ * @param ctx Context (output reference)
+ * @param key 16-byte (k1 k2, k3 = k1) or 24-byte (k1 k2 k3) key
+ * @param key_len 16 or 24
+ * @return 0, or -1 for any other key_len
+ */
+int des3_ctx_init(des3_ctx *ctx, const char *key, int key_len) {
+    if(key_len != 16 && key_len != 24) return -1;
+    des_ctx_init(&(ctx->ks[0]), key);
+    des_ctx_init(&(ctx->ks[1]), key + 8);
+    des_ctx_init(&(ctx->ks[2]), key_len == 24 ? key + 16 : key);
+    return 0;
+}
 
-        // (3/9) MD = Data after initial permutation (IP)
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            getIP(&(MD[i]), in_part[i]);
-        }
+/*
+ * Triple-DES ECB encrypt in -> out
+ * Runs E k1, D k2, E k3 (see ecbCore).
+ * @param ctx Context from des3_ctx_init
+ * @param in Input plain text
+ * @param out Output cipher text
+ * @param input_len Length of in (multiple of 8)
+ */
+int des3_ecb_encrypt(const des3_ctx *ctx, const char *in, char *out, int input_len) {
+    const long long unsigned *keys[3] = { ctx->ks[0].enc_subkeys, ctx->ks[1].dec_subkeys, ctx->ks[2].enc_subkeys };
+    const long long unsigned first_keys[3] = { ctx->ks[0].first_key, ctx->ks[1].first_key, ctx->ks[2].first_key };
 
-        // (4/9) Get first_key
-        first_key = 0x0;
-        for(i = 0; i < 56; i++) {
-            first_key ^= ( ( 0x1ull << table_PC1[i]) & key_part) >> table_PC1[i];
-            if(i != 55) first_key <<= 1;
-        }
-        keys[0] = first_key;
+    return ECB_DISPATCH(keys, first_keys, 3, 0);
+}
 
-        // (5/9) Pre-compute all round keys (Rotate round key 1 or 2 times to LEFT (i-th bit to (i+1)-th bit, ...))
-        for(round = 0; round < 16; round++) {
-            rotation_overflow = keys[round] & 0x0080000008000000; // 27th, 55th bit kept(0-based counting)
-            keys[round] <<= 1;
-            keys[round] &= ~(0x0000000010000001);
-            keys[round] ^= (rotation_overflow >> 27);
-            keys[round] &= 0x00ffffffffffffff; // trim
-            if(round != 0 && round != 7 && round != 14 && round != 15) {
-                rotation_overflow = keys[round] & 0x0080000008000000; // 27th, 55th bit kept(0-based counting)
-                keys[round] <<= 1;
-                keys[round] &= ~(0x0000000010000001);
-                keys[round] ^= (rotation_overflow >> 27);
-                keys[round] &= 0x00ffffffffffffff; // trim
-            }
-            if(round != 15) keys[round+1] = keys[round];
-        }
+/*
+ * Triple-DES ECB decrypt in -> out
+ * Runs D k3, E k2, D k1 (see ecbCore).
+ * @param ctx Context from des3_ctx_init
+ * @param in Input cipher text
+ * @param out Output plain text
+ * @param input_len Length of in (multiple of 8)
+ */
+int des3_ecb_decrypt(const des3_ctx *ctx, const char *in, char *out, int input_len) {
+    const long long unsigned *keys[3] = { ctx->ks[2].dec_subkeys, ctx->ks[1].enc_subkeys, ctx->ks[0].dec_subkeys };
+    const long long unsigned first_keys[3] = { ctx->ks[0].first_key, ctx->ks[1].first_key, ctx->ks[2].first_key };
 
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            for(round = 0; round < 16; round++) {
-#ifdef DEBUG
-                printf("%d\tbefore %8llX %8llX\n", round, ((MD >> 32) & 0x00000000ffffffff), (MD & 0x00000000ffffffff));
-                //printf("%d\t w/key %8llX %8llX\n", round, ((keys >> 32) & 0x00000000ffffffff), (keys & 0x00000000ffffffff));
-#endif
-                // (6/9) Run DES block
-                DES(15-round, &(MD[i]), keys);
-            }
-        }
+    return ECB_DISPATCH(keys, first_keys, 3, 1);
+}
 
-        // (7/9) Swap LR
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            temp = (MD[i] & 0x00000000ffffffff) << 32;
-            MD[i] >>= 32;
-            MD[i] &= 0x00000000ffffffff;
-            MD[i] = MD[i] ^ temp;
-        }
+#ifndef DES_NO_MAIN
 
-#ifdef DEBUG
-        printf("%d\t LRfin %8llX %8llX\n", round, ((MD >> 32) & 0x00000000ffffffff), (MD & 0x00000000ffffffff));
-#endif
+/*
+ * Parallel read of the input file: each chunk is first touched by the worker
+ * that will also encrypt it (same static share in des_pool_run)
+ */
+struct load_job {
+    int fd;
+    char *buffer;
+    long size; // file size
+    long len; // buffer size
+    int failed;
+};
 
-        // (8/9) Final permutation (FP)
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            getFP(&(out_part[i]), MD[i]);
-        }
+static void loadTask(void *arg, long index, int worker) {
+    struct load_job *job = arg;
+    long offset = index * DES_POOL_CHUNK;
+    long len = job->len - offset;
+    long want, got;
+    ssize_t n;
+
+    if(len > DES_POOL_CHUNK) len = DES_POOL_CHUNK;
+    want = job->size - offset;
+    if(want > len) want = len;
+    if(want < 0) want = 0;
+    for(got = 0; got < want; got += n) {
+        n = pread(job->fd, job->buffer + offset + got, want - got, offset + got);
+        if(n <= 0) { __sync_fetch_and_or(&job->failed, 1); return; }
+    }
+    memset(job->buffer + offset + want, 0, len - want);
+}
 
-#ifdef DEBUG
-        printf("%d\t final %8llX %8llX\n", round, ((out_part >> 32) & 0x00000000ffffffff), (out_part & 0x00000000ffffffff));
-        getIP(&MD, out_part);
-        printf("%d\t  re   %8llX %8llX\n", round, ((MD >> 32) & 0x00000000ffffffff), (MD & 0x00000000ffffffff));
-        getFP(&out_part, MD);
-        printf("%d\t  rere %8llX %8llX\n", round, ((out_part >> 32) & 0x00000000ffffffff), (out_part & 0x00000000ffffffff));
-#endif
+/*
+ * 16 hex digits -> 8 bytes
+ * @return 0, or -1 if hex is not exactly one block
+ */
+static int getHexBlock(char *block, const char *hex) {
+    int j;
 
-        // (9/9) Write to output array
-        for(i = 0; i < NUM_PARALLEL; i++) {
-            for(j = 7; j >= 0; j--) {
-                out[count + (8 * i) + j] = out_part[i] & 0x00ff;
-                if(j != 0) out_part[i] >>= 8;
-            }
-        }
+    if(strlen(hex) != 16 || strspn(hex, "0123456789abcdefABCDEF") != 16) return -1;
+    for(j = 0; j < 8; j++) {
+        sscanf(hex + 2 * j, "%2hhx", (unsigned char *)&block[j]);
     }
-
     return 0;
 }
 
+static void usage(void) {
+    printf("des_c [-j threads] <input_file_path> <keyphrase>\n");
+    printf("des_c [-j threads] -e|-d [-o output_path] <input_file_path|-> <keyphrase>\n");
+    printf("des_c [-j threads] -e|-d -m -o output_path <input_file_path> <keyphrase>\n");
+    printf("des_c [-j threads] -e|-d -i <input_file_path> <keyphrase>\n");
+    printf("des_c [-j threads] -e|-d -u|-D -o output_path <input_file_path> <keyphrase>\n");
+    printf("des_c [-j threads] -e|-d -O output_dir [-v n] <file|dir|->... <keyphrase>\n");
+    printf("des_c --range offset:len [--ctr iv_hex] [-o output_path] <input_file_path> <keyphrase>\n");
+    printf("des_c [-j threads] -s [-r start:end] [-c checkpoint_path] [-a] <plain_hex> <cipher_hex>\n");
+    printf("des_c [-j threads] --rainbow-build <plain_hex> <chain_len> <num_chains> <table_path> [table_number]\n");
+    printf("des_c [-j threads] --rainbow-lookup <table_path> <cipher_hex>...\n");
+    printf("des_c -S socket_path [-w deadline_us]\n");
+    printf("des_c --crypt <salt> <password>\n");
+    printf("des_c [-j threads] --crypt-audit <hash_file> <wordlist>\n");
+    printf("des_c --print-kernel\n");
+    printf("  -j: encrypt/decrypt on a pool of this many threads\n");
+    printf("  -e, -d: stream encrypt (with padding) / decrypt input to output (default stdout)\n");
+    printf("  -m: with -e/-d and -o, map both files instead of reading and writing\n");
+    printf("  -i: with -e/-d, transform the input file in place (mapped)\n");
+    printf("  -u: with -e/-d and -o, asynchronous reads and writes (io_uring, or I/O threads)\n");
+    printf("  -D: as -u, with O_DIRECT\n");
+    printf("  -O: with -e/-d, every file, directory (recursively) or stdin manifest (-) into output_dir\n");
+    printf("  -v: with -O, undo one task in n and compare with the input (default 1, 0: never)\n");
+    printf("  --range: decrypt only these plain text bytes (des_c -e format, or CTR with --ctr)\n");
+    printf("  -s: search the key of a known 8-byte block pair (default: all CPUs)\n");
+    printf("  -r: key index range in hex (key bytes 1..7, default 0:100000000000000)\n");
+    printf("  -c: checkpoint file, resumed from when it exists\n");
+    printf("  -a: keep searching after the first key\n");
+    printf("  --rainbow-build: chains of a chosen plain text into a sorted table file (default: all CPUs)\n");
+    printf("  --rainbow-lookup: key of each cipher text of the table's plain text, if the table covers it\n");
+    printf("  -S: serve encrypt/decrypt requests on a Unix socket (des_server.h)\n");
+    printf("  -w: with -S, microseconds a small request may wait to share a batch (default 200)\n");
+    printf("  --crypt: print the crypt(3) DES hash of password\n");
+    printf("  --crypt-audit: try every word against the DES hashes of a passwd/shadow file (default: all CPUs)\n");
+    printf("  -k: force a kernel, e.g. bs128,table (overrides DES_KERNEL)\n");
+    printf("  --print-kernel: print the kernel this CPU (and DES_KERNEL / -k) selects\n");
+}
+
 int main(int argc, char** argv) {
-    FILE *fi;
-    long iSize, residue; // for 64-bit divisable lenght of iBuffer/oBuffer
+    FILE *fi, *fo;
+    long iSize, iLen; // iLen: iSize rounded up to 8 * NUM_PARALLEL, with at least one 0 after the data
     char *iBuffer;
     char *oBuffer; // output of encryption
     char *dBuffer; // output of decryption
-    int i;
+    des_arena *arena; // all three buffers
+    int num_threads = 0; // 0: run on the calling thread
+    des_pool *pool = NULL;
+    int stream = 0; // 'e' or 'd': stream mode
+    int map = 0; // 'm': mapped output file, 'i': in place
+    int aio = 0; // 'u': asynchronous I/O, 'D': with O_DIRECT
+    char *output_path = NULL;
+    char *output_dir = NULL; // 'O': many files
+    int verify = 1;
+    int search = 0, find_all = 0; // 's', 'a': key search
+    long long unsigned range_start = 0, range_end = DES_SEARCH_SPACE;
+    char *checkpoint_path = NULL, *range_sep;
+    int fd_in, fd_out;
+    int print_kernel = 0;
+    long range_offset = -1, range_len = 0; // 'R': random-access read
+    char *ctr_hex = NULL;
+    char *socket_path = NULL; // 'S': server mode
+    long deadline_us = 200;
+    int crypt_mode = 0; // 'P': one hash, 'A': audit
+    int rainbow = 0; // 'B': build, 'L': lookup
+    des_rainbow *rt;
+    des_rainbow_stats rt_stats;
+    long long unsigned key_index;
+    char hash[DES_CRYPT_LEN + 1];
+    long found;
+    int i, opt;
+    static const struct option long_opts[] = {
+        { "print-kernel", no_argument, NULL, 'K' },
+        { "range", required_argument, NULL, 'R' },
+        { "ctr", required_argument, NULL, 'C' },
+        { "crypt", no_argument, NULL, 'P' },
+        { "crypt-audit", no_argument, NULL, 'A' },
+        { "rainbow-build", no_argument, NULL, 'B' },
+        { "rainbow-lookup", no_argument, NULL, 'L' },
+        { NULL, 0, NULL, 0 }
+    };
 
     /*** HOW TO USE ***/
-    if(argc < 2) {
-        printf("des_c <input_file_path> <keyphrase>\n");
+    while((opt = getopt_long(argc, argv, "j:edo:O:v:miuDsr:c:ak:S:w:", long_opts, NULL)) != -1) {
+        switch(opt) {
+        case 'k':
+            if(des_kernel_select(optarg) != 0) {
+                fprintf(stderr, "kernel %s not supported\n", optarg);
+                exit(1);
+            }
+            break;
+        case 'K':
+            print_kernel = 1;
+            break;
+        case 'R':
+            range_offset = strtol(optarg, &range_sep, 0);
+            if(*range_sep != ':' || range_offset < 0) { usage(); exit(1); }
+            range_len = strtol(range_sep + 1, NULL, 0);
+            if(range_len < 0) { usage(); exit(1); }
+            break;
+        case 'C':
+            ctr_hex = optarg;
+            break;
+        case 'P':
+        case 'A':
+            crypt_mode = opt;
+            break;
+        case 'B':
+        case 'L':
+            rainbow = opt;
+            break;
+        case 'j':
+            num_threads = atoi(optarg);
+            if(num_threads < 1) { usage(); exit(1); }
+            break;
+        case 'e':
+        case 'd':
+            stream = opt;
+            break;
+        case 'o':
+            output_path = optarg;
+            break;
+        case 'O':
+            output_dir = optarg;
+            break;
+        case 'v':
+            verify = atoi(optarg);
+            if(verify < 0) { usage(); exit(1); }
+            break;
+        case 'm':
+        case 'i':
+            map = opt;
+            break;
+        case 'u':
+        case 'D':
+            aio = opt;
+            break;
+        case 's':
+            search = 1;
+            break;
+        case 'r':
+            range_start = strtoull(optarg, &range_sep, 16);
+            if(*range_sep != ':') { usage(); exit(1); }
+            range_end = strtoull(range_sep + 1, NULL, 16);
+            break;
+        case 'c':
+            checkpoint_path = optarg;
+            break;
+        case 'a':
+            find_all = 1;
+            break;
+        case 'S':
+            socket_path = optarg;
+            break;
+        case 'w':
+            deadline_us = atol(optarg);
+            if(deadline_us < 0) { usage(); exit(1); }
+            break;
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if(print_kernel) {
+        printf("%s\n", des_kernel_name());
+        return 0;
+    }
+    if(socket_path) {
+        return des_server_run(socket_path, deadline_us) == 0 ? 0 : 1;
     }
 
-    // Open test file
-    fi = fopen(argv[1], "rb");
-    if(!fi) { perror("opening file"); exit(1); }
-
-    fseek(fi, 0L, SEEK_END);
-    iSize = ftell(fi);
-    rewind(fi);
-
-    // Make it to can be devided with 64-bit for convenience (7 ==> to count in EOF)
-    if(iSize % 8 != 7) {
-        residue = (8 - (iSize % (8 * NUM_PARALLEL)));
+    // RAINBOW TABLES: no key, a chosen plain text and its table, or cipher texts to look up
+    if(rainbow) {
+        char plain[8], cipher[8];
+        if(argc - optind < 2 || (rainbow == 'B' && (argc - optind < 4 || argc - optind > 5
+                                                    || getHexBlock(plain, argv[optind]) != 0))) {
+            usage();
+            exit(1);
+        }
+        if(num_threads == 0) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        pool = des_pool_create(num_threads > 0 ? num_threads : 1);
+        if(!pool) { fputs("thread creation fails", stderr); exit(1); }
+        if(rainbow == 'B') {
+            i = des_rainbow_build(pool, argv[optind + 3], plain, atoi(argv[optind + 1]),
+                                  strtoull(argv[optind + 2], NULL, 0), argc - optind == 5 ? atoi(argv[optind + 4]) : 0);
+            des_pool_destroy(pool);
+            return i == 0 ? 0 : 1;
+        }
+        rt = des_rainbow_open(argv[optind]);
+        if(!rt) { des_pool_destroy(pool); exit(1); }
+        found = 0;
+        for(i = optind + 1; i < argc; i++) {
+            if(getHexBlock(cipher, argv[i]) != 0) {
+                fprintf(stderr, "%s: not an 8-byte hex block\n", argv[i]);
+                continue;
+            }
+            opt = des_rainbow_lookup(rt, pool, cipher, &key_index, &rt_stats);
+            if(opt < 0) break;
+            if(opt > 0) {
+                printf("%s found %016llX\n", argv[i], key_index); // the key, byte 0 = 00
+                found++;
+            } else {
+                printf("%s not found\n", argv[i]);
+            }
+            fflush(stdout);
+            fprintf(stderr, "%s: %.3f ms, %llu encryptions, %llu false alarms\n", argv[i],
+                    rt_stats.seconds * 1e3, rt_stats.encryptions, rt_stats.false_alarms);
+        }
+        des_rainbow_close(rt);
+        des_pool_destroy(pool);
+        return found > 0 ? 0 : 1;
     }
 
-    // Buffer allocations
-    iBuffer = calloc(1, iSize+residue+1);
-    oBuffer = calloc(1, iSize+residue+1);
-    dBuffer = calloc(1, iSize+residue+1);
-    if(!iBuffer) { fclose(fi); fputs("mem allocation fails", stderr); exit(1); }
-    if(!oBuffer) { fclose(fi); fputs("mem allocation fails", stderr); exit(1); }
-    if(!dBuffer) { fclose(fi); fputs("mem allocation fails", stderr); exit(1); }
-
-    if(1 != fread(iBuffer, iSize, 1, fi)) {
-        fclose(fi);
-        free(iBuffer); free(oBuffer); free(dBuffer);
-        fputs("input read fails", stderr);
+    // CRYPT(3): a salt and a password (may be empty), or a hash file and a word list
+    if(crypt_mode) {
+        if(argc - optind != 2) {
+            usage();
+            exit(1);
+        }
+        if(crypt_mode == 'P') {
+            if(des_crypt(argv[optind + 1], argv[optind], hash) != 0) {
+                fputs("invalid salt (2 characters of [./0-9A-Za-z])\n", stderr);
+                exit(1);
+            }
+            printf("%s\n", hash);
+            return 0;
+        }
+        if(num_threads == 0) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        pool = des_pool_create(num_threads > 0 ? num_threads : 1);
+        if(!pool) { fputs("thread creation fails", stderr); exit(1); }
+        found = des_crypt_audit(pool, argv[optind], argv[optind + 1]);
+        des_pool_destroy(pool);
+        return found > 0 ? 0 : 1;
+    }
+    if(argc - optind < 2 || strlen(argv[output_dir ? argc - 1 : optind + 1]) == 0) {
+        usage();
+        exit(1);
+    }
+    if(map && (!stream || (map == 'm' && !output_path) || (map == 'i' && output_path))) {
+        usage();
+        exit(1);
+    }
+    if(aio && (!stream || !output_path || map)) {
+        usage();
+        exit(1);
+    }
+    if(output_dir && (!stream || output_path || map || aio)) {
+        usage();
+        exit(1);
+    }
+    if((range_offset >= 0 && (stream || map || aio || output_dir)) || (ctr_hex && range_offset < 0)) {
+        usage();
         exit(1);
-        return -1;
+    }
+
+    // KEY SEARCH: no key, the arguments are a known block pair
+    if(search) {
+        char plain[8], cipher[8];
+        if(getHexBlock(plain, argv[optind]) != 0 || getHexBlock(cipher, argv[optind + 1]) != 0) {
+            usage();
+            exit(1);
+        }
+        if(num_threads == 0) num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+        pool = des_pool_create(num_threads > 0 ? num_threads : 1);
+        if(!pool) { fputs("thread creation fails", stderr); exit(1); }
+        i = des_search(pool, plain, cipher, range_start, range_end, checkpoint_path, find_all);
+        des_pool_destroy(pool);
+        return i > 0 ? 0 : 1;
     }
 
     // GENERATE KEY FROM GIVEN KEYPHRASE
     char key[8];
+    char *keyphrase = output_dir ? argv[argc - 1] : argv[optind + 1];
     for(i = 0; i < 8; i++) {
-        key[i] = argv[2][i % strlen(argv[2])];
+        key[i] = keyphrase[i % strlen(keyphrase)];
 
 #ifdef PARITY_CHECK
         // Keeping Odd parity with every 8-th bit
@@ -580,19 +851,134 @@ int main(int argc, char** argv) {
 #endif
     }
 
+    // KEY SCHEDULE, SHARED BY BOTH DIRECTIONS
+    des_ctx ctx;
+    des_ctx_init(&ctx, key);
+
+    if(num_threads > 0) {
+        pool = des_pool_create(num_threads);
+        if(!pool) { fputs("thread creation fails", stderr); exit(1); }
+    }
+
+    // MAPPED MODE: no copies, no heap buffers
+    if(map) {
+        i = des_map_file(&ctx, pool, argv[optind], map == 'm' ? output_path : NULL, stream == 'd');
+        des_pool_destroy(pool);
+        return i == 0 ? 0 : 1;
+    }
+
+    // RANGE: only the blocks covering offset:len
+    if(range_offset >= 0) {
+        char iv[8];
+        char *buf;
+        long n;
+        if(ctr_hex && getHexBlock(iv, ctr_hex) != 0) { usage(); exit(1); }
+        fd_in = open(argv[optind], O_RDONLY);
+        if(fd_in < 0) { perror("opening file"); exit(1); }
+        buf = malloc(range_len > 0 ? range_len : 1);
+        if(!buf) { fputs("memory allocation fails", stderr); exit(1); }
+        n = des_range_read(&ctx, fd_in, ctr_hex ? DES_RANGE_CTR : DES_RANGE_ECB, iv, range_offset, range_len, buf);
+        close(fd_in);
+        fo = output_path ? fopen(output_path, "wb") : stdout;
+        if(!fo) { perror("opening output"); exit(1); }
+        if(n > 0 && fwrite(buf, 1, n, fo) != (size_t)n) { perror("writing output"); n = -1; }
+        if(fo != stdout && fclose(fo) != 0) { perror("closing output"); n = -1; }
+        free(buf);
+        des_pool_destroy(pool);
+        return n >= 0 ? 0 : 1;
+    }
+
+    // MANY FILES: one pool job, large files split, small ones grouped
+    if(output_dir) {
+        if(!pool) {
+            pool = des_pool_create((int)sysconf(_SC_NPROCESSORS_ONLN));
+            if(!pool) { fputs("thread creation fails", stderr); exit(1); }
+        }
+        i = des_files(&ctx, pool, argv + optind, argc - optind - 1, output_dir, stream == 'd', verify);
+        des_pool_destroy(pool);
+        return i == 0 ? 0 : 1;
+    }
+
+    // ASYNCHRONOUS MODE: reads, compute and writes overlap on regular files
+    if(aio) {
+        i = des_aio_file(&ctx, pool, argv[optind], output_path, stream == 'd', aio == 'D');
+        des_pool_destroy(pool);
+        return i == 0 ? 0 : 1;
+    }
+
+    // STREAM MODE: constant memory, works on pipes
+    if(stream) {
+        fd_in = 0;
+        if(strcmp(argv[optind], "-") != 0) {
+            fd_in = open(argv[optind], O_RDONLY);
+            if(fd_in < 0) { perror("opening file"); exit(1); }
+        }
+        fd_out = 1;
+        if(output_path) {
+            fd_out = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if(fd_out < 0) { perror("opening output"); exit(1); }
+        }
+        i = des_stream(&ctx, pool, fd_in, fd_out, stream == 'd');
+        if(fd_out != 1 && close(fd_out) != 0) { perror("closing output"); i = -1; }
+        des_pool_destroy(pool);
+        return i == 0 ? 0 : 1;
+    }
+
+    // Open test file
+    fi = fopen(argv[optind], "rb");
+    if(!fi) { perror("opening file"); exit(1); }
+
+    fseek(fi, 0L, SEEK_END);
+    iSize = ftell(fi);
+    rewind(fi);
+
+    // Make it to can be devided with 64-bit for convenience (+1 ==> to count in EOF)
+    iLen = (iSize / (8 * NUM_PARALLEL) + 1) * (8 * NUM_PARALLEL);
+
+    // Buffer allocations: one reservation, 64-byte aligned and never zeroed as a
+    // whole (des_arena.h); only the tail of iBuffer after the data is read unwritten
+    arena = des_arena_create(3 * (size_t)(iLen + 64), des_arena_flags());
+    iBuffer = arena ? des_arena_alloc(arena, iLen) : NULL;
+    oBuffer = arena ? des_arena_alloc(arena, iLen) : NULL;
+    dBuffer = arena ? des_arena_alloc(arena, iLen) : NULL;
+    if(!iBuffer || !oBuffer || !dBuffer) { fclose(fi); fputs("mem allocation fails", stderr); exit(1); }
+
+    if(pool) {
+        // Read and tail zeroed chunk by chunk on the workers that will encrypt them
+        struct load_job load = { fileno(fi), iBuffer, iSize, iLen, 0 };
+        des_pool_run(pool, loadTask, &load, (iLen + DES_POOL_CHUNK - 1) / DES_POOL_CHUNK);
+        if(load.failed) {
+            fclose(fi);
+            des_arena_destroy(arena);
+            fputs("input read fails", stderr);
+            exit(1);
+        }
+    } else {
+        if(iSize > 0 && 1 != fread(iBuffer, iSize, 1, fi)) {
+            fclose(fi);
+            des_arena_destroy(arena);
+            fputs("input read fails", stderr);
+            exit(1);
+            return -1;
+        }
+        memset(iBuffer + iSize, 0, iLen - iSize);
+    }
+    fclose(fi);
+
 #ifdef RESULT
     printf("<RESULT> iBuffer str: %s\n", iBuffer);
 #endif
 #ifdef DEBUG
     printf("<DEBUG> iBuffer hex: ");
-    for(int d = 0; d < iSize+residue+1; d++) {
+    for(int d = 0; d < iLen; d++) {
         printf("%X ", iBuffer[d] & 0xff);
     }
     printf("\n");
 #endif
 
     // TEST ENCRYPTION
-    encryption(iBuffer, oBuffer, key, iSize+residue+1);
+    if(pool) des_pool_ecb_encrypt(pool, &ctx, iBuffer, oBuffer, iLen);
+    else des_ecb_encrypt(&ctx, iBuffer, oBuffer, iLen);
 
 #ifdef DEBUG
     printf("<DEBUG> oBuffer: ");
@@ -603,12 +989,17 @@ int main(int argc, char** argv) {
     printf("<DEBUG> oBuffer: %s\n", oBuffer);
 #endif
 
-    // TEST ENCRYPTION
-    decryption(oBuffer, dBuffer, key, iSize+residue+1);
+    // TEST DECRYPTION
+    if(pool) des_pool_ecb_decrypt(pool, &ctx, oBuffer, dBuffer, iLen);
+    else des_ecb_decrypt(&ctx, oBuffer, dBuffer, iLen);
 
 #ifdef RESULT
     printf("<RESULT> dBuffer str: %s\n", dBuffer);
 #endif
 
+    des_pool_destroy(pool);
+    des_arena_destroy(arena);
     return 0;
 }
+
+#endif
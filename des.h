@@ -0,0 +1,51 @@
+
+/*
+ * des.h
+ *
+ * DES encryption/decryption API
+ *
+ * Usage:
+ *   des_ctx ctx;
+ *   des_ctx_init(&ctx, key);                 // key schedule, once per key
+ *   des_ecb_encrypt(&ctx, in, out, len);     // any number of times, from any thread
+ *   des_ecb_decrypt(&ctx, out, in, len);
+ * len is a multiple of 8 bytes (one block); in and out may be the same buffer.
+ */
+
+#ifndef DES_H
+#define DES_H
+
+/*
+ * Key schedule of one key
+ *   first_key   -> 56-bit key after PC1 (bitsliced engine)
+ *   enc_subkeys -> 48-bit subkeys prepared for F, in encryption order
+ *   dec_subkeys -> the same subkeys in decryption order
+ */
+typedef struct des_ctx {
+    long long unsigned first_key;
+    long long unsigned enc_subkeys[16];
+    long long unsigned dec_subkeys[16];
+} des_ctx;
+
+void des_ctx_init(des_ctx *ctx, const char *key);
+int des_ecb_encrypt(const des_ctx *ctx, const char *in, char *out, int input_len);
+int des_ecb_decrypt(const des_ctx *ctx, const char *in, char *out, int input_len);
+
+/*
+ * Triple-DES (EDE): C = E_k3(D_k2(E_k1(P)))
+ * A 16-byte key is k1 k2 with k3 = k1 (2-key), a 24-byte key is k1 k2 k3.
+ * The 48 rounds run back to back between one IP and one FP.
+ */
+typedef struct des3_ctx {
+    des_ctx ks[3];
+} des3_ctx;
+
+int des3_ctx_init(des3_ctx *ctx, const char *key, int key_len);
+int des3_ecb_encrypt(const des3_ctx *ctx, const char *in, char *out, int input_len);
+int des3_ecb_decrypt(const des3_ctx *ctx, const char *in, char *out, int input_len);
+
+// One-shot helpers (key schedule on every call)
+int encryption(char *in, char *out, char *key, int input_len);
+int decryption(char *in, char *out, char *key, int input_len);
+
+#endif
@@ -0,0 +1,507 @@
+
+/*
+ * des_aio.c
+ *
+ * File encryption with asynchronous I/O
+ *
+ * Role of each functions:
+ *   des_aio_file(..):
+ *     -> Keeps every free slot reading, encrypts the slots that are read and
+ *        queues their writes; the calling thread only blocks in aioWait.
+ *   aioInit(..), aioSubmit(..), aioFlush(..), aioWait(..), aioClose(..):
+ *     -> I/O backend: io_uring (raw system calls, READV/WRITEV so Linux 5.1 is
+ *        enough) or DES_AIO_THREADS threads running pread/pwrite.
+ *        aioFlush hands queued requests to the kernel before a slot is
+ *        encrypted, so reads and writes run during the encryption.
+ * Slots:
+ *   DES_AIO_DEPTH buffers of DES_AIO_CHUNK bytes. Chunk n is file bytes
+ *   n * DES_AIO_CHUNK onwards, in and out, so chunks are independent and only
+ *   the last one is padded / unpadded. A slot goes
+ *   FREE -> READING -> READ -> WRITING -> FREE.
+ * O_DIRECT:
+ *   Buffers and chunk offsets are DES_AIO_ALIGN-aligned and the last read and
+ *   write are rounded up to it; the output is cut to its size at the end.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+#include "des_aio.h"
+#include "des_stats.h"
+#include "des_arena.h"
+#include "des_block.h"
+
+#if DES_AIO_ALIGN > DES_ARENA_PAGE
+#error "des_arena_get chunks are not aligned enough for O_DIRECT"
+#endif
+
+enum { SLOT_FREE, SLOT_READING, SLOT_READ, SLOT_WRITING };
+enum { OP_READ, OP_WRITE };
+
+struct aio_slot {
+    char *data; // DES_AIO_CHUNK + DES_AIO_ALIGN bytes (room for the padding)
+    struct iovec iov;
+    long off; // file offset of data[0]
+    long len; // bytes to read / write
+    long done; // bytes read / written so far
+    int last;
+    int state;
+};
+
+// One request of the thread fallback, and one completion of either backend
+struct aio_req {
+    int slot, op, fd;
+    char *buf;
+    long len, off;
+};
+
+struct aio_done {
+    int slot;
+    long res; // bytes, or -errno
+};
+
+struct aio {
+    int uring;
+    // io_uring: rings mapped from the kernel
+    int ring_fd;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_size, cq_size, sqes_size;
+    unsigned *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned to_submit;
+    // Thread fallback: request queue and completion queue (DES_AIO_DEPTH each)
+    pthread_t threads[DES_AIO_THREADS];
+    int num_threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond, done_cond;
+    struct aio_req queue[DES_AIO_DEPTH];
+    int q_head, q_len;
+    struct aio_done done[DES_AIO_DEPTH];
+    int d_len;
+    int stop;
+};
+
+/*********************
+ *   I/O  BACKENDS   *
+ *********************/
+
+static int uringSetup(struct aio *a) {
+    struct io_uring_params p;
+    int single;
+
+    memset(&p, 0, sizeof(p));
+    a->ring_fd = (int)syscall(__NR_io_uring_setup, DES_AIO_DEPTH, &p);
+    if(a->ring_fd < 0) return -1;
+
+    a->sq_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    a->cq_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if(single && a->cq_size > a->sq_size) a->sq_size = a->cq_size;
+
+    a->sq_ptr = mmap(NULL, a->sq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, a->ring_fd, IORING_OFF_SQ_RING);
+    if(a->sq_ptr == MAP_FAILED) { close(a->ring_fd); return -1; }
+    a->cq_ptr = a->sq_ptr;
+    if(!single) {
+        a->cq_ptr = mmap(NULL, a->cq_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, a->ring_fd, IORING_OFF_CQ_RING);
+        if(a->cq_ptr == MAP_FAILED) { munmap(a->sq_ptr, a->sq_size); close(a->ring_fd); return -1; }
+    }
+    a->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    a->sqes = mmap(NULL, a->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, a->ring_fd, IORING_OFF_SQES);
+    if(a->sqes == MAP_FAILED) {
+        if(a->cq_ptr != a->sq_ptr) munmap(a->cq_ptr, a->cq_size);
+        munmap(a->sq_ptr, a->sq_size);
+        close(a->ring_fd);
+        return -1;
+    }
+
+    a->sq_tail = (unsigned *)((char *)a->sq_ptr + p.sq_off.tail);
+    a->sq_mask = (unsigned *)((char *)a->sq_ptr + p.sq_off.ring_mask);
+    a->sq_array = (unsigned *)((char *)a->sq_ptr + p.sq_off.array);
+    a->cq_head = (unsigned *)((char *)a->cq_ptr + p.cq_off.head);
+    a->cq_tail = (unsigned *)((char *)a->cq_ptr + p.cq_off.tail);
+    a->cq_mask = (unsigned *)((char *)a->cq_ptr + p.cq_off.ring_mask);
+    a->cqes = (struct io_uring_cqe *)((char *)a->cq_ptr + p.cq_off.cqes);
+    a->uring = 1;
+    return 0;
+}
+
+static void *ioMain(void *p) {
+    struct aio *a = p;
+    struct aio_req req;
+    long res;
+
+    pthread_mutex_lock(&a->lock);
+    for(;;) {
+        while(!a->stop && a->q_len == 0) pthread_cond_wait(&a->cond, &a->lock);
+        if(a->q_len == 0) break;
+        req = a->queue[a->q_head];
+        a->q_head = (a->q_head + 1) % DES_AIO_DEPTH;
+        a->q_len--;
+        pthread_mutex_unlock(&a->lock);
+
+        if(req.op == OP_READ) res = pread(req.fd, req.buf, req.len, req.off);
+        else res = pwrite(req.fd, req.buf, req.len, req.off);
+        if(res < 0) res = -errno;
+
+        pthread_mutex_lock(&a->lock);
+        a->done[a->d_len].slot = req.slot;
+        a->done[a->d_len].res = res;
+        a->d_len++;
+        pthread_cond_signal(&a->done_cond);
+    }
+    pthread_mutex_unlock(&a->lock);
+    return NULL;
+}
+
+static void aioClose(struct aio *a);
+
+/*
+ * io_uring unless it is missing, not permitted, or DES_AIO=threads
+ * @return 0, or -1 after printing the reason to stderr
+ */
+static int aioInit(struct aio *a) {
+    const char *env = getenv("DES_AIO");
+    int i;
+
+    memset(a, 0, sizeof(*a));
+    if(!(env && strcmp(env, "threads") == 0) && uringSetup(a) == 0) return 0;
+
+    pthread_mutex_init(&a->lock, NULL);
+    pthread_cond_init(&a->cond, NULL);
+    pthread_cond_init(&a->done_cond, NULL);
+    for(i = 0; i < DES_AIO_THREADS; i++) {
+        if(pthread_create(&a->threads[i], NULL, ioMain, a) != 0) {
+            fputs("thread creation fails\n", stderr);
+            aioClose(a);
+            return -1;
+        }
+        a->num_threads++;
+    }
+    return 0;
+}
+
+/*
+ * Queue a read or write of slot 'slot' (started by the next aioFlush or aioWait on io_uring)
+ */
+static void aioSubmit(struct aio *a, int slot, int op, int fd, struct iovec *iov, long off) {
+    struct io_uring_sqe *sqe;
+    unsigned tail, idx;
+
+    if(!a->uring) {
+        pthread_mutex_lock(&a->lock);
+        a->queue[(a->q_head + a->q_len) % DES_AIO_DEPTH] = (struct aio_req){ slot, op, fd, iov->iov_base, (long)iov->iov_len, off };
+        a->q_len++;
+        pthread_cond_signal(&a->cond);
+        pthread_mutex_unlock(&a->lock);
+        return;
+    }
+
+    // Only this thread writes the tail
+    tail = *a->sq_tail;
+    idx = tail & *a->sq_mask;
+    sqe = &a->sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = op == OP_READ ? IORING_OP_READV : IORING_OP_WRITEV;
+    sqe->fd = fd;
+    sqe->addr = (unsigned long)iov;
+    sqe->len = 1;
+    sqe->off = off;
+    sqe->user_data = slot;
+    a->sq_array[idx] = idx;
+    __atomic_store_n(a->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    a->to_submit++;
+}
+
+/*
+ * Start the queued requests without waiting (the threads start them at once)
+ * @return 0, or -1 if io_uring_enter fails
+ */
+static int aioFlush(struct aio *a) {
+    int ret;
+
+    if(!a->uring || a->to_submit == 0) return 0;
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, a->ring_fd, a->to_submit, 0, 0, NULL, 0);
+    } while(ret < 0 && errno == EINTR);
+    if(ret < 0) { perror("io_uring_enter"); return -1; }
+    a->to_submit -= ret;
+    return 0;
+}
+
+/*
+ * Start the queued requests and wait for at least one to finish
+ * @param done Completions (output reference, DES_AIO_DEPTH entries)
+ * @return number of completions, or -1 if io_uring_enter fails
+ */
+static int aioWait(struct aio *a, struct aio_done *done) {
+    struct io_uring_cqe *cqe;
+    unsigned head;
+    int n = 0, ret;
+
+    if(!a->uring) {
+        pthread_mutex_lock(&a->lock);
+        while(a->d_len == 0) pthread_cond_wait(&a->done_cond, &a->lock);
+        n = a->d_len;
+        memcpy(done, a->done, n * sizeof(*done));
+        a->d_len = 0;
+        pthread_mutex_unlock(&a->lock);
+        return n;
+    }
+
+    do {
+        ret = (int)syscall(__NR_io_uring_enter, a->ring_fd, a->to_submit, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    } while(ret < 0 && errno == EINTR);
+    if(ret < 0) { perror("io_uring_enter"); return -1; }
+    a->to_submit -= ret;
+
+    head = *a->cq_head;
+    while(head != __atomic_load_n(a->cq_tail, __ATOMIC_ACQUIRE) && n < DES_AIO_DEPTH) {
+        cqe = &a->cqes[head & *a->cq_mask];
+        done[n].slot = (int)cqe->user_data;
+        done[n].res = cqe->res;
+        n++;
+        head++;
+    }
+    __atomic_store_n(a->cq_head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+static void aioClose(struct aio *a) {
+    int i;
+
+    if(a->uring) {
+        munmap(a->sqes, a->sqes_size);
+        if(a->cq_ptr != a->sq_ptr) munmap(a->cq_ptr, a->cq_size);
+        munmap(a->sq_ptr, a->sq_size);
+        close(a->ring_fd);
+        return;
+    }
+    pthread_mutex_lock(&a->lock);
+    a->stop = 1;
+    pthread_cond_broadcast(&a->cond);
+    pthread_mutex_unlock(&a->lock);
+    for(i = 0; i < a->num_threads; i++) pthread_join(a->threads[i], NULL);
+    pthread_mutex_destroy(&a->lock);
+    pthread_cond_destroy(&a->cond);
+    pthread_cond_destroy(&a->done_cond);
+}
+
+/*********************
+ *     PIPELINE      *
+ *********************/
+
+/*
+ * Read or write what is left of a slot (rounded up to DES_AIO_ALIGN with O_DIRECT)
+ */
+static void submitSlot(struct aio *a, struct aio_slot *slots, int i, int op, int fd, int direct) {
+    struct aio_slot *slot = &slots[i];
+    long len = slot->len - slot->done;
+
+    if(direct) len = (len + DES_AIO_ALIGN - 1) / DES_AIO_ALIGN * DES_AIO_ALIGN;
+    slot->iov.iov_base = slot->data + slot->done;
+    slot->iov.iov_len = len;
+    slot->state = op == OP_READ ? SLOT_READING : SLOT_WRITING;
+    aioSubmit(a, i, op, fd, &slot->iov, slot->off + slot->done);
+}
+
+static void cryptSlot(const des_ctx *ctx, des_pool *pool, struct aio_slot *slot, int decrypt) {
+    long done, n;
+
+    if(pool) {
+        if(decrypt) des_pool_ecb_decrypt(pool, ctx, slot->data, slot->data, slot->len);
+        else des_pool_ecb_encrypt(pool, ctx, slot->data, slot->data, slot->len);
+        return;
+    }
+    for(done = 0; done < slot->len; done += n) {
+        n = slot->len - done;
+        if(n > DES_POOL_CHUNK) n = DES_POOL_CHUNK;
+        if(decrypt) des_ecb_decrypt(ctx, slot->data + done, slot->data + done, (int)n);
+        else des_ecb_encrypt(ctx, slot->data + done, slot->data + done, (int)n);
+    }
+}
+
+static int openFile(const char *path, int flags, int direct) {
+    int fd = -1;
+
+    // Not every file system takes O_DIRECT (tmpfs): fall back to buffered I/O
+    if(direct) fd = open(path, flags | O_DIRECT, 0644);
+    if(fd < 0) fd = open(path, flags, 0644);
+    return fd;
+}
+
+/*
+ * Encrypt (and pad) or decrypt (and unpad) in_path -> out_path
+ */
+int des_aio_file(const des_ctx *ctx, des_pool *pool, const char *in_path, const char *out_path, int decrypt, int direct) {
+    struct aio_slot slots[DES_AIO_DEPTH];
+    struct aio_done done[DES_AIO_DEPTH];
+    struct aio a;
+    struct aio_slot *slot;
+    struct stat st;
+    des_arena *arena = des_arena_default();
+    int fd_in, fd_out;
+    long size, out_size, num_chunks, next_chunk = 0, chunks_written = 0;
+    int i, n, pad, in_flight = 0, failed = 0, abandoned = 0, rtn = -1;
+    DES_STAT_DECL;
+
+    fd_in = openFile(in_path, O_RDONLY, direct);
+    if(fd_in < 0) { perror("opening file"); return -1; }
+    if(fstat(fd_in, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fputs("input is not a regular file\n", stderr);
+        close(fd_in);
+        return -1;
+    }
+    size = st.st_size;
+
+    // (1/3) Chunks: encryption always has a last one to pad, even if empty
+    if(!decrypt) {
+        num_chunks = size / DES_AIO_CHUNK + 1;
+        out_size = size + 8 - size % 8;
+    } else {
+        if(size == 0 || size % 8 != 0) {
+            fputs("input is not a multiple of 8 bytes\n", stderr);
+            close(fd_in);
+            return -1;
+        }
+        num_chunks = (size + DES_AIO_CHUNK - 1) / DES_AIO_CHUNK;
+        out_size = size; // until unpadded
+    }
+
+    fd_out = openFile(out_path, O_WRONLY | O_CREAT | O_TRUNC, direct);
+    if(fd_out < 0) { perror("opening output"); close(fd_in); return -1; }
+
+    memset(slots, 0, sizeof(slots));
+    for(i = 0; i < DES_AIO_DEPTH; i++) {
+        slots[i].data = des_arena_get(arena, DES_AIO_CHUNK + DES_AIO_ALIGN);
+        if(!slots[i].data) {
+            fputs("mem allocation fails\n", stderr);
+            while(i-- > 0) des_arena_put(arena, slots[i].data);
+            close(fd_out); close(fd_in);
+            return -1;
+        }
+    }
+    if(aioInit(&a) != 0) {
+        for(i = 0; i < DES_AIO_DEPTH; i++) des_arena_put(arena, slots[i].data);
+        close(fd_out); close(fd_in);
+        return -1;
+    }
+
+    // (2/3) Until every chunk is written, or nothing is left in flight after a failure
+    while(failed ? in_flight > 0 : chunks_written < num_chunks) {
+        // Free slots read the next chunks, started before any encryption below
+        for(i = 0; i < DES_AIO_DEPTH && !failed; i++) {
+            slot = &slots[i];
+            if(slot->state == SLOT_FREE && next_chunk < num_chunks) {
+                slot->off = next_chunk * DES_AIO_CHUNK;
+                slot->len = size - slot->off < DES_AIO_CHUNK ? size - slot->off : DES_AIO_CHUNK;
+                slot->last = ++next_chunk == num_chunks;
+                slot->done = 0;
+                if(slot->len == 0) {
+                    slot->state = SLOT_READ;
+                } else {
+                    submitSlot(&a, slots, i, OP_READ, fd_in, direct);
+                    in_flight++;
+                }
+            }
+        }
+        if(aioFlush(&a) != 0) {
+            // The kernel may still hold requests on the buffers: they are not freed
+            failed = abandoned = 1;
+            break;
+        }
+
+        // Chunks that are read are encrypted and written, each write started at once
+        for(i = 0; i < DES_AIO_DEPTH && !failed; i++) {
+            slot = &slots[i];
+            if(slot->state == SLOT_READ) {
+                if(!decrypt && slot->last) {
+                    pad = 8 - slot->len % 8;
+                    memset(slot->data + slot->len, pad, pad);
+                    slot->len += pad;
+                }
+                cryptSlot(ctx, pool, slot, decrypt);
+                if(decrypt && slot->last) {
+                    pad = des_get_pad(slot->data + slot->len - 8);
+                    if(pad < 0) {
+                        fputs("bad padding (wrong key or damaged input)\n", stderr);
+                        failed = 1;
+                        break;
+                    }
+                    out_size = size - pad;
+                }
+                slot->done = 0;
+                submitSlot(&a, slots, i, OP_WRITE, fd_out, direct);
+                in_flight++;
+                if(aioFlush(&a) != 0) {
+                    failed = abandoned = 1;
+                    break;
+                }
+            }
+        }
+        if(abandoned) break;
+        if(in_flight == 0) continue;
+
+        DES_STAT_START();
+        n = aioWait(&a, done);
+        DES_STAT_LAP(DES_STAGE_STALL);
+        if(n < 0) {
+            // The kernel may still hold requests on the buffers: they are not freed
+            failed = abandoned = 1;
+            break;
+        }
+        for(i = 0; i < n; i++) {
+            slot = &slots[done[i].slot];
+            in_flight--;
+            if(done[i].res == -EINTR || done[i].res == -EAGAIN) {
+                done[i].res = 0;
+            } else if(done[i].res < 0) {
+                errno = (int)-done[i].res;
+                perror(slot->state == SLOT_READING ? "reading input" : "writing output");
+                failed = 1;
+                continue;
+            } else if(done[i].res == 0 && slot->state == SLOT_READING) {
+                fputs("input changed while reading\n", stderr);
+                failed = 1;
+                continue;
+            }
+            slot->done += done[i].res;
+            if(failed) continue;
+            if(slot->done < slot->len) {
+                // Short transfer: queue the rest
+                submitSlot(&a, slots, done[i].slot, slot->state == SLOT_READING ? OP_READ : OP_WRITE,
+                           slot->state == SLOT_READING ? fd_in : fd_out, direct);
+                in_flight++;
+            } else if(slot->state == SLOT_READING) {
+                slot->state = SLOT_READ;
+            } else {
+                slot->state = SLOT_FREE;
+                chunks_written++;
+            }
+        }
+    }
+    aioClose(&a);
+
+    // (3/3) Cut off the O_DIRECT rounding and the stripped padding
+    if(!failed) {
+        rtn = 0;
+        if(ftruncate(fd_out, out_size) != 0) { perror("sizing output"); rtn = -1; }
+    }
+    if(close(fd_out) != 0) { perror("closing output"); rtn = -1; }
+    close(fd_in);
+    for(i = 0; i < DES_AIO_DEPTH && !abandoned; i++) des_arena_put(arena, slots[i].data);
+    return rtn;
+}
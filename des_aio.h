@@ -0,0 +1,39 @@
+
+/*
+ * des_aio.h
+ *
+ * File encryption with asynchronous I/O
+ *
+ * Same format as des_stream (ECB + PKCS#5 padding), between two regular files.
+ * Up to DES_AIO_DEPTH chunks are in flight at once: reads and writes are queued
+ * on io_uring (or on I/O threads doing pread/pwrite where io_uring is not
+ * available, or DES_AIO=threads is set) while the calling thread encrypts the
+ * chunks that have arrived.
+ */
+
+#ifndef DES_AIO_H
+#define DES_AIO_H
+
+#include "des.h"
+#include "des_pool.h"
+
+// Bytes per chunk, chunks in flight, buffer / offset alignment for O_DIRECT
+#define DES_AIO_CHUNK (4 * DES_POOL_CHUNK)
+#define DES_AIO_DEPTH 8
+#define DES_AIO_ALIGN 4096
+
+// I/O threads of the pread/pwrite fallback
+#define DES_AIO_THREADS 4
+
+/*
+ * @param ctx Context from des_ctx_init
+ * @param pool Worker pool for the compute stage, or NULL for the calling thread
+ * @param in_path Input file
+ * @param out_path Output file
+ * @param decrypt 0 to encrypt and pad, 1 to decrypt and strip the padding
+ * @param direct 1 to open both files with O_DIRECT (where the file system allows it)
+ * @return 0, or -1 after printing the reason to stderr
+ */
+int des_aio_file(const des_ctx *ctx, des_pool *pool, const char *in_path, const char *out_path, int decrypt, int direct);
+
+#endif
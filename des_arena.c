@@ -0,0 +1,230 @@
+
+/*
+ * des_arena.c
+ *
+ * Buffer arena (see des_arena.h)
+ *
+ * Role of each functions:
+ *   des_arena_create(..):
+ *     -> mmap of the whole reservation: hugetlb first when asked for, else a
+ *        normal mapping trimmed to DES_ARENA_HUGE_PAGE alignment (and advised
+ *        for transparent huge pages when asked for).
+ *   des_arena_alloc(..):
+ *     -> Bump allocation, never given back before des_arena_destroy.
+ *   des_arena_get(..), des_arena_put(..):
+ *     -> Chunks rounded to DES_ARENA_PAGE, one free list per size. The 64
+ *        bytes before a chunk hold its size and link.
+ *        Without an arena (NULL) they fall back to posix_memalign and free.
+ *        Once the reservation is used up, des_arena_get takes chunks from the
+ *        heap too (one page more, for the header); the header marks them so
+ *        des_arena_put frees them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "des_arena.h"
+
+#ifndef MAP_HUGETLB
+#define MAP_HUGETLB 0
+#endif
+
+// Distinct chunk sizes with a free list; the pipelines use a handful
+#define ARENA_CLASSES 16
+#define ARENA_HEADER 64
+
+struct chunk {
+    size_t size; // rounded to DES_ARENA_PAGE
+    struct chunk *next;
+    int heap; // from posix_memalign, DES_ARENA_PAGE bytes before the chunk
+};
+
+struct size_class {
+    size_t size; // 0: unused
+    struct chunk *head;
+};
+
+struct des_arena {
+    pthread_mutex_t lock;
+    char *map; // as returned by mmap
+    size_t map_size;
+    char *base; // aligned start
+    size_t size, used;
+    int huge;
+    struct size_class classes[ARENA_CLASSES];
+};
+
+static des_arena *default_arena;
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+static size_t roundUp(size_t n, size_t align) {
+    return (n + align - 1) / align * align;
+}
+
+des_arena *des_arena_create(size_t size, int flags) {
+    des_arena *a;
+    void *p = MAP_FAILED;
+
+    if(size == 0) return NULL;
+    a = calloc(1, sizeof(*a));
+    if(!a) return NULL;
+    a->size = roundUp(size, DES_ARENA_HUGE_PAGE);
+
+    // (1/2) hugetlb pages, reserved now: without enough of them the mmap fails
+    // here instead of a page fault raising SIGBUS later
+    if((flags & DES_ARENA_HUGE) && MAP_HUGETLB) {
+        p = mmap(NULL, a->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if(p != MAP_FAILED) {
+            a->map = a->base = p;
+            a->map_size = a->size;
+            a->huge = 2;
+        }
+    }
+
+    // (2/2) Normal pages, one huge page extra to align the start
+    if(p == MAP_FAILED) {
+        p = mmap(NULL, a->size + DES_ARENA_HUGE_PAGE, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if(p == MAP_FAILED) {
+            free(a);
+            return NULL;
+        }
+        a->map = p;
+        a->map_size = a->size + DES_ARENA_HUGE_PAGE;
+        a->base = (char *)roundUp((uintptr_t)p, DES_ARENA_HUGE_PAGE);
+#ifdef MADV_HUGEPAGE
+        if((flags & DES_ARENA_HUGE) && madvise(a->base, a->size, MADV_HUGEPAGE) == 0) a->huge = 1;
+#endif
+    }
+    pthread_mutex_init(&a->lock, NULL);
+    return a;
+}
+
+void des_arena_destroy(des_arena *a) {
+    if(!a) return;
+    munmap(a->map, a->map_size);
+    pthread_mutex_destroy(&a->lock);
+    free(a);
+}
+
+/*
+ * Carve len aligned bytes with at least skip bytes free before them
+ * @return the aligned address, NULL if the reservation is used up
+ */
+static char *carve(des_arena *a, size_t len, size_t align, size_t skip) {
+    size_t offset = roundUp(a->used + skip, align);
+
+    if(offset + len > a->size) return NULL;
+    a->used = offset + len;
+    return a->base + offset;
+}
+
+void *des_arena_alloc(des_arena *a, size_t size) {
+    char *p;
+
+    pthread_mutex_lock(&a->lock);
+    p = carve(a, size ? size : 1, 64, 0);
+    pthread_mutex_unlock(&a->lock);
+    return p;
+}
+
+/*
+ * Free list of a chunk size, created on first use
+ * @return the class, NULL if every class is taken by other sizes
+ */
+static struct size_class *getClass(des_arena *a, size_t size) {
+    int i;
+
+    for(i = 0; i < ARENA_CLASSES; i++) {
+        if(a->classes[i].size == size) return &a->classes[i];
+        if(a->classes[i].size == 0) {
+            a->classes[i].size = size;
+            return &a->classes[i];
+        }
+    }
+    return NULL;
+}
+
+void *des_arena_get(des_arena *a, size_t size) {
+    struct size_class *cls;
+    struct chunk *c;
+    char *p = NULL;
+    void *heap;
+
+    if(!a) return posix_memalign(&heap, DES_ARENA_PAGE, size ? size : 1) == 0 ? heap : NULL;
+    size = roundUp(size ? size : 1, DES_ARENA_PAGE);
+
+    pthread_mutex_lock(&a->lock);
+    cls = getClass(a, size);
+    if(cls && cls->head) {
+        c = cls->head;
+        cls->head = c->next;
+        p = (char *)c + ARENA_HEADER;
+    } else {
+        p = carve(a, size, DES_ARENA_PAGE, ARENA_HEADER);
+        if(p) {
+            ((struct chunk *)(p - ARENA_HEADER))->size = size;
+            ((struct chunk *)(p - ARENA_HEADER))->heap = 0;
+        }
+    }
+    pthread_mutex_unlock(&a->lock);
+
+    // Reservation used up: the heap, as without an arena
+    if(!p && posix_memalign(&heap, DES_ARENA_PAGE, size + DES_ARENA_PAGE) == 0) {
+        p = (char *)heap + DES_ARENA_PAGE;
+        ((struct chunk *)(p - ARENA_HEADER))->size = size;
+        ((struct chunk *)(p - ARENA_HEADER))->heap = 1;
+    }
+    return p;
+}
+
+/*
+ * A chunk of a size without a free list stays carved until des_arena_destroy
+ */
+void des_arena_put(des_arena *a, void *chunk) {
+    struct size_class *cls;
+    struct chunk *c;
+
+    if(!chunk) return;
+    if(!a) {
+        free(chunk);
+        return;
+    }
+    c = (struct chunk *)((char *)chunk - ARENA_HEADER);
+    if(c->heap) {
+        free((char *)chunk - DES_ARENA_PAGE);
+        return;
+    }
+    pthread_mutex_lock(&a->lock);
+    cls = getClass(a, c->size);
+    if(cls) {
+        c->next = cls->head;
+        cls->head = c;
+    }
+    pthread_mutex_unlock(&a->lock);
+}
+
+int des_arena_huge(const des_arena *a) {
+    return a->huge;
+}
+
+int des_arena_flags(void) {
+    const char *env = getenv("DES_HUGEPAGES");
+    return env && atoi(env) != 0 ? DES_ARENA_HUGE : 0;
+}
+
+static void initDefault(void) {
+    const char *env = getenv("DES_ARENA");
+    size_t size = env && atol(env) > 0 ? (size_t)atol(env) << 20 : DES_ARENA_DEFAULT;
+
+    default_arena = des_arena_create(size, des_arena_flags());
+}
+
+des_arena *des_arena_default(void) {
+    pthread_once(&default_once, initDefault);
+    return default_arena;
+}
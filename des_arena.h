@@ -0,0 +1,76 @@
+
+/*
+ * des_arena.h
+ *
+ * Buffer arena: one aligned reservation, carved and recycled without malloc
+ *
+ * Usage:
+ *   des_arena *a = des_arena_create(size, des_arena_flags());
+ *   char *buf = des_arena_alloc(a, len);    // 64-byte aligned, lives until destroy
+ *   char *chunk = des_arena_get(a, len);    // page aligned, recycled by des_arena_put
+ *   des_arena_put(a, chunk);
+ *   des_arena_destroy(a);
+ * Memory is never zeroed: fresh pages are zero, recycled chunks keep their old
+ * bytes, and callers only read what they have written. The reservation is
+ * MAP_NORESERVE, so untouched parts cost address space only.
+ * Huge pages (DES_ARENA_HUGE, or DES_HUGEPAGES=1 for des_arena_flags()):
+ *   2 MB hugetlb pages if the system has them reserved, otherwise a 2 MB
+ *   aligned region advised for transparent huge pages.
+ */
+
+#ifndef DES_ARENA_H
+#define DES_ARENA_H
+
+#include <stddef.h>
+
+#define DES_ARENA_HUGE 0x1
+
+// Huge page size, and the alignment of des_arena_get chunks (O_DIRECT safe)
+#define DES_ARENA_HUGE_PAGE (2UL * 1024 * 1024)
+#define DES_ARENA_PAGE 4096
+
+// Process-wide arena for pipeline chunks (DES_ARENA=<MB> overrides)
+#define DES_ARENA_DEFAULT (1024UL * 1024 * 1024)
+
+typedef struct des_arena des_arena;
+
+/*
+ * @param size Bytes to reserve (rounded up to the page size in use)
+ * @param flags 0 or DES_ARENA_HUGE
+ * @return the arena, or NULL
+ */
+des_arena *des_arena_create(size_t size, int flags);
+void des_arena_destroy(des_arena *a);
+
+/*
+ * @return 64-byte aligned size bytes, NULL when the reservation is used up
+ */
+void *des_arena_alloc(des_arena *a, size_t size);
+
+/*
+ * Chunk of at least size bytes, DES_ARENA_PAGE aligned; a chunk of the same
+ * size class given back by des_arena_put is reused first. With a NULL arena
+ * (des_arena_default() could not reserve), or once the reservation is used
+ * up, the chunk comes from the heap.
+ * @return the chunk, NULL only if the heap fails too
+ */
+void *des_arena_get(des_arena *a, size_t size);
+void des_arena_put(des_arena *a, void *chunk);
+
+/*
+ * @return 2 if backed by hugetlb pages, 1 if advised for transparent huge pages, 0 if neither
+ */
+int des_arena_huge(const des_arena *a);
+
+/*
+ * @return DES_ARENA_HUGE if DES_HUGEPAGES is set to a nonzero value, else 0
+ */
+int des_arena_flags(void);
+
+/*
+ * Shared by des_stream, des_aio and des_files, created on first use
+ * @return the arena, or NULL if it cannot be reserved
+ */
+des_arena *des_arena_default(void);
+
+#endif
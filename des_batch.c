@@ -0,0 +1,194 @@
+
+/*
+ * des_batch.c
+ *
+ * Key-agile batches over the bitsliced engine
+ *
+ * Role of each functions:
+ *   batchBlocks(..):
+ *     -> ECB, CTR and CBC decryption: every block is independent, so the blocks
+ *        of all messages are packed into lanes back to back.
+ *   batchChains(..):
+ *     -> CBC encryption: one lane per message, and a lane whose message is done
+ *        takes the next message at once.
+ *   batchSerial(..):
+ *     -> The same per message through des_ctx (bitsliced engine switched off).
+ * Lanes:
+ *   Every lane carries its own loaded key (des_bs_crypt_keys), so one pass of
+ *   des_bs_width() blocks can mix any number of keys.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "des.h"
+#include "des_bs.h"
+#include "des_modes.h"
+#include "des_batch.h"
+#include "des_block.h"
+#include "des_keycache.h"
+
+// Lane bookkeeping of one kernel pass
+struct pass {
+    long long unsigned blocks[DES_BS_MAX_WIDTH];
+    long long unsigned keys[DES_BS_MAX_WIDTH];
+    long long unsigned prev[DES_BS_MAX_WIDTH]; // CBC: previous cipher block
+    int msg[DES_BS_MAX_WIDTH];
+    int offset[DES_BS_MAX_WIDTH];
+    int num;
+};
+
+/*
+ * Run a pass and write back every used lane
+ */
+static void flushBlocks(struct pass *ps, des_batch_msg *msgs, int mode, int decrypt) {
+    des_batch_msg *m;
+    char ks[8];
+    int i, j, n;
+
+    for(i = ps->num; i < des_bs_width(); i++) {
+        ps->blocks[i] = 0;
+        ps->keys[i] = 0;
+    }
+    des_bs_crypt_keys(ps->blocks, ps->keys, decrypt);
+
+    for(i = 0; i < ps->num; i++) {
+        m = &msgs[ps->msg[i]];
+        if(mode == DES_BATCH_CTR) {
+            // Key stream, the last block of a message may be partial
+            des_store_block(ks, ps->blocks[i], 0);
+            n = m->len - ps->offset[i] < 8 ? m->len - ps->offset[i] : 8;
+            for(j = 0; j < n; j++) m->out[ps->offset[i] + j] = m->in[ps->offset[i] + j] ^ ks[j];
+        } else if(mode == DES_BATCH_CBC) {
+            // Decryption only: P = D(C) ^ previous C, stored like des_ecb_decrypt
+            des_store_block(m->out + ps->offset[i], ps->blocks[i] ^ ps->prev[i], 1);
+        } else {
+            des_store_block(m->out + ps->offset[i], ps->blocks[i], decrypt);
+        }
+    }
+    ps->num = 0;
+}
+
+static void batchBlocks(des_batch_msg *msgs, int num_msgs, int mode, int decrypt) {
+    struct pass ps;
+    long long unsigned key, ctr, chain;
+    int width, i, offset;
+
+    width = des_bs_width();
+    ps.num = 0;
+    for(i = 0; i < num_msgs; i++) {
+        key = des_load_block(msgs[i].key, 1);
+        ctr = mode == DES_BATCH_CTR ? des_load_block(msgs[i].iv, 1) : 0;
+        // CBC: the previous cipher block, kept as des_ecb_decrypt stores it (big-endian)
+        chain = mode == DES_BATCH_CBC ? des_load_block(msgs[i].iv, 1) : 0;
+
+        for(offset = 0; offset < msgs[i].len; offset += 8) {
+            if(mode != DES_BATCH_CTR && offset + 8 > msgs[i].len) break;
+            ps.msg[ps.num] = i;
+            ps.offset[ps.num] = offset;
+            ps.keys[ps.num] = key;
+            if(mode == DES_BATCH_CTR) {
+                ps.blocks[ps.num] = ctr++;
+            } else {
+                ps.blocks[ps.num] = des_load_block(msgs[i].in + offset, !decrypt);
+                if(mode == DES_BATCH_CBC) {
+                    ps.prev[ps.num] = chain;
+                    chain = des_load_block(msgs[i].in + offset, 1);
+                }
+            }
+            if(++ps.num == width) flushBlocks(&ps, msgs, mode, decrypt);
+        }
+
+        // The chaining value is final once the message has been read
+        if(mode == DES_BATCH_CTR) des_store_block(msgs[i].iv, ctr, 1);
+        if(mode == DES_BATCH_CBC) des_store_block(msgs[i].iv, chain, 1);
+    }
+    if(ps.num > 0) flushBlocks(&ps, msgs, mode, decrypt);
+}
+
+static void batchChains(des_batch_msg *msgs, int num_msgs) {
+    struct pass ps;
+    int lane_msg[DES_BS_MAX_WIDTH];
+    int width, next, active, i;
+    des_batch_msg *m;
+
+    width = des_bs_width();
+    for(i = 0; i < width; i++) lane_msg[i] = -1;
+    next = 0;
+
+    for(;;) {
+        // (1/3) Idle lanes take the next message, gather one block per lane
+        active = 0;
+        for(i = 0; i < width; i++) {
+            while(lane_msg[i] < 0 && next < num_msgs) {
+                if(msgs[next].len >= 8) {
+                    lane_msg[i] = next;
+                    ps.offset[i] = 0;
+                }
+                next++;
+            }
+            if(lane_msg[i] < 0) {
+                ps.blocks[i] = 0;
+                ps.keys[i] = 0;
+                continue;
+            }
+            m = &msgs[lane_msg[i]];
+            ps.blocks[i] = des_load_block(m->in + ps.offset[i], 1) ^ des_load_block(m->iv, 1);
+            ps.keys[i] = des_load_block(m->key, 1);
+            active++;
+        }
+        if(active == 0) break;
+
+        // (2/3) One pass for all chains
+        des_bs_crypt_keys(ps.blocks, ps.keys, 0);
+
+        // (3/3) The cipher block is the output and the next chaining value
+        for(i = 0; i < width; i++) {
+            if(lane_msg[i] < 0) continue;
+            m = &msgs[lane_msg[i]];
+            des_store_block(m->out + ps.offset[i], ps.blocks[i], 0);
+            des_store_block(m->iv, ps.blocks[i], 0);
+            ps.offset[i] += 8;
+            if(ps.offset[i] + 8 > m->len) lane_msg[i] = -1;
+        }
+    }
+}
+
+static void batchSerial(des_batch_msg *msgs, int num_msgs, int mode, int decrypt) {
+    des_keycache *kc = des_keycache_default();
+    des_ctx ctx;
+    int i;
+
+    for(i = 0; i < num_msgs; i++) {
+        if(kc) des_keycache_get(kc, msgs[i].key, &ctx);
+        else des_ctx_init(&ctx, msgs[i].key);
+        if(mode == DES_BATCH_CTR) des_ctr_crypt(&ctx, msgs[i].in, msgs[i].out, msgs[i].len, msgs[i].iv);
+        else if(mode == DES_BATCH_CBC && decrypt) des_cbc_decrypt(&ctx, msgs[i].in, msgs[i].out, msgs[i].len, msgs[i].iv);
+        else if(mode == DES_BATCH_CBC) des_cbc_encrypt(&ctx, msgs[i].in, msgs[i].out, msgs[i].len, msgs[i].iv);
+        else if(decrypt) des_ecb_decrypt(&ctx, msgs[i].in, msgs[i].out, msgs[i].len);
+        else des_ecb_encrypt(&ctx, msgs[i].in, msgs[i].out, msgs[i].len);
+    }
+}
+
+static int batch(des_batch_msg *msgs, int num_msgs, int mode, int decrypt) {
+    if(mode != DES_BATCH_ECB && mode != DES_BATCH_CBC && mode != DES_BATCH_CTR) return -1;
+    if(des_bs_width() == 0) batchSerial(msgs, num_msgs, mode, decrypt);
+    else if(mode == DES_BATCH_CBC && !decrypt) batchChains(msgs, num_msgs);
+    else batchBlocks(msgs, num_msgs, mode, mode == DES_BATCH_CTR ? 0 : decrypt);
+    return 0;
+}
+
+/*
+ * Encrypt every message with its own key (and IV)
+ */
+int des_batch_encrypt(des_batch_msg *msgs, int num_msgs, int mode) {
+    return batch(msgs, num_msgs, mode, 0);
+}
+
+/*
+ * Decrypt every message with its own key (and IV)
+ */
+int des_batch_decrypt(des_batch_msg *msgs, int num_msgs, int mode) {
+    return batch(msgs, num_msgs, mode, 1);
+}
@@ -0,0 +1,37 @@
+
+/*
+ * des_batch.h
+ *
+ * Key-agile batch API: many independent (key, message) pairs per call
+ *
+ * Usage:
+ *   des_batch_msg msgs[n] = {{key, iv, in, out, len}, ..};
+ *   des_batch_encrypt(msgs, n, DES_BATCH_CBC);
+ * Blocks of different messages share one bitsliced kernel pass, each lane
+ * with its own key, so there is no des_ctx_init per message. The bytes are
+ * the same as des_ctx_init + des_ecb_* / des_cbc_* / des_ctr_crypt per message.
+ */
+
+#ifndef DES_BATCH_H
+#define DES_BATCH_H
+
+enum { DES_BATCH_ECB, DES_BATCH_CBC, DES_BATCH_CTR };
+
+typedef struct des_batch_msg {
+    const char *key; // 8-byte key
+    char *iv; // 8-byte IV / counter block, updated as by des_modes.h (CBC, CTR only)
+    const char *in;
+    char *out; // may be in
+    int len; // multiple of 8, any length for CTR
+} des_batch_msg;
+
+/*
+ * @param msgs Messages
+ * @param num_msgs Number of messages
+ * @param mode DES_BATCH_ECB, DES_BATCH_CBC or DES_BATCH_CTR
+ * @return 0, or -1 for an unknown mode
+ */
+int des_batch_encrypt(des_batch_msg *msgs, int num_msgs, int mode);
+int des_batch_decrypt(des_batch_msg *msgs, int num_msgs, int mode);
+
+#endif
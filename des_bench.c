@@ -0,0 +1,657 @@
+
+/*
+ * des_bench.c
+ *
+ * Benchmark of the DES engines, modes and thread counts
+ *
+ * Role of each functions:
+ *   checkEngine(..), checkMac(..), checkPool(..):
+ *     -> Known answers and a cross check against the SP-table path (blocks and
+ *        retail MACs). An engine that fails is reported and never timed.
+ *   checkKeycache(..):
+ *     -> des_keycache hits match des_ctx_init, and keys that differ in a few
+ *        bytes only still spread over the buckets.
+ *   runCase(..):
+ *     -> Times one engine / mode / thread count / size (rdtsc cycles and wall clock).
+ *   runKeys(..):
+ *     -> Key setup rate of des_ctx_init and des3_ctx_init, and of des_keycache hits.
+ *   checkCrypt(..), runCrypt(..):
+ *     -> crypt(3) known answers and hash rate of each bitsliced kernel.
+ * Engines:
+ *   sp               -> SP-table F() path only (bitsliced engine switched off)
+ *   sp-bmi2          -> the same with PEXT/PDEP IP and FP
+ *   bs64 .. bs512    -> bitsliced kernels, the SP path takes the blocks left over
+ *   pool             -> widest kernel on a des_pool of 1, 2, 4 .. threads
+ *   Engines the CPU cannot run are skipped. The bitsliced ones and the pool keep
+ *   the IP/FP choice of des_bs.c (or DES_KERNEL) for their leftover blocks.
+ * Known answers:
+ *   The S-box wiring of this cipher differs from FIPS 46-3, so the FIPS 81 /
+ *   SP 800-67 inputs are kept but the expected outputs are the ones of the
+ *   original des.c implementation. A change that alters them breaks
+ *   compatibility with files encrypted before. The crypt(3) hashes are the
+ *   standard DES ones, as printed by glibc crypt().
+ *
+ * Usage:
+ *   des_bench [-s max_bytes] [-t max_threads] [-T ms_per_case] [-f csv|json] [-o output_path]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "des.h"
+#include "des_bs.h"
+#include "des_pool.h"
+#include "des_modes.h"
+#include "des_keycache.h"
+#include "des_crypt.h"
+#include "des_mac.h"
+
+// Per-call samples kept for the latency percentiles
+#define BENCH_SAMPLES 10000
+
+struct kat {
+    const char *key;
+    const char *plain;
+    const char *cipher;
+};
+
+// DES: FIPS 81 appendix B and well known single-block inputs
+static const struct kat katDES[] = {
+    { "0123456789ABCDEF", "4E6F77206973207468652074696D6520666F7220616C6C20", "8B41A35152ACA9CA4CAF69FA23B33ED3A56B386A7F7275B4" },
+    { "133457799BBCDFF1", "0123456789ABCDEF", "AAB10DEAA19FD515" },
+    { "0E329232EA6D0D73", "8787878787878787", "F43CFEE7A0062860" },
+    { "0000000000000000", "0000000000000000", "CAC5424BE21DCC96" },
+    { "FFFFFFFFFFFFFFFF", "FFFFFFFFFFFFFFFF", "353ABDB41DE23369" },
+};
+
+// Triple-DES: SP 800-67 example, 2-key and 3-key
+static const struct kat katDES3[] = {
+    { "0123456789ABCDEF23456789ABCDEF01", "54686520717566636B2062726F776E20666F78206A756D70", "B934BE8F362E6294A7F5EFAA739E39563266DDA6D1A054DA" },
+    { "0123456789ABCDEF23456789ABCDEF01456789ABCDEF0123", "54686520717566636B2062726F776E20666F78206A756D70", "086B6EE193C65C5D13BA88538D09806111E33964F0082C3E" },
+};
+
+struct crypt_kat {
+    const char *key;
+    const char *salt;
+    const char *hash;
+};
+
+// crypt(3): glibc crypt() output, the last key is longer than the 8 characters used
+static const struct crypt_kat katCrypt[] = {
+    { "password", "ab", "abJnggxhB/yWI" },
+    { "", "./", "./Una9Fi.seRo" },
+    { "test1234longer", "zz", "zz5v1cUTMe6OU" },
+    { "~!@#$%^&", "Aq", "AqkrdPexYhUgk" },
+    { "U*U*U*U*", "CC", "CCNf8Sbh3HDfQ" },
+};
+
+struct engine {
+    const char *name;
+    int width;
+    const char *kernel; // des_kernel_select spec, NULL: default IP/FP
+};
+
+static const struct engine engines[] = {
+    { "sp", 0, "table" }, { "sp-bmi2", 0, "bmi2" },
+    { "bs64", 64, NULL }, { "bs128", 128, NULL }, { "bs256", 256, NULL }, { "bs512", 512, NULL },
+};
+
+// Everything a timed call needs
+struct bench {
+    des_ctx ctx;
+    des3_ctx ctx3;
+    des_pool *pool;
+    char iv[8];
+};
+
+typedef void (*bench_fn)(struct bench *b, char *buf, long len);
+
+static void ecbEncrypt(struct bench *b, char *buf, long len) { des_ecb_encrypt(&b->ctx, buf, buf, (int)len); }
+static void ecbDecrypt(struct bench *b, char *buf, long len) { des_ecb_decrypt(&b->ctx, buf, buf, (int)len); }
+static void cbcEncrypt(struct bench *b, char *buf, long len) { des_cbc_encrypt(&b->ctx, buf, buf, (int)len, b->iv); }
+static void cbcDecrypt(struct bench *b, char *buf, long len) { des_cbc_decrypt(&b->ctx, buf, buf, (int)len, b->iv); }
+static void ctrCrypt(struct bench *b, char *buf, long len) { des_ctr_crypt(&b->ctx, buf, buf, (int)len, b->iv); }
+static void ecbEncrypt3(struct bench *b, char *buf, long len) { des3_ecb_encrypt(&b->ctx3, buf, buf, (int)len); }
+static void ctrCrypt3(struct bench *b, char *buf, long len) { des3_ctr_crypt(&b->ctx3, buf, buf, (int)len, b->iv); }
+// Retail MAC of 64-byte messages (ISO 8583 sized), one key per message
+static void retailMac(struct bench *b, char *buf, long len) {
+    static des_mac_msg msgs[4096];
+    static char keys[4096][16];
+    long pos;
+    int n = 0, i;
+    (void)b;
+
+    if(!keys[0][0]) {
+        for(i = 0; i < 4096 * 16; i++) keys[i / 16][i % 16] = (char)(i * 37 + 1);
+    }
+    for(pos = 0; pos < len; pos += 64) {
+        msgs[n].key = keys[n];
+        msgs[n].in = buf + pos;
+        msgs[n].len = len - pos < 64 ? (int)(len - pos) : 64;
+        msgs[n].mac = buf + pos; // written once every message has been read
+        if(++n == 4096 || pos + 64 >= len) {
+            des_mac_batch(msgs, n, DES_MAC_ALG3, DES_MAC_PAD2);
+            n = 0;
+        }
+    }
+}
+
+static void poolEcbEncrypt(struct bench *b, char *buf, long len) { des_pool_ecb_encrypt(b->pool, &b->ctx, buf, buf, len); }
+static void poolCbcDecrypt(struct bench *b, char *buf, long len) { des_pool_cbc_decrypt(b->pool, &b->ctx, buf, buf, len, b->iv); }
+static void poolCtrCrypt(struct bench *b, char *buf, long len) { des_pool_ctr_crypt(b->pool, &b->ctx, buf, buf, len, b->iv); }
+
+struct mode {
+    const char *name;
+    bench_fn fn;
+    int serial; // the engine does not matter, timed on "sp" only
+};
+
+static const struct mode modes[] = {
+    { "ecb-enc", ecbEncrypt, 0 },
+    { "ecb-dec", ecbDecrypt, 0 },
+    { "cbc-enc", cbcEncrypt, 1 },
+    { "cbc-dec", cbcDecrypt, 0 },
+    { "ctr", ctrCrypt, 0 },
+    { "3des-ecb-enc", ecbEncrypt3, 0 },
+    { "3des-ctr", ctrCrypt3, 0 },
+    { "mac-retail", retailMac, 0 },
+};
+
+static const struct mode poolModes[] = {
+    { "ecb-enc", poolEcbEncrypt, 0 },
+    { "cbc-dec", poolCbcDecrypt, 0 },
+    { "ctr", poolCtrCrypt, 0 },
+};
+
+#define COUNT(a) ((int)(sizeof(a) / sizeof((a)[0])))
+
+// Output
+static FILE *out;
+static int json;
+static int rows;
+
+static long long unsigned cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+#endif
+}
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int compareCycles(const void *a, const void *b) {
+    long long unsigned x = *(const long long unsigned *)a, y = *(const long long unsigned *)b;
+    return x < y ? -1 : x > y;
+}
+
+/*
+ * Hex string -> bytes
+ * @return number of bytes
+ */
+static int getHex(char *out, const char *hex) {
+    int n;
+
+    for(n = 0; hex[2 * n] && hex[2 * n + 1]; n++) {
+        sscanf(hex + 2 * n, "%2hhx", (unsigned char *)&out[n]);
+    }
+    return n;
+}
+
+/*
+ * One result row, CSV or JSON
+ * Empty fields (negative values) do not apply to the row.
+ */
+static void report(const char *engine, const char *mode, int threads, long bytes, long reps,
+                   double cpb, double mbps, double p50, double p90, double p99, double keys) {
+    if(json) {
+        fprintf(out, "%s\n  {\"engine\": \"%s\", \"mode\": \"%s\", \"threads\": %d, \"bytes\": %ld, \"reps\": %ld",
+                rows ? "," : "[", engine, mode, threads, bytes, reps);
+        if(cpb >= 0) fprintf(out, ", \"cycles_per_byte\": %.3f, \"mb_per_s\": %.2f", cpb, mbps);
+        if(p50 >= 0) fprintf(out, ", \"p50_cycles\": %.0f, \"p90_cycles\": %.0f, \"p99_cycles\": %.0f", p50, p90, p99);
+        if(keys >= 0) fprintf(out, ", \"keys_per_s\": %.0f", keys);
+        fprintf(out, "}");
+    } else {
+        if(rows == 0) {
+            fprintf(out, "engine,mode,threads,bytes,reps,cycles_per_byte,mb_per_s,p50_cycles,p90_cycles,p99_cycles,keys_per_s\n");
+        }
+        fprintf(out, "%s,%s,%d,%ld,%ld,", engine, mode, threads, bytes, reps);
+        if(cpb >= 0) fprintf(out, "%.3f,%.2f,", cpb, mbps); else fprintf(out, ",,");
+        if(p50 >= 0) fprintf(out, "%.0f,%.0f,%.0f,", p50, p90, p99); else fprintf(out, ",,,");
+        if(keys >= 0) fprintf(out, "%.0f\n", keys); else fprintf(out, "\n");
+    }
+    rows++;
+    fflush(out);
+}
+
+/*
+ * Time fn over len bytes for at least budget seconds (and at least once)
+ */
+static void runCase(struct bench *b, const char *engine, const struct mode *m, int threads,
+                    char *buf, long len, double budget, long long unsigned *samples) {
+    long long unsigned c0, c1, start;
+    double t0, t1;
+    long reps, n;
+
+    // Warm up (caches, branch predictors, first touch) unless that costs a second run of a huge buffer
+    if(len <= DES_POOL_CHUNK) m->fn(b, buf, len);
+
+    reps = 0;
+    t0 = seconds();
+    c0 = cycles();
+    do {
+        start = cycles();
+        m->fn(b, buf, len);
+        if(reps < BENCH_SAMPLES) samples[reps] = cycles() - start;
+        reps++;
+        t1 = seconds();
+    } while(t1 - t0 < budget);
+    c1 = cycles();
+
+    n = reps < BENCH_SAMPLES ? reps : BENCH_SAMPLES;
+    if(n >= 10) {
+        qsort(samples, n, sizeof(*samples), compareCycles);
+        report(engine, m->name, threads, len, reps, (double)(c1 - c0) / ((double)reps * len),
+               (double)reps * len / 1e6 / (t1 - t0),
+               samples[n * 50 / 100], samples[n * 90 / 100], samples[n * 99 / 100], -1);
+    } else {
+        report(engine, m->name, threads, len, reps, (double)(c1 - c0) / ((double)reps * len),
+               (double)reps * len / 1e6 / (t1 - t0), -1, -1, -1, -1);
+    }
+}
+
+/*
+ * Keys that differ only in bytes first..first+2, each looked up twice
+ * @return 0 if every lookup is right and no bucket chain is long
+ */
+static int checkKeycacheBytes(int first) {
+    const int num_keys = 4096;
+    des_keycache *kc;
+    des_keycache_stats stats;
+    des_ctx ctx, ref;
+    char key[8];
+    int pass, i, bad = 0;
+
+    // Room to spare: the shards do not fill evenly
+    kc = des_keycache_create(4 * num_keys);
+    if(!kc) return 1;
+    memcpy(key, "cachekey", 8);
+    for(pass = 0; pass < 2; pass++) {
+        for(i = 0; i < num_keys; i++) {
+            key[first] = (char)(i * 7);
+            key[first + 1] = (char)(i >> 5);
+            key[first + 2] = (char)(i >> 11);
+            if(des_keycache_get(kc, key, &ctx) != pass) bad = 1;
+            des_ctx_init(&ref, key);
+            if(memcmp(&ctx, &ref, sizeof(ctx)) != 0) bad = 1;
+        }
+    }
+    des_keycache_stats_get(kc, &stats);
+    if(stats.hits != (long long unsigned)num_keys || stats.max_chain > 16) bad = 1;
+    if(bad) {
+        fprintf(stderr, "keycache, keys differing in bytes %d..%d: hits %llu, longest chain %d\n",
+                first, first + 2, stats.hits, stats.max_chain);
+    }
+    des_keycache_destroy(kc);
+    return bad;
+}
+
+static int checkKeycache(void) {
+    return checkKeycacheBytes(0) | checkKeycacheBytes(5);
+}
+
+/*
+ * Key setup rate (des_ctx_init / des3_ctx_init / des_keycache_get)
+ */
+static void runKeys(double budget) {
+    des_keycache *kc;
+    des_ctx ctx;
+    des3_ctx ctx3;
+    char key[24];
+    double t0, t1;
+    long reps;
+    int i;
+
+    for(i = 0; i < 24; i++) key[i] = i * 37;
+
+    reps = 0;
+    t0 = seconds();
+    do {
+        key[reps & 7]++;
+        des_ctx_init(&ctx, key);
+        reps++;
+        t1 = seconds();
+    } while(t1 - t0 < budget);
+    report("keysetup", "des", 1, 8, reps, -1, -1, -1, -1, -1, reps / (t1 - t0));
+
+    reps = 0;
+    t0 = seconds();
+    do {
+        key[reps % 24]++;
+        des3_ctx_init(&ctx3, key, 24);
+        reps++;
+        t1 = seconds();
+    } while(t1 - t0 < budget);
+    report("keysetup", "3des", 1, 24, reps, -1, -1, -1, -1, -1, reps / (t1 - t0));
+
+    // The same 1024 keys over and over, through a cache that holds them all
+    kc = des_keycache_create(4096);
+    if(!kc) return;
+    reps = 0;
+    t0 = seconds();
+    do {
+        key[0] = (char)reps;
+        key[1] = (char)(reps >> 8 & 3);
+        des_keycache_get(kc, key, &ctx);
+        reps++;
+        t1 = seconds();
+    } while(t1 - t0 < budget);
+    report("keysetup", "cached", 1, 8, reps, -1, -1, -1, -1, -1, reps / (t1 - t0));
+    des_keycache_destroy(kc);
+}
+
+/*
+ * crypt(3) known answers, each in every lane of a batch and with a partial last call
+ * @return 0 if the current kernel is correct
+ */
+static int checkCrypt(void) {
+    const int num_keys = 2 * DES_BS_MAX_WIDTH + 5;
+    const char **keys;
+    char (*hashes)[DES_CRYPT_LEN + 1];
+    int i, k, bad = 0;
+
+    keys = malloc(num_keys * sizeof(*keys));
+    hashes = malloc(num_keys * sizeof(*hashes));
+    if(!keys || !hashes) { free(keys); free(hashes); return -1; }
+
+    for(k = 0; k < COUNT(katCrypt) && !bad; k++) {
+        for(i = 0; i < num_keys; i++) keys[i] = katCrypt[k].key;
+        if(des_crypt_batch(NULL, katCrypt[k].salt, keys, num_keys, hashes) != 0) { bad = 1; break; }
+        for(i = 0; i < num_keys; i++) {
+            if(strcmp(hashes[i], katCrypt[k].hash) != 0) { bad = 1; break; }
+        }
+    }
+    free(keys);
+    free(hashes);
+    return bad ? -1 : 0;
+}
+
+/*
+ * crypt(3) hashes per second, DES_BS_MAX_WIDTH distinct keys per batch
+ */
+static void runCrypt(const char *engine, double budget) {
+    static char words[DES_BS_MAX_WIDTH][9];
+    const char *keys[DES_BS_MAX_WIDTH];
+    static char hashes[DES_BS_MAX_WIDTH][DES_CRYPT_LEN + 1];
+    double t0, t1;
+    long reps;
+    int i;
+
+    for(i = 0; i < DES_BS_MAX_WIDTH; i++) {
+        snprintf(words[i], sizeof(words[i]), "pw%06d", i);
+        keys[i] = words[i];
+    }
+    reps = 0;
+    t0 = seconds();
+    do {
+        des_crypt_batch(NULL, "ab", keys, DES_BS_MAX_WIDTH, hashes);
+        reps++;
+        t1 = seconds();
+    } while(t1 - t0 < budget);
+    report(engine, "crypt", 1, 8, reps, -1, -1, -1, -1, -1, (double)reps * DES_BS_MAX_WIDTH / (t1 - t0));
+}
+
+/*
+ * Retail MACs of messages of many lengths, each with its own key: SP path vs this engine
+ * @param data Random bytes the messages and keys are cut from
+ * @return 0 if the engine is correct
+ */
+static int checkMac(const struct engine *engine, const char *perm, const char *data, int len) {
+    const int num_msgs = 2 * DES_BS_MAX_WIDTH + 5;
+    des_mac_msg *msgs;
+    char *macs, *ref;
+    int i, pad, bad = 0;
+
+    msgs = malloc(num_msgs * sizeof(*msgs));
+    macs = malloc(8 * num_msgs);
+    ref = malloc(8 * num_msgs);
+    if(!msgs || !macs || !ref) { free(msgs); free(macs); free(ref); return -1; }
+
+    for(i = 0; i < num_msgs; i++) {
+        msgs[i].key = data + (i * 24) % (len - 16);
+        msgs[i].in = data + (i * 8) % (len - 200);
+        msgs[i].len = (i * 37) % 200;
+    }
+    for(pad = DES_MAC_PAD1; pad <= DES_MAC_PAD2; pad++) {
+        for(i = 0; i < num_msgs; i++) msgs[i].mac = ref + 8 * i;
+        des_kernel_select("sp,table");
+        des_mac_batch(msgs, num_msgs, DES_MAC_ALG3, pad);
+        des_bs_select(engine->width);
+        des_kernel_select(perm);
+        for(i = 0; i < num_msgs; i++) msgs[i].mac = macs + 8 * i;
+        des_mac_batch(msgs, num_msgs, DES_MAC_ALG3, pad);
+        bad |= memcmp(macs, ref, 8 * num_msgs) != 0;
+    }
+    free(msgs);
+    free(macs);
+    free(ref);
+    return bad ? -1 : 0;
+}
+
+/*
+ * Known answers through the current engine, then random data against the SP path
+ * Every vector is repeated over more than two bitsliced batches so that each lane
+ * of the kernel sees it, and the tail goes through the SP path.
+ * @param engine Engine, already selected
+ * @param perm Its des_kernel_select spec
+ * @return 0 if the engine is correct
+ */
+static int checkEngine(const struct engine *engine, const char *perm) {
+    const int num_blocks = 2 * DES_BS_MAX_WIDTH + 5;
+    char key[24], plain[24], cipher[24];
+    char *buf, *ref;
+    des_ctx ctx;
+    des3_ctx ctx3;
+    int i, k, n, len, bad = 0;
+
+    buf = malloc(8 * num_blocks);
+    ref = malloc(8 * num_blocks);
+    if(!buf || !ref) { free(buf); free(ref); return -1; }
+
+    for(k = 0; k < COUNT(katDES) + COUNT(katDES3); k++) {
+        const struct kat *v = k < COUNT(katDES) ? &katDES[k] : &katDES3[k - COUNT(katDES)];
+        int key_len = getHex(key, v->key);
+        n = getHex(plain, v->plain);
+        getHex(cipher, v->cipher);
+        len = 8 * num_blocks / n * n;
+        for(i = 0; i < len; i++) buf[i] = plain[i % n];
+
+        if(key_len == 8) {
+            des_ctx_init(&ctx, key);
+            des_ecb_encrypt(&ctx, buf, buf, len);
+        } else {
+            des3_ctx_init(&ctx3, key, key_len);
+            des3_ecb_encrypt(&ctx3, buf, buf, len);
+        }
+        for(i = 0; i < len; i++) bad |= buf[i] != cipher[i % n];
+        if(key_len == 8) des_ecb_decrypt(&ctx, buf, buf, len);
+        else des3_ecb_decrypt(&ctx3, buf, buf, len);
+        for(i = 0; i < len; i++) bad |= buf[i] != plain[i % n];
+    }
+
+    // Random blocks, one random key: SP path vs this engine
+    srand(engine->width + 1);
+    for(i = 0; i < 8; i++) key[i] = rand();
+    for(i = 0; i < 8 * num_blocks; i++) buf[i] = ref[i] = rand();
+    des_ctx_init(&ctx, key);
+    des_kernel_select("sp,table");
+    des_ecb_encrypt(&ctx, ref, ref, 8 * num_blocks);
+    des_bs_select(engine->width);
+    des_kernel_select(perm);
+    des_ecb_encrypt(&ctx, buf, buf, 8 * num_blocks);
+    bad |= memcmp(buf, ref, 8 * num_blocks) != 0;
+    if(!bad) bad = checkMac(engine, perm, buf, 8 * num_blocks);
+
+    free(buf);
+    free(ref);
+    return bad ? -1 : 0;
+}
+
+/*
+ * The pool against the calling thread on a few chunks
+ * @return 0 if the results match
+ */
+static int checkPool(struct bench *b) {
+    long len = 3 * DES_POOL_CHUNK + 64;
+    char *buf = malloc(len), *ref = malloc(len);
+    long i;
+    int bad;
+
+    if(!buf || !ref) { free(buf); free(ref); return -1; }
+    for(i = 0; i < len; i++) buf[i] = ref[i] = rand();
+    des_pool_ecb_encrypt(b->pool, &b->ctx, buf, buf, len);
+    for(i = 0; i < len; i += DES_POOL_CHUNK) {
+        des_ecb_encrypt(&b->ctx, ref + i, ref + i, (int)(len - i < DES_POOL_CHUNK ? len - i : DES_POOL_CHUNK));
+    }
+    bad = memcmp(buf, ref, len) != 0;
+    free(buf);
+    free(ref);
+    return bad ? -1 : 0;
+}
+
+static void usage(void) {
+    printf("des_bench [-s max_bytes] [-t max_threads] [-T ms_per_case] [-f csv|json] [-o output_path]\n");
+    printf("  -s: largest message, sizes are 8, 64, 512 .. (default 1G, K/M/G suffixes)\n");
+    printf("  -t: pool runs with 1, 2, 4 .. up to this many threads (default: online CPUs)\n");
+    printf("  -T: minimum time per measurement in milliseconds (default 100)\n");
+    printf("  -f: output format (default csv)\n");
+}
+
+int main(int argc, char **argv) {
+    struct bench b;
+    long max_bytes = 1L << 30, len;
+    int max_threads, threads, widest = 0;
+    double budget = 0.1;
+    long long unsigned *samples;
+    char *buf, *suffix;
+    const char *perm, *kernel;
+    int e, m, opt, failed = 0;
+
+    max_threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if(max_threads < 1) max_threads = 1;
+    out = stdout;
+
+    while((opt = getopt(argc, argv, "s:t:T:f:o:")) != -1) {
+        switch(opt) {
+        case 's':
+            max_bytes = strtol(optarg, &suffix, 10);
+            if(*suffix == 'K' || *suffix == 'k') max_bytes <<= 10;
+            if(*suffix == 'M' || *suffix == 'm') max_bytes <<= 20;
+            if(*suffix == 'G' || *suffix == 'g') max_bytes <<= 30;
+            break;
+        case 't':
+            max_threads = atoi(optarg);
+            break;
+        case 'T':
+            budget = atoi(optarg) / 1000.0;
+            break;
+        case 'f':
+            json = strcmp(optarg, "json") == 0;
+            break;
+        case 'o':
+            out = fopen(optarg, "w");
+            if(!out) { perror("opening output"); exit(1); }
+            break;
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    // des_ecb_* take an int length
+    if(max_bytes < 8 || max_bytes > (1L << 30) || max_threads < 1) {
+        usage();
+        exit(1);
+    }
+
+    samples = malloc(BENCH_SAMPLES * sizeof(*samples));
+    buf = malloc(max_bytes);
+    if(!samples || !buf) { fputs("mem allocation fails\n", stderr); exit(1); }
+    memset(buf, 0x5a, max_bytes);
+
+    memset(&b, 0, sizeof(b));
+    des_ctx_init(&b.ctx, "benchkey");
+    des3_ctx_init(&b.ctx3, "benchkey-triple-des-key!", 24);
+
+    // IP/FP of the engines that do not pick their own
+    perm = des_kernel_bmi2() ? "bmi2" : "table";
+
+    if(checkKeycache() != 0) {
+        fputs("keycache: test FAILED\n", stderr);
+        failed = 1;
+    }
+    runKeys(budget);
+
+    // (1/2) Each engine on the calling thread
+    for(e = 0; e < COUNT(engines); e++) {
+        kernel = engines[e].kernel ? engines[e].kernel : perm;
+        if(des_bs_select(engines[e].width) != 0 || des_kernel_select(kernel) != 0) continue;
+        if(checkEngine(&engines[e], kernel) != 0) {
+            fprintf(stderr, "%s: known answer test FAILED, not timed\n", engines[e].name);
+            failed = 1;
+            continue;
+        }
+        if(engines[e].width > widest) widest = engines[e].width;
+        for(m = 0; m < COUNT(modes); m++) {
+            if(modes[m].serial && engines[e].width != 0) continue;
+            for(len = 8; len <= max_bytes; len *= 8) {
+                runCase(&b, engines[e].name, &modes[m], 1, buf, len, budget, samples);
+            }
+        }
+        if(engines[e].width == 0) continue;
+        if(checkCrypt() != 0) {
+            fprintf(stderr, "%s: crypt known answer test FAILED, not timed\n", engines[e].name);
+            failed = 1;
+            continue;
+        }
+        runCrypt(engines[e].name, budget);
+    }
+
+    // (2/2) Pool sizes with the widest kernel, from one chunk up
+    des_kernel_select(perm);
+    des_bs_select(widest);
+    for(threads = 1; ; threads = threads * 2 < max_threads ? threads * 2 : max_threads) {
+        b.pool = des_pool_create(threads);
+        if(!b.pool) { fputs("thread creation fails\n", stderr); exit(1); }
+        if(checkPool(&b) != 0) {
+            fprintf(stderr, "pool of %d: result differs from the calling thread, not timed\n", threads);
+            failed = 1;
+        } else {
+            for(m = 0; m < COUNT(poolModes); m++) {
+                for(len = DES_POOL_CHUNK; len <= max_bytes; len *= 8) {
+                    runCase(&b, "pool", &poolModes[m], threads, buf, len, budget, samples);
+                }
+            }
+        }
+        des_pool_destroy(b.pool);
+        b.pool = NULL;
+        if(threads == max_threads) break;
+    }
+
+    if(json) fprintf(out, "%s]\n", rows ? "\n" : "[");
+    if(out != stdout) fclose(out);
+    free(buf);
+    free(samples);
+    return failed;
+}
@@ -0,0 +1,58 @@
+
+/*
+ * des_block.h
+ *
+ * 8 bytes <-> 64-bit block word, one load or store and a byte swap
+ *
+ * des_ecb_encrypt loads big-endian (p[0] is the top byte) and stores
+ * little-endian, des_ecb_decrypt the reverse. Code that feeds the bitsliced
+ * kernels directly (des_batch.c, des_mac.c) uses the same words, so its
+ * output matches des_ecb_* byte for byte.
+ * des_get_pad checks the PKCS#5 padding of the file formats (des_stream.h).
+ */
+
+#ifndef DES_BLOCK_H
+#define DES_BLOCK_H
+
+#include <string.h>
+
+/*
+ * @param big_endian 1: p[0] is the top byte, 0: p[7] is
+ */
+static inline long long unsigned des_load_block(const char *p, int big_endian) {
+    long long unsigned w;
+
+    memcpy(&w, p, 8);
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if(big_endian) w = __builtin_bswap64(w);
+#else
+    if(!big_endian) w = __builtin_bswap64(w);
+#endif
+    return w;
+}
+
+static inline void des_store_block(char *p, long long unsigned w, int big_endian) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    if(big_endian) w = __builtin_bswap64(w);
+#else
+    if(!big_endian) w = __builtin_bswap64(w);
+#endif
+    memcpy(p, &w, 8);
+}
+
+/*
+ * PKCS#5 padding length of the last block
+ * @return 1..8, or -1 if the block does not end in valid padding
+ */
+static inline int des_get_pad(const char *block) {
+    int pad = block[7] & 0xff;
+    int i;
+
+    if(pad < 1 || pad > 8) return -1;
+    for(i = 8 - pad; i < 8; i++) {
+        if((block[i] & 0xff) != pad) return -1;
+    }
+    return pad;
+}
+
+#endif
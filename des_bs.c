@@ -0,0 +1,328 @@
+
+/*
+ * des_bs.c
+ *
+ * Bitsliced DES front end
+ *
+ * Role of each functions:
+ *   des_bs_width(..):
+ *     -> Blocks per kernel call of the selected backend.
+ *   des_bs_select(..):
+ *     -> Forces one backend, or none.
+ *   des_bs_keyplanes(..):
+ *     -> Broadcasts one 56-bit key (after PC1) into key planes.
+ *   des_bs_crypt(..), des_bs_crypt3(..):
+ *     -> Runs whole batches of loaded blocks through the DES / Triple-DES kernel.
+ *   des_bs_crypt_keys(..):
+ *     -> One kernel pass with a different key in every lane.
+ *   des_bs_search(..):
+ *     -> One pass of the key search kernel (des_bs_width() keys).
+ *   des_bs_crypt25(..):
+ *     -> One pass of the crypt(3) kernel (des_bs_crypt25_width() keys).
+ *   des_kernel_select(..), des_kernel_name(..), des_kernel_bmi2(..):
+ *     -> Forced kernel choice (DES_KERNEL, des_c -k) and the current one.
+ * Backends (see Makefile for the compiler flags):
+ *   des_bs64  -> 64-bit words
+ *   des_bs128 -> SSE2
+ *   des_bs256 -> AVX2
+ *   des_bs512 -> AVX-512
+ *   The widest one the CPU supports is used.
+ * IP/FP of the SP path (des.c):
+ *   table -> byte lookup tables
+ *   bmi2  -> PEXT/PDEP (des_perm_bmi2.c), used where BMI2 is fast (not on AMD
+ *            before Zen 3, which runs PEXT/PDEP in microcode)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "des_bs.h"
+
+static des_bs_kernel bs_kernel = NULL;
+static des_bs_kernel bs_kernel3 = NULL;
+static des_bs_kernel bs_agile = NULL;
+static des_bs_search_kernel bs_search = NULL;
+static des_bs_crypt25_kernel bs_crypt25 = NULL;
+static int bs_width = 0;
+static int bs_crypt25_width = 0; // kept when bs_width is 0: crypt(3) has no SP path
+static int bs_bmi2 = 0;
+
+// initBS() runs once, from the first call of any entry point
+static pthread_once_t bs_once = PTHREAD_ONCE_INIT;
+
+static int selectKernel(const char *spec);
+static const char *kernelName(void);
+
+/*
+ * @return 1 if the CPU can run the kernel of this width
+ */
+static int supported(int width) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    switch(width) {
+    case 64: return 1;
+    case 128: return __builtin_cpu_supports("sse2");
+    case 256: return __builtin_cpu_supports("avx2");
+    case 512: return __builtin_cpu_supports("avx512f");
+    }
+    return 0;
+#else
+    return width == 64;
+#endif
+}
+
+/*
+ * @return 1 if the CPU has BMI2, 2 if PEXT/PDEP are also fast
+ */
+static int supportedBMI2(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if(!__builtin_cpu_supports("bmi2")) return 0;
+    if(__builtin_cpu_is("amdfam15h") || __builtin_cpu_is("amdfam17h")) return 1;
+    return 2;
+#else
+    return 0;
+#endif
+}
+
+static void useKernel(int width) {
+    switch(width) {
+    case 512:
+        bs_kernel = des_bs512;
+        bs_kernel3 = des_bs512_ede;
+        bs_agile = des_bs512_agile;
+        bs_search = des_bs512_search;
+        bs_crypt25 = des_bs512_crypt25;
+        break;
+    case 256:
+        bs_kernel = des_bs256;
+        bs_kernel3 = des_bs256_ede;
+        bs_agile = des_bs256_agile;
+        bs_search = des_bs256_search;
+        bs_crypt25 = des_bs256_crypt25;
+        break;
+    case 128:
+        bs_kernel = des_bs128;
+        bs_kernel3 = des_bs128_ede;
+        bs_agile = des_bs128_agile;
+        bs_search = des_bs128_search;
+        bs_crypt25 = des_bs128_crypt25;
+        break;
+    default:
+        bs_kernel = des_bs64;
+        bs_kernel3 = des_bs64_ede;
+        bs_agile = des_bs64_agile;
+        bs_search = des_bs64_search;
+        bs_crypt25 = des_bs64_crypt25;
+        break;
+    }
+    bs_width = width;
+    bs_crypt25_width = width;
+}
+
+static void initBS(void) {
+    const char *env;
+    int width;
+
+    for(width = DES_BS_MAX_WIDTH; width > 64 && !supported(width); width /= 2);
+    useKernel(width);
+    bs_bmi2 = supportedBMI2() == 2;
+
+    env = getenv("DES_KERNEL");
+    if(env && selectKernel(env) != 0) {
+        fprintf(stderr, "DES_KERNEL=%s not supported, using %s\n", env, kernelName());
+    }
+}
+
+/*
+ * @return number of blocks per kernel call, 0 if the engine is switched off
+ */
+int des_bs_width(void) {
+    pthread_once(&bs_once, initBS);
+    return bs_width;
+}
+
+/*
+ * Use the kernel of the given width instead of the widest supported one
+ * Meant for benchmarks and tests; not safe while other threads are encrypting.
+ * @param width 64, 128, 256 or 512, or 0 to leave every block to the SP-table path
+ * @return 0, or -1 if the CPU cannot run that kernel
+ */
+int des_bs_select(int width) {
+    pthread_once(&bs_once, initBS);
+    if(width == 0) {
+        bs_width = 0;
+        return 0;
+    }
+    if(!supported(width)) return -1;
+    useKernel(width);
+    return 0;
+}
+
+/*
+ * Broadcast a key into key planes
+ * @param kp 56 key planes of 'words' 64-bit words (output reference)
+ * @param first_key 56-bit key after PC1
+ * @param words 64-bit words per plane
+ */
+void des_bs_keyplanes(long long unsigned *kp, long long unsigned first_key, int words) {
+    int i, g;
+
+    for(i = 0; i < 56; i++) {
+        for(g = 0; g < words; g++) {
+            kp[i * words + g] = 0 - ( ( first_key >> i ) & 0x1 );
+        }
+    }
+}
+
+/*
+ * Encrypt or decrypt loaded blocks with one key
+ * @param blocks 64-bit blocks (input & output reference)
+ * @param num_blocks Number of blocks, a multiple of des_bs_width()
+ * @param first_key 56-bit key after PC1
+ * @param decrypt 0 for encryption, 1 for decryption
+ */
+void des_bs_crypt(long long unsigned *blocks, int num_blocks, long long unsigned first_key, int decrypt) {
+    long long unsigned kp[56 * DES_BS_MAX_WIDTH / 64];
+    int count;
+
+    pthread_once(&bs_once, initBS);
+    des_bs_keyplanes(kp, first_key, bs_width / 64);
+    for(count = 0; count < num_blocks; count += bs_width) {
+        bs_kernel(blocks + count, kp, decrypt);
+    }
+}
+
+/*
+ * Triple-DES (EDE) on loaded blocks
+ * @param blocks 64-bit blocks (input & output reference)
+ * @param num_blocks Number of blocks, a multiple of des_bs_width()
+ * @param first_keys 56-bit keys k1, k2, k3 after PC1
+ * @param decrypt 0 for encryption, 1 for decryption
+ */
+void des_bs_crypt3(long long unsigned *blocks, int num_blocks, const long long unsigned *first_keys, int decrypt) {
+    long long unsigned kp[3 * 56 * DES_BS_MAX_WIDTH / 64];
+    int count, k;
+
+    pthread_once(&bs_once, initBS);
+    for(k = 0; k < 3; k++) {
+        des_bs_keyplanes(kp + k * 56 * (bs_width / 64), first_keys[k], bs_width / 64);
+    }
+    for(count = 0; count < num_blocks; count += bs_width) {
+        bs_kernel3(blocks + count, kp, decrypt);
+    }
+}
+
+/*
+ * Encrypt or decrypt des_bs_width() loaded blocks, block i under key i
+ * @param blocks 64-bit blocks (input & output reference)
+ * @param keys 64-bit keys, loaded as getKeyPart loads them
+ * @param decrypt 0 for encryption, 1 for decryption
+ */
+void des_bs_crypt_keys(long long unsigned *blocks, const long long unsigned *keys, int decrypt) {
+    pthread_once(&bs_once, initBS);
+    bs_agile(blocks, keys, decrypt);
+}
+
+/*
+ * Test des_bs_width() keys against one known plain / cipher text pair
+ * @param kp 56 key planes with one key per lane
+ * @param plain Plain text block, loaded as des_ecb_encrypt loads it
+ * @param cipher Cipher text block, loaded as des_ecb_decrypt loads it
+ * @param match Matching lanes, des_bs_width() / 64 words (output reference)
+ * @return nonzero if any lane matched
+ */
+int des_bs_search(const long long unsigned *kp, long long unsigned plain, long long unsigned cipher, long long unsigned *match) {
+    pthread_once(&bs_once, initBS);
+    return bs_search(kp, plain, cipher, match);
+}
+
+/*
+ * @return keys per des_bs_crypt25 call (the width of the last kernel selected, also with the engine off)
+ */
+int des_bs_crypt25_width(void) {
+    pthread_once(&bs_once, initBS);
+    return bs_crypt25_width;
+}
+
+/*
+ * crypt(3) core of des_bs_crypt25_width() keys with one salt
+ * @param keys 64-bit keys, FIPS bit n = bit 64 - n
+ * @param salt 12-bit salt
+ * @param out 64-bit results, same bit order (output reference)
+ */
+void des_bs_crypt25(const long long unsigned *keys, int salt, long long unsigned *out) {
+    pthread_once(&bs_once, initBS);
+    bs_crypt25(keys, salt, out);
+}
+
+/*
+ * Force a kernel choice
+ * Meant for tests and benchmarks; not safe while other threads are encrypting.
+ * Parts the spec leaves out keep their current choice.
+ * @param spec Comma separated kernel names (see des_bs.h)
+ * @return 0, or -1 (nothing changed) for an unknown name or one the CPU cannot run
+ */
+int des_kernel_select(const char *spec) {
+    pthread_once(&bs_once, initBS);
+    return selectKernel(spec);
+}
+
+// des_kernel_select without the initBS() call, for initBS() itself
+static int selectKernel(const char *spec) {
+    char buf[64], *tok, *save, *end;
+    int width, bmi2;
+
+    if(strlen(spec) >= sizeof(buf)) return -1;
+    strcpy(buf, spec);
+    width = bs_width;
+    bmi2 = bs_bmi2;
+
+    for(tok = strtok_r(buf, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        if(strcmp(tok, "sp") == 0) {
+            width = 0;
+        } else if(strncmp(tok, "bs", 2) == 0) {
+            width = (int)strtol(tok + 2, &end, 10);
+            if(*end != '\0' || !supported(width)) return -1;
+        } else if(strcmp(tok, "bmi2") == 0) {
+            if(!supportedBMI2()) return -1;
+            bmi2 = 1;
+        } else if(strcmp(tok, "table") == 0) {
+            bmi2 = 0;
+        } else {
+            return -1;
+        }
+    }
+
+    if(width == 0) bs_width = 0;
+    else useKernel(width);
+    bs_bmi2 = bmi2;
+    return 0;
+}
+
+/*
+ * @return the current choice as a spec, e.g. "bs512,bmi2" (static buffer)
+ */
+const char *des_kernel_name(void) {
+    pthread_once(&bs_once, initBS);
+    return kernelName();
+}
+
+static const char *kernelName(void) {
+    static char name[16];
+
+    if(bs_width == 0) strcpy(name, "sp");
+    else sprintf(name, "bs%d", bs_width);
+    strcat(name, bs_bmi2 ? ",bmi2" : ",table");
+    return name;
+}
+
+/*
+ * @return 1 if IP and FP run on des_ip_bmi2/des_fp_bmi2
+ */
+int des_kernel_bmi2(void) {
+    pthread_once(&bs_once, initBS);
+    return bs_bmi2;
+}
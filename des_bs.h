@@ -0,0 +1,77 @@
+
+/*
+ * des_bs.h
+ *
+ * Bitsliced DES engine
+ *
+ * Blocks are passed as 64-bit words already loaded the way encryption()/decryption()
+ * load them, and come back in the same form (see des_bs_kernel.h for the layout).
+ */
+
+#ifndef DES_BS_H
+#define DES_BS_H
+
+// Widest kernel: 512 blocks per call
+#define DES_BS_MAX_WIDTH 512
+
+typedef void (*des_bs_kernel)(long long unsigned *blocks, const long long unsigned *kp, int decrypt);
+
+// Kernels, one per word width (des_bs_kernel.h)
+void des_bs64(long long unsigned *blocks, const long long unsigned *kp, int decrypt);
+void des_bs128(long long unsigned *blocks, const long long unsigned *kp, int decrypt);
+void des_bs256(long long unsigned *blocks, const long long unsigned *kp, int decrypt);
+void des_bs512(long long unsigned *blocks, const long long unsigned *kp, int decrypt);
+
+// Triple-DES kernels, kp holds the planes of k1, k2 and k3 one after another
+void des_bs64_ede(long long unsigned *blocks, const long long unsigned *kp, int decrypt);
+void des_bs128_ede(long long unsigned *blocks, const long long unsigned *kp, int decrypt);
+void des_bs256_ede(long long unsigned *blocks, const long long unsigned *kp, int decrypt);
+void des_bs512_ede(long long unsigned *blocks, const long long unsigned *kp, int decrypt);
+
+// One-key-per-lane kernels, keys holds one loaded 64-bit key per block
+void des_bs64_agile(long long unsigned *blocks, const long long unsigned *keys, int decrypt);
+void des_bs128_agile(long long unsigned *blocks, const long long unsigned *keys, int decrypt);
+void des_bs256_agile(long long unsigned *blocks, const long long unsigned *keys, int decrypt);
+void des_bs512_agile(long long unsigned *blocks, const long long unsigned *keys, int decrypt);
+
+// Key search kernels (one key per lane), see des_search.c
+typedef int (*des_bs_search_kernel)(const long long unsigned *kp, long long unsigned plain, long long unsigned cipher, long long unsigned *match);
+int des_bs64_search(const long long unsigned *kp, long long unsigned plain, long long unsigned cipher, long long unsigned *match);
+int des_bs128_search(const long long unsigned *kp, long long unsigned plain, long long unsigned cipher, long long unsigned *match);
+int des_bs256_search(const long long unsigned *kp, long long unsigned plain, long long unsigned cipher, long long unsigned *match);
+int des_bs512_search(const long long unsigned *kp, long long unsigned plain, long long unsigned cipher, long long unsigned *match);
+
+// crypt(3) kernels (standard DES, one key per lane), see des_crypt.c
+typedef void (*des_bs_crypt25_kernel)(const long long unsigned *keys, int salt, long long unsigned *out);
+void des_bs64_crypt25(const long long unsigned *keys, int salt, long long unsigned *out);
+void des_bs128_crypt25(const long long unsigned *keys, int salt, long long unsigned *out);
+void des_bs256_crypt25(const long long unsigned *keys, int salt, long long unsigned *out);
+void des_bs512_crypt25(const long long unsigned *keys, int salt, long long unsigned *out);
+
+// Front end (des_bs.c)
+int des_bs_width(void);
+int des_bs_select(int width);
+void des_bs_keyplanes(long long unsigned *kp, long long unsigned first_key, int words);
+void des_bs_crypt(long long unsigned *blocks, int num_blocks, long long unsigned first_key, int decrypt);
+void des_bs_crypt3(long long unsigned *blocks, int num_blocks, const long long unsigned *first_keys, int decrypt);
+void des_bs_crypt_keys(long long unsigned *blocks, const long long unsigned *keys, int decrypt);
+int des_bs_search(const long long unsigned *kp, long long unsigned plain, long long unsigned cipher, long long unsigned *match);
+int des_bs_crypt25_width(void);
+void des_bs_crypt25(const long long unsigned *keys, int salt, long long unsigned *out);
+
+/*
+ * Kernel choice (des_bs.c), made once from CPUID and then from the DES_KERNEL
+ * environment variable. A spec is a comma separated list of
+ *   sp | bs64 | bs128 | bs256 | bs512 -> block kernel (sp: bitsliced engine off)
+ *   bmi2 | table                      -> IP/FP of the SP path: PEXT/PDEP or byte tables
+ * e.g. DES_KERNEL=bs128,table. des_kernel_name() prints the current choice in the same form.
+ */
+int des_kernel_select(const char *spec);
+const char *des_kernel_name(void);
+int des_kernel_bmi2(void);
+
+// IP and FP with PEXT/PDEP (des_perm_bmi2.c), only when des_kernel_bmi2()
+void des_ip_bmi2(long long unsigned *out, long long unsigned in);
+void des_fp_bmi2(long long unsigned *out, long long unsigned in);
+
+#endif
@@ -0,0 +1,15 @@
+
+/*
+ * des_bs_avx2.c
+ *
+ * Bitsliced DES kernel on AVX2 (256 blocks per call)
+ */
+
+#define BS_BYTES 32
+#define BS_NAME des_bs256
+#define BS_NAME_EDE des_bs256_ede
+#define BS_NAME_AGILE des_bs256_agile
+#define BS_NAME_SEARCH des_bs256_search
+#define BS_NAME_CRYPT des_bs256_crypt25
+
+#include "des_bs_kernel.h"
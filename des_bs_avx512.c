@@ -0,0 +1,15 @@
+
+/*
+ * des_bs_avx512.c
+ *
+ * Bitsliced DES kernel on AVX-512 (512 blocks per call)
+ */
+
+#define BS_BYTES 64
+#define BS_NAME des_bs512
+#define BS_NAME_EDE des_bs512_ede
+#define BS_NAME_AGILE des_bs512_agile
+#define BS_NAME_SEARCH des_bs512_search
+#define BS_NAME_CRYPT des_bs512_crypt25
+
+#include "des_bs_kernel.h"
@@ -0,0 +1,268 @@
+
+/*
+ * des_bs_kernel.h
+ *
+ * Bitsliced DES kernel, instantiated once per word width
+ *
+ * Define before including:
+ *   BS_BYTES    -> width of one bit-plane word in bytes (8, 16, 32 or 64)
+ *   BS_NAME     -> name of the DES kernel function
+ *   BS_NAME_EDE -> name of the Triple-DES kernel function
+ *   BS_NAME_AGILE  -> name of the one-key-per-lane kernel function
+ *   BS_NAME_SEARCH -> name of the key search kernel function
+ *   BS_NAME_CRYPT  -> name of the crypt(3) kernel function
+ * The including file is compiled with the matching -m flags (see Makefile).
+ *
+ * BS_NAME(blocks, kp, decrypt):
+ *   -> Encrypts or decrypts 8 * BS_BYTES loaded blocks in place.
+ *      kp holds the 56 key planes (bits of the PC1 output), BS_BYTES / 8 words each.
+ * BS_NAME_EDE(blocks, kp, decrypt):
+ *   -> The same with 3 * 56 key planes (k1, k2, k3): E k1, D k2, E k3 or back,
+ *      48 rounds between a single IP and a single FP.
+ * BS_NAME_AGILE(blocks, keys, decrypt):
+ *   -> Like BS_NAME, but lane i uses its own key: keys[i] is the loaded 64-bit key
+ *      (as getKeyPart loads it). The key schedule of all lanes is one transpose
+ *      plus the bs_PC1 plane selection.
+ * BS_NAME_SEARCH(kp, plain, cipher, match):
+ *   -> Key search: every lane encrypts the same loaded block under its own key
+ *      (one per lane in kp) and is compared with the cipher block.
+ * BS_NAME_CRYPT(keys, salt, out):
+ *   -> crypt(3): 25 standard (FIPS 46-3) DES encryptions of a zero block under
+ *      every lane's key, with the expansion changed by the 12-bit salt. Uses the
+ *      tables and S-boxes of des_crypt_gen.h, not those of this cipher.
+ * Layout:
+ *   Plane i holds bit i of every block; bit b of 64-bit word g in a plane is block
+ *   b * BS_BYTES / 8 + g, so both transposes run on whole bs_t words.
+ *   IP, E, P, FP and the key schedule are only plane indices (des_bs_gen.h);
+ *   the S-boxes are gate networks. Only the transposes at both ends move bits.
+ */
+
+#include <string.h>
+
+#include "des_bs.h"
+
+typedef long long unsigned bs_t __attribute__((vector_size(BS_BYTES)));
+#define BS_WORDS (BS_BYTES / 8)
+
+#include "des_bs_gen.h"
+#include "des_crypt_gen.h"
+
+/*
+ * 64x64 bit transpose in every 64-bit word g: bit j of a[i] <-> bit i of a[j]
+ */
+static inline void bs_transpose(bs_t *a) {
+    long long unsigned m;
+    bs_t t;
+    int j, k;
+
+    for(j = 32, m = 0x00000000ffffffffull; j != 0; j >>= 1, m ^= m << j) {
+        for(k = 0; k < 64; k = ((k | j) + 1) & ~j) {
+            t = ((a[k] >> j) ^ a[k | j]) & m;
+            a[k] ^= t << j;
+            a[k | j] ^= t;
+        }
+    }
+}
+
+#define BS_IN(X, key, ks, k, j) (X[bs_E[k][j]] ^ key[ks[6*(k) + (j)]])
+#define BS_SBOX(D, X, key, ks, k) \
+    bs_s##k(BS_IN(X, key, ks, k, 0), BS_IN(X, key, ks, k, 1), BS_IN(X, key, ks, k, 2), \
+            BS_IN(X, key, ks, k, 3), BS_IN(X, key, ks, k, 4), BS_IN(X, key, ks, k, 5), \
+            &D[bs_P[k][0]], &D[bs_P[k][1]], &D[bs_P[k][2]], &D[bs_P[k][3]])
+
+/*
+ * One round: D ^= F(X, subkey) with the subkey selected by ks
+ */
+static inline void bs_round(bs_t *D, const bs_t *X, const bs_t *key, const int *ks) {
+    BS_SBOX(D, X, key, ks, 0);
+    BS_SBOX(D, X, key, ks, 1);
+    BS_SBOX(D, X, key, ks, 2);
+    BS_SBOX(D, X, key, ks, 3);
+    BS_SBOX(D, X, key, ks, 4);
+    BS_SBOX(D, X, key, ks, 5);
+    BS_SBOX(D, X, key, ks, 6);
+    BS_SBOX(D, X, key, ks, 7);
+}
+
+/*
+ * IP, 16 rounds per stage, FP
+ * Stage s uses key set (decrypt ? stages - 1 - s : s) and runs backwards on odd
+ * stages, so 3 stages give E-D-E. Between stages FP and IP cancel out and only
+ * the swap of L and R is left, which is a swap of the two pointers.
+ */
+static inline void bs_crypt(long long unsigned *blocks, const long long unsigned *kp, int stages, int decrypt) {
+    bs_t data[64], A[32], B[32], key[56];
+    bs_t *L = A, *R = B, *T;
+    int i, s, dir, round;
+
+    // (1/5) Transpose blocks into bit-planes
+    memcpy(data, blocks, sizeof(data));
+    bs_transpose(data);
+
+    // (2/5) IP
+    for(i = 0; i < 32; i++) {
+        R[i] = data[bs_IP[i]];
+        L[i] = data[bs_IP[32 + i]];
+    }
+
+    // (3/5) 16 rounds per stage, L and R take turns so no swap is needed
+    for(s = 0; s < stages; s++) {
+        memcpy(key, kp + 56 * BS_WORDS * (decrypt ? stages - 1 - s : s), sizeof(key));
+        dir = decrypt ^ (s & 1);
+        for(round = 0; round < 16; round += 2) {
+            bs_round(L, R, key, bs_K[dir ? 15 - round : round]);
+            bs_round(R, L, key, bs_K[dir ? 14 - round : round + 1]);
+        }
+        if(s != stages - 1) {
+            T = L; L = R; R = T;
+        }
+    }
+
+    // (4/5) Swap LR and FP
+    for(i = 0; i < 64; i++) {
+        data[i] = bs_FP[i] < 32 ? L[bs_FP[i]] : R[bs_FP[i] - 32];
+    }
+
+    // (5/5) Transpose back
+    bs_transpose(data);
+    memcpy(blocks, data, sizeof(data));
+}
+
+void BS_NAME(long long unsigned *blocks, const long long unsigned *kp, int decrypt) {
+    bs_crypt(blocks, kp, 1, decrypt);
+}
+
+void BS_NAME_EDE(long long unsigned *blocks, const long long unsigned *kp, int decrypt) {
+    bs_crypt(blocks, kp, 3, decrypt);
+}
+
+void BS_NAME_AGILE(long long unsigned *blocks, const long long unsigned *keys, int decrypt) {
+    bs_t data[64], kp[56];
+    int i;
+
+    // Key planes of every lane: transpose, then PC1 picks 56 of the 64 planes
+    memcpy(data, keys, sizeof(data));
+    bs_transpose(data);
+    for(i = 0; i < 56; i++) kp[i] = data[bs_PC1[i]];
+    bs_crypt(blocks, (const long long unsigned *)kp, 1, decrypt);
+}
+
+static inline bs_t bs_broadcast(long long unsigned x, int bit) {
+    bs_t v;
+    int g;
+
+    for(g = 0; g < BS_WORDS; g++) v[g] = 0 - ( ( x >> bit ) & 0x1 );
+    return v;
+}
+
+/*
+ * Encrypt plain under every lane's key and compare with cipher
+ * No transposes: the plain text planes are broadcast, and the output planes are
+ * compared one by one, giving up as soon as every lane has a wrong bit.
+ * @param kp 56 key planes, one key per lane
+ * @param plain Loaded plain text block (as des_ecb_encrypt loads it)
+ * @param cipher Cipher text block as des_ecb_encrypt would store it, loaded back
+ * @param match Lanes that matched, same layout as a key plane (output reference)
+ * @return nonzero if any lane matched
+ */
+int BS_NAME_SEARCH(const long long unsigned *kp, long long unsigned plain, long long unsigned cipher, long long unsigned *match) {
+    bs_t L[32], R[32], key[56], diff;
+    long long unsigned all;
+    int i, g, round;
+
+    memcpy(key, kp, sizeof(key));
+
+    // (1/3) IP of the broadcast plain text
+    for(i = 0; i < 32; i++) {
+        R[i] = bs_broadcast(plain, bs_IP[i]);
+        L[i] = bs_broadcast(plain, bs_IP[32 + i]);
+    }
+
+    // (2/3) 16 rounds
+    for(round = 0; round < 16; round += 2) {
+        bs_round(L, R, key, bs_K[round]);
+        bs_round(R, L, key, bs_K[round + 1]);
+    }
+
+    // (3/3) Swap LR and FP, one output plane at a time
+    diff = L[0] ^ L[0];
+    for(i = 0; i < 64; i++) {
+        diff |= (bs_FP[i] < 32 ? L[bs_FP[i]] : R[bs_FP[i] - 32]) ^ bs_broadcast(cipher, i);
+        if((i & 7) == 7) {
+            all = ~0ull;
+            for(g = 0; g < BS_WORDS; g++) all &= diff[g];
+            if(all == ~0ull) return 0;
+        }
+    }
+
+    all = 0;
+    for(g = 0; g < BS_WORDS; g++) {
+        match[g] = ~diff[g];
+        all |= match[g];
+    }
+    return all != 0;
+}
+
+#define CR_IN(X, key, E, ks, t) (X[E[t]] ^ key[ks[t]])
+#define CR_SBOX(D, X, key, E, ks, k) \
+    bs_c##k(CR_IN(X, key, E, ks, 6*(k) + 5), CR_IN(X, key, E, ks, 6*(k) + 4), CR_IN(X, key, E, ks, 6*(k) + 3), \
+            CR_IN(X, key, E, ks, 6*(k) + 2), CR_IN(X, key, E, ks, 6*(k) + 1), CR_IN(X, key, E, ks, 6*(k)), \
+            &D[cr_P[k][0]], &D[cr_P[k][1]], &D[cr_P[k][2]], &D[cr_P[k][3]])
+
+/*
+ * One FIPS 46-3 round: D ^= F(X, subkey) with the salted expansion E
+ */
+static inline void cr_round(bs_t *D, const bs_t *X, const bs_t *key, const int *E, const int *ks) {
+    CR_SBOX(D, X, key, E, ks, 0);
+    CR_SBOX(D, X, key, E, ks, 1);
+    CR_SBOX(D, X, key, E, ks, 2);
+    CR_SBOX(D, X, key, E, ks, 3);
+    CR_SBOX(D, X, key, E, ks, 4);
+    CR_SBOX(D, X, key, E, ks, 5);
+    CR_SBOX(D, X, key, E, ks, 6);
+    CR_SBOX(D, X, key, E, ks, 7);
+}
+
+/*
+ * crypt(3) of 8 * BS_BYTES keys with one salt
+ * The plain text is zero, so IP is skipped, and between the 25 encryptions FP
+ * and IP cancel out, leaving the swap of L and R.
+ * @param keys One key per lane, FIPS bit n = bit 64 - n (des_crypt.c loads them)
+ * @param salt 12-bit salt: bit i swaps expanded bits i and i + 24
+ * @param out One result per lane, same bit order as keys (output reference)
+ */
+void BS_NAME_CRYPT(const long long unsigned *keys, int salt, long long unsigned *out) {
+    bs_t data[64], A[32], B[32];
+    bs_t *L = A, *R = B, *T;
+    int E[48], i, t, iter, round;
+
+    for(t = 0; t < 48; t++) E[t] = cr_E[t];
+    for(t = 0; t < 12; t++) {
+        if((salt >> t) & 0x1) {
+            E[t] = cr_E[t + 24];
+            E[t + 24] = cr_E[t];
+        }
+    }
+
+    // (1/3) Key planes of every lane
+    memcpy(data, keys, sizeof(data));
+    bs_transpose(data);
+    memset(A, 0, sizeof(A));
+    memset(B, 0, sizeof(B));
+
+    // (2/3) 25 x 16 rounds
+    for(iter = 0; iter < 25; iter++) {
+        for(round = 0; round < 16; round += 2) {
+            cr_round(L, R, data, E, cr_K[round]);
+            cr_round(R, L, data, E, cr_K[round + 1]);
+        }
+        T = L; L = R; R = T;
+    }
+
+    // (3/3) FP (the key planes are no longer needed), then back to one word per lane
+    for(i = 0; i < 64; i++) {
+        data[i] = cr_FP[i] < 32 ? L[cr_FP[i]] : R[cr_FP[i] - 32];
+    }
+    bs_transpose(data);
+    memcpy(out, data, sizeof(data));
+}
@@ -0,0 +1,15 @@
+
+/*
+ * des_bs_scalar.c
+ *
+ * Bitsliced DES kernel on 64-bit words (64 blocks per call)
+ */
+
+#define BS_BYTES 8
+#define BS_NAME des_bs64
+#define BS_NAME_EDE des_bs64_ede
+#define BS_NAME_AGILE des_bs64_agile
+#define BS_NAME_SEARCH des_bs64_search
+#define BS_NAME_CRYPT des_bs64_crypt25
+
+#include "des_bs_kernel.h"
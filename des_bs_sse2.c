@@ -0,0 +1,15 @@
+
+/*
+ * des_bs_sse2.c
+ *
+ * Bitsliced DES kernel on SSE2 (128 blocks per call)
+ */
+
+#define BS_BYTES 16
+#define BS_NAME des_bs128
+#define BS_NAME_EDE des_bs128_ede
+#define BS_NAME_AGILE des_bs128_agile
+#define BS_NAME_SEARCH des_bs128_search
+#define BS_NAME_CRYPT des_bs128_crypt25
+
+#include "des_bs_kernel.h"
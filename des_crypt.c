@@ -0,0 +1,257 @@
+
+/*
+ * des_crypt.c
+ *
+ * Traditional DES-based crypt(3) on the bitsliced kernels (see des_crypt.h)
+ *
+ * Role of each functions:
+ *   des_crypt(..), des_crypt_batch(..):
+ *     -> Hashes in the crypt(3) format.
+ *   hashKeys(..), cryptTask(..):
+ *     -> 64-bit results of many keys with one salt, des_bs_crypt25_width()
+ *        keys per kernel call and pool task.
+ *   des_crypt_audit(..):
+ *     -> Word list against a password file, grouped by salt.
+ *   loadKey(..), getSalt(..), encode(..), decode(..):
+ *     -> Between crypt(3) strings and the kernel's words.
+ * Bit order:
+ *   FIPS bit n (1 = first) of a key or result is bit 64 - n of its word, so
+ *   key byte i is byte 7 - i of the word and the first hash character is the
+ *   top 6 bits.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "des_crypt.h"
+#include "des_bs.h"
+
+static const char crypt_chars[] = "./0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+struct crypt_job {
+    int salt, width;
+    const char *const *keys;
+    long num_keys;
+    long long unsigned *results;
+};
+
+struct hash {
+    char *user;
+    long long unsigned value;
+    int salt;
+};
+
+/*
+ * @return 0..63, or -1 if c is not a crypt(3) character
+ */
+static int charValue(char c) {
+    const char *p = c ? strchr(crypt_chars, c) : NULL;
+    return p ? (int)(p - crypt_chars) : -1;
+}
+
+/*
+ * @return 12-bit salt (first character in the low 6 bits), or -1
+ */
+static int getSalt(const char *salt) {
+    int lo = charValue(salt[0]), hi;
+
+    if(lo < 0) return -1;
+    hi = charValue(salt[1]);
+    if(hi < 0) return -1;
+    return hi << 6 | lo;
+}
+
+/*
+ * First 8 characters, shifted left by one (the low bit of each byte is parity)
+ */
+static long long unsigned loadKey(const char *key) {
+    long long unsigned w = 0;
+    int i;
+
+    for(i = 0; i < 8; i++) {
+        w = w << 8 | (*key << 1 & 0xfe);
+        if(*key) key++;
+    }
+    return w;
+}
+
+static void encode(char *out, int salt, long long unsigned w) {
+    int i;
+
+    out[0] = crypt_chars[salt & 0x3f];
+    out[1] = crypt_chars[salt >> 6];
+    for(i = 0; i < 10; i++) out[2 + i] = crypt_chars[(w >> (58 - 6*i)) & 0x3f];
+    out[12] = crypt_chars[(w & 0xf) << 2];
+    out[13] = '\0';
+}
+
+/*
+ * @return 0, or -1 if hash is not a 13-character DES hash
+ */
+static int decode(const char *hash, long long unsigned *w, int *salt) {
+    int i, v;
+
+    if(strlen(hash) != DES_CRYPT_LEN) return -1;
+    *salt = getSalt(hash);
+    if(*salt < 0) return -1;
+    *w = 0;
+    for(i = 0; i < 11; i++) {
+        v = charValue(hash[2 + i]);
+        if(v < 0) return -1;
+        *w = i < 10 ? *w << 6 | v : *w << 4 | v >> 2;
+    }
+    return 0;
+}
+
+static void cryptTask(void *arg, long index, int worker) {
+    struct crypt_job *job = arg;
+    long long unsigned keys[DES_BS_MAX_WIDTH], out[DES_BS_MAX_WIDTH];
+    long first = index * job->width, i;
+    (void)worker;
+
+    for(i = 0; i < job->width; i++) {
+        keys[i] = first + i < job->num_keys ? loadKey(job->keys[first + i]) : 0;
+    }
+    des_bs_crypt25(keys, job->salt, out);
+    for(i = 0; i < job->width && first + i < job->num_keys; i++) {
+        job->results[first + i] = out[i];
+    }
+}
+
+static void hashKeys(des_pool *pool, int salt, const char *const *keys, long num_keys, long long unsigned *results) {
+    struct crypt_job job;
+    long num_tasks, t;
+
+    job.salt = salt;
+    job.width = des_bs_crypt25_width();
+    job.keys = keys;
+    job.num_keys = num_keys;
+    job.results = results;
+    num_tasks = (num_keys + job.width - 1) / job.width;
+    if(pool) {
+        des_pool_run(pool, cryptTask, &job, num_tasks);
+        return;
+    }
+    for(t = 0; t < num_tasks; t++) cryptTask(&job, t, 0);
+}
+
+int des_crypt(const char *key, const char *salt, char *out) {
+    return des_crypt_batch(NULL, salt, &key, 1, (char (*)[DES_CRYPT_LEN + 1])out);
+}
+
+int des_crypt_batch(des_pool *pool, const char *salt, const char *const *keys, int num_keys, char (*out)[DES_CRYPT_LEN + 1]) {
+    long long unsigned *results;
+    int s = getSalt(salt), i;
+
+    if(s < 0) return -1;
+    results = malloc((num_keys > 0 ? num_keys : 1) * sizeof(*results));
+    if(!results) return -1;
+    hashKeys(pool, s, keys, num_keys, results);
+    for(i = 0; i < num_keys; i++) encode(out[i], s, results[i]);
+    free(results);
+    return 0;
+}
+
+static int compareHash(const void *a, const void *b) {
+    const struct hash *x = a, *y = b;
+
+    if(x->salt != y->salt) return x->salt - y->salt;
+    return (x->value > y->value) - (x->value < y->value);
+}
+
+/*
+ * Every line of a file, without the newline
+ * @return number of lines, or -1
+ */
+static long readLines(const char *path, char ***lines) {
+    FILE *f = fopen(path, "r");
+    char *line = NULL, **grown;
+    size_t cap = 0;
+    ssize_t n;
+    long num = 0, max = 0;
+
+    *lines = NULL;
+    if(!f) { perror(path); return -1; }
+    while((n = getline(&line, &cap, f)) >= 0) {
+        if(n > 0 && line[n - 1] == '\n') line[--n] = '\0';
+        if(num == max) {
+            max = max ? 2 * max : 1024;
+            grown = realloc(*lines, max * sizeof(*grown));
+            if(!grown) break;
+            *lines = grown;
+        }
+        (*lines)[num] = strdup(line);
+        if(!(*lines)[num]) break;
+        num++;
+    }
+    free(line);
+    fclose(f);
+    return num;
+}
+
+long des_crypt_audit(des_pool *pool, const char *hash_path, const char *words_path) {
+    char **lines = NULL, **words = NULL, *field, *end;
+    struct hash *hashes = NULL, key, *hit;
+    long long unsigned *results = NULL;
+    long num_lines, num_words, num_hashes = 0, found = -1, tried = 0, i, j, first;
+    struct timespec t0, t1;
+    double t;
+
+    num_lines = readLines(hash_path, &lines);
+    num_words = readLines(words_path, &words);
+    if(num_lines < 0 || num_words < 0) goto out;
+    hashes = malloc((num_lines > 0 ? num_lines : 1) * sizeof(*hashes));
+    results = malloc((num_words > 0 ? num_words : 1) * sizeof(*results));
+    if(!hashes || !results) { fputs("memory allocation fails\n", stderr); goto out; }
+
+    // (1/2) DES hashes, sorted by salt then value
+    for(i = 0; i < num_lines; i++) {
+        field = strchr(lines[i], ':');
+        if(field) {
+            *field++ = '\0';
+            end = strchr(field, ':');
+            if(end) *end = '\0';
+        } else {
+            field = lines[i];
+        }
+        if(decode(field, &hashes[num_hashes].value, &hashes[num_hashes].salt) != 0) continue;
+        hashes[num_hashes++].user = field == lines[i] ? field : lines[i];
+    }
+    qsort(hashes, num_hashes, sizeof(*hashes), compareHash);
+
+    // (2/2) Every word once per salt
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    found = 0;
+    for(first = 0; first < num_hashes; first = i) {
+        for(i = first; i < num_hashes && hashes[i].salt == hashes[first].salt; i++);
+        hashKeys(pool, hashes[first].salt, (const char *const *)words, num_words, results);
+        tried += num_words;
+        key.salt = hashes[first].salt;
+        for(j = 0; j < num_words; j++) {
+            key.value = results[j];
+            hit = bsearch(&key, hashes + first, i - first, sizeof(*hashes), compareHash);
+            if(!hit) continue;
+            // Several users may share the hash
+            while(hit > hashes + first && compareHash(hit - 1, &key) == 0) hit--;
+            for(; hit < hashes + i && compareHash(hit, &key) == 0; hit++) {
+                printf("%s:%s\n", hit->user, words[j]);
+                found++;
+            }
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    fprintf(stderr, "%ld hashes, %ld words, %ld found, %ld crypts in %.3f s (%.0f hashes/s)\n",
+            num_hashes, num_words, found, tried, t, t > 0 ? tried / t : 0);
+
+out:
+    for(i = 0; i < num_lines; i++) free(lines[i]);
+    for(i = 0; i < num_words; i++) free(words[i]);
+    free(lines);
+    free(words);
+    free(hashes);
+    free(results);
+    return found;
+}
@@ -0,0 +1,49 @@
+
+/*
+ * des_crypt.h
+ *
+ * Traditional DES-based crypt(3): 13-character hashes, 2 salt characters first
+ *
+ * Usage:
+ *   char hash[DES_CRYPT_LEN + 1];
+ *   des_crypt("password", "ab", hash);           // "abJnggxhB/yWI", as glibc crypt()
+ *   des_crypt_batch(pool, "ab", words, n, out);  // many candidates, one salt
+ * The hash is 25 encryptions of a zero block with the standard DES (FIPS 46-3),
+ * not with the cipher of des.h, under the first 8 password characters (7 bits
+ * each). Salt bit i swaps bits i and i + 24 of the expansion. The bitsliced
+ * kernels run des_bs_crypt25_width() candidates per call, each with its own key.
+ */
+
+#ifndef DES_CRYPT_H
+#define DES_CRYPT_H
+
+#include "des_pool.h"
+
+#define DES_CRYPT_LEN 13
+
+/*
+ * @param key Password (only the first 8 characters count)
+ * @param salt 2 characters of [./0-9A-Za-z] (a whole hash works too)
+ * @param out DES_CRYPT_LEN + 1 bytes (output reference)
+ * @return 0, or -1 for an invalid salt
+ */
+int des_crypt(const char *key, const char *salt, char *out);
+
+/*
+ * Hash num_keys candidates with one salt, one pool task per kernel call
+ * @param pool Worker pool, or NULL for the calling thread
+ * @param out num_keys hashes (output reference)
+ * @return 0, or -1 for an invalid salt or when memory runs out
+ */
+int des_crypt_batch(des_pool *pool, const char *salt, const char *const *keys, int num_keys, char (*out)[DES_CRYPT_LEN + 1]);
+
+/*
+ * Try every word of a list against every DES hash of a password file
+ * Hashes are lines of 'user:hash:..' (passwd / shadow) or bare hashes; other
+ * formats are skipped. Words are hashed once per distinct salt. Matches are
+ * printed to stdout as 'user:password', hashes/s to stderr.
+ * @return number of passwords found, or -1 after printing the reason to stderr
+ */
+long des_crypt_audit(des_pool *pool, const char *hash_path, const char *words_path);
+
+#endif
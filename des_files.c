@@ -0,0 +1,453 @@
+
+/*
+ * des_files.c
+ *
+ * Many files in one run (see des_files.h)
+ *
+ * Role of each functions:
+ *   des_files(..):
+ *     -> Collects the files, cuts them into tasks, runs the tasks on the pool.
+ *   addPath(..), walkDir(..), readManifest(..):
+ *     -> File list with output paths and sizes (output directories made here).
+ *   makeUnits(..):
+ *     -> Tasks: ranges of large files (outputs created and sized here), groups
+ *        of small files. Inputs that would share an output path (same base
+ *        name from two arguments), or whose output is one of the input files
+ *        (e.g. -O . in the input directory), fail instead (markShared).
+ *   runTask(..):
+ *     -> One task on a worker, with that worker's buffers.
+ *   transform(..):
+ *     -> ECB of one piece with the padding at the end of a file, and the
+ *        optional check that undoing it gives the input back.
+ * Large files:
+ *   Ranges are read and written with pread / pwrite at their own offset, so
+ *   they can run in any order. The range at the end of a file pads it, or
+ *   checks the padding and truncates the output.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "des_files.h"
+#include "des_arena.h"
+#include "des_block.h"
+#include "des_io.h"
+
+struct entry {
+    char *in, *out;
+    long size;
+    dev_t dev; // of in
+    ino_t ino;
+    int shared; // 1: another entry has the same out, 2: out is an input file
+};
+
+// count files from 'file' on, or one range at 'offset' of a large file
+struct unit {
+    long file;
+    long offset;
+    int count;
+};
+
+struct job {
+    const des_ctx *ctx;
+    int decrypt, verify;
+    struct entry *files;
+    long num_files, cap_files;
+    struct unit *units;
+    long num_units, cap_units;
+    char **bufs; // per worker: input, output, check (DES_FILES_CHUNK + 8 each)
+    long long unsigned bytes;
+    int failed;
+    struct stat out_st; // out_dir, never walked as an input
+};
+
+static void fail(struct job *job, const char *path, const char *reason) {
+    fprintf(stderr, "%s: %s\n", path, reason);
+    __atomic_store_n(&job->failed, 1, __ATOMIC_RELAXED);
+}
+
+static char *joinPath(const char *dir, const char *name) {
+    long n = strlen(dir);
+    char *p = malloc(n + strlen(name) + 2);
+
+    if(!p) return NULL;
+    memcpy(p, dir, n);
+    p[n] = '/';
+    strcpy(p + n + 1, name);
+    return p;
+}
+
+static int addFile(struct job *job, const char *in, const char *out_dir, const char *name, const struct stat *st) {
+    struct entry *e;
+
+    if(job->num_files == job->cap_files) {
+        job->cap_files = job->cap_files ? 2 * job->cap_files : 1024;
+        e = realloc(job->files, job->cap_files * sizeof(*e));
+        if(!e) return -1;
+        job->files = e;
+    }
+    e = &job->files[job->num_files];
+    e->in = strdup(in);
+    e->out = joinPath(out_dir, name);
+    e->size = st->st_size;
+    e->dev = st->st_dev;
+    e->ino = st->st_ino;
+    e->shared = 0;
+    if(!e->in || !e->out) { free(e->in); free(e->out); return -1; }
+    job->num_files++;
+    return 0;
+}
+
+static int makeDir(struct job *job, const char *path) {
+    if(mkdir(path, 0755) != 0 && errno != EEXIST) {
+        fail(job, path, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Every regular file below in_dir, mirrored below out_dir (symbolic links and
+ * the top out_dir, when it lies below in_dir, are skipped)
+ */
+static int walkDir(struct job *job, const char *in_dir, const char *out_dir) {
+    DIR *d;
+    struct dirent *de;
+    struct stat st;
+    char *in, *out;
+    int rtn = 0;
+
+    if(makeDir(job, out_dir) != 0) return 0;
+    d = opendir(in_dir);
+    if(!d) { fail(job, in_dir, strerror(errno)); return 0; }
+    while(rtn == 0 && (de = readdir(d))) {
+        if(strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        if(fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) continue;
+        if(S_ISREG(st.st_mode)) {
+            in = joinPath(in_dir, de->d_name);
+            rtn = in ? addFile(job, in, out_dir, de->d_name, &st) : -1;
+            free(in);
+        } else if(S_ISDIR(st.st_mode) && !(st.st_dev == job->out_st.st_dev && st.st_ino == job->out_st.st_ino)) {
+            in = joinPath(in_dir, de->d_name);
+            out = joinPath(out_dir, de->d_name);
+            rtn = in && out ? walkDir(job, in, out) : -1;
+            free(in);
+            free(out);
+        }
+    }
+    closedir(d);
+    return rtn;
+}
+
+/*
+ * @return 0, or -1 when out of memory (other errors only fail their path)
+ */
+static int addPath(struct job *job, const char *path, const char *out_dir) {
+    struct stat st;
+    const char *name;
+
+    if(stat(path, &st) != 0) { fail(job, path, strerror(errno)); return 0; }
+    if(S_ISDIR(st.st_mode)) return walkDir(job, path, out_dir);
+    if(!S_ISREG(st.st_mode)) { fail(job, path, "not a regular file"); return 0; }
+    name = strrchr(path, '/');
+    return addFile(job, path, out_dir, name ? name + 1 : path, &st);
+}
+
+static int readManifest(struct job *job, const char *out_dir) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t n;
+    int rtn = 0;
+
+    while(rtn == 0 && (n = getline(&line, &cap, stdin)) > 0) {
+        if(line[n - 1] == '\n') line[--n] = 0;
+        if(n > 0) rtn = addPath(job, line, out_dir);
+    }
+    free(line);
+    return rtn;
+}
+
+static int addUnit(struct job *job, long file, long offset, int count) {
+    struct unit *u;
+
+    if(job->num_units == job->cap_units) {
+        job->cap_units = job->cap_units ? 2 * job->cap_units : 1024;
+        u = realloc(job->units, job->cap_units * sizeof(*u));
+        if(!u) return -1;
+        job->units = u;
+    }
+    u = &job->units[job->num_units++];
+    u->file = file;
+    u->offset = offset;
+    u->count = count;
+    return 0;
+}
+
+/*
+ * Create and size the output of a file that is split into ranges
+ */
+static int createSplit(struct job *job, const struct entry *e) {
+    long out_size = job->decrypt ? e->size : e->size - e->size % 8 + 8;
+    int fd;
+
+    fd = open(e->out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) { fail(job, e->out, strerror(errno)); return -1; }
+    if(ftruncate(fd, out_size) != 0) {
+        fail(job, e->out, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    close(fd);
+    return 0;
+}
+
+static int compareOut(const void *a, const void *b) {
+    return strcmp((*(struct entry *const *)a)->out, (*(struct entry *const *)b)->out);
+}
+
+static int compareInode(const void *a, const void *b) {
+    const struct entry *x = *(struct entry *const *)a, *y = *(struct entry *const *)b;
+
+    if(x->dev != y->dev) return x->dev < y->dev ? -1 : 1;
+    if(x->ino != y->ino) return x->ino < y->ino ? -1 : 1;
+    return 0;
+}
+
+/*
+ * Flag every entry whose output path another entry also has, and every entry
+ * whose output already exists as one of the inputs (it would be truncated
+ * before that input is read)
+ * @return 0, or -1 when out of memory
+ */
+static int markShared(struct job *job) {
+    struct entry **sorted, key, *pkey = &key;
+    struct stat st;
+    long i, j;
+
+    if(job->num_files == 0) return 0;
+    sorted = malloc(job->num_files * sizeof(*sorted));
+    if(!sorted) return -1;
+    for(i = 0; i < job->num_files; i++) sorted[i] = &job->files[i];
+    qsort(sorted, job->num_files, sizeof(*sorted), compareOut);
+    for(i = 0; i < job->num_files; i = j) {
+        for(j = i + 1; j < job->num_files && strcmp(sorted[i]->out, sorted[j]->out) == 0; j++);
+        if(j - i == 1) continue;
+        for(; i < j; i++) sorted[i]->shared = 1;
+    }
+
+    qsort(sorted, job->num_files, sizeof(*sorted), compareInode);
+    for(i = 0; i < job->num_files; i++) {
+        if(job->files[i].shared || stat(job->files[i].out, &st) != 0) continue;
+        key.dev = st.st_dev;
+        key.ino = st.st_ino;
+        if(bsearch(&pkey, sorted, job->num_files, sizeof(*sorted), compareInode)) job->files[i].shared = 2;
+    }
+    free(sorted);
+    return 0;
+}
+
+static int makeUnits(struct job *job) {
+    struct entry *e;
+    long i, offset, group_bytes = 0;
+    int group = 0; // files in the open group, which starts at i - group
+
+    if(markShared(job) != 0) return -1;
+    for(i = 0; i < job->num_files; i++) {
+        e = &job->files[i];
+        if(e->shared) {
+            // Neither is written: the group so far ends before it
+            if(group > 0 && addUnit(job, i - group, 0, group) != 0) return -1;
+            group = 0;
+            group_bytes = 0;
+            fail(job, e->in, e->shared == 1 ? "output path is shared with another input" : "output is an input file");
+            continue;
+        }
+        if(job->decrypt && (e->size == 0 || e->size % 8 != 0)) {
+            // Not ours: the group so far ends before it
+            if(group > 0 && addUnit(job, i - group, 0, group) != 0) return -1;
+            group = 0;
+            group_bytes = 0;
+            fail(job, e->in, "input is not a multiple of 8 bytes");
+            continue;
+        }
+        if(e->size > DES_FILES_CHUNK) {
+            if(createSplit(job, e) != 0) {
+                if(group > 0 && addUnit(job, i - group, 0, group) != 0) return -1;
+                group = 0;
+                group_bytes = 0;
+                continue;
+            }
+            for(offset = 0; offset < e->size; offset += DES_FILES_CHUNK) {
+                if(addUnit(job, i, offset, 1) != 0) return -1;
+            }
+            if(group > 0 && addUnit(job, i - group, 0, group) != 0) return -1;
+            group = 0;
+            group_bytes = 0;
+            continue;
+        }
+        group++;
+        group_bytes += e->size;
+        if(group == DES_FILES_GROUP || group_bytes >= DES_FILES_CHUNK) {
+            if(addUnit(job, i + 1 - group, 0, group) != 0) return -1;
+            group = 0;
+            group_bytes = 0;
+        }
+    }
+    if(group > 0 && addUnit(job, i - group, 0, group) != 0) return -1;
+    return 0;
+}
+
+/*
+ * @param last The piece ends the file (pad / unpad)
+ * @param check Scratch for the verification, or NULL
+ * @return output bytes, or -1 with *reason set
+ */
+static long transform(const struct job *job, const char *in, long len, int last, char *out, char *check, const char **reason) {
+    long whole = len - len % 8, out_len = whole;
+    int pad;
+
+    if(!job->decrypt) {
+        des_ecb_encrypt(job->ctx, in, out, (int)whole);
+        if(last) {
+            pad = 8 - len % 8;
+            memcpy(out + whole, in + whole, len % 8);
+            memset(out + len, pad, pad);
+            des_ecb_encrypt(job->ctx, out + whole, out + whole, 8);
+            out_len += 8;
+        }
+        if(check) {
+            des_ecb_decrypt(job->ctx, out, check, (int)out_len);
+            if(memcmp(check, in, len) != 0) { *reason = "verification failed"; return -1; }
+        }
+        return out_len;
+    }
+
+    des_ecb_decrypt(job->ctx, in, out, (int)len);
+    if(check) {
+        des_ecb_encrypt(job->ctx, out, check, (int)len);
+        if(memcmp(check, in, len) != 0) { *reason = "verification failed"; return -1; }
+    }
+    if(last) {
+        pad = des_get_pad(out + len - 8);
+        if(pad < 0) { *reason = "bad padding (wrong key or damaged input)"; return -1; }
+        out_len -= pad;
+    }
+    return out_len;
+}
+
+static int writeAt(int fd, const char *buf, long len, long offset) {
+    long done;
+    ssize_t n;
+
+    for(done = 0; done < len; done += n) {
+        n = pwrite(fd, buf + done, len - done, offset + done);
+        if(n < 0 && errno == EINTR) { n = 0; continue; }
+        if(n <= 0) return -1;
+    }
+    return 0;
+}
+
+/*
+ * One whole file (small) or one range (large) through the worker's buffers
+ */
+static void cryptPiece(struct job *job, const struct entry *e, long offset, char *buf, int verify) {
+    char *out = buf + DES_FILES_CHUNK + 8, *check = verify ? out + DES_FILES_CHUNK + 8 : NULL;
+    long len = e->size - offset, out_len;
+    int split = e->size > DES_FILES_CHUNK;
+    const char *reason;
+    int fd;
+
+    if(len > DES_FILES_CHUNK) len = DES_FILES_CHUNK;
+
+    fd = open(e->in, O_RDONLY);
+    if(fd < 0) { fail(job, e->in, strerror(errno)); return; }
+    if(des_read_at(fd, buf, len, offset) != len) {
+        fail(job, e->in, "short read (file changed?)");
+        close(fd);
+        return;
+    }
+    close(fd);
+
+    out_len = transform(job, buf, len, offset + len == e->size, out, check, &reason);
+    if(out_len < 0) { fail(job, e->in, reason); return; }
+
+    fd = open(e->out, split ? O_WRONLY : O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) { fail(job, e->out, strerror(errno)); return; }
+    if(writeAt(fd, out, out_len, offset) != 0
+       || (split && job->decrypt && offset + len == e->size && ftruncate(fd, offset + out_len) != 0)) {
+        fail(job, e->out, strerror(errno));
+    }
+    if(close(fd) != 0) fail(job, e->out, strerror(errno));
+    __atomic_fetch_add(&job->bytes, len, __ATOMIC_RELAXED);
+}
+
+static void runTask(void *arg, long index, int worker) {
+    struct job *job = arg;
+    const struct unit *u = &job->units[index];
+    int verify = job->verify > 0 && index % job->verify == 0;
+    int i;
+
+    for(i = 0; i < u->count; i++) {
+        cryptPiece(job, &job->files[u->file + i], u->offset, job->bufs[worker], verify);
+    }
+}
+
+int des_files(const des_ctx *ctx, des_pool *pool, char **paths, int num_paths, const char *out_dir, int decrypt, int verify) {
+    struct job job;
+    des_arena *arena = des_arena_default();
+    struct timespec t0, t1;
+    double t;
+    long i;
+    int num_workers = des_pool_size(pool), rtn = -1;
+
+    memset(&job, 0, sizeof(job));
+    job.ctx = ctx;
+    job.decrypt = decrypt;
+    job.verify = verify;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+
+    // (1/3) Files and tasks
+    if(makeDir(&job, out_dir) != 0) return -1;
+    if(stat(out_dir, &job.out_st) != 0) { fail(&job, out_dir, strerror(errno)); return -1; }
+    for(i = 0; i < num_paths; i++) {
+        if((strcmp(paths[i], "-") == 0 ? readManifest(&job, out_dir) : addPath(&job, paths[i], out_dir)) != 0) {
+            fputs("memory allocation fails\n", stderr);
+            goto out;
+        }
+    }
+    if(makeUnits(&job) != 0) { fputs("memory allocation fails\n", stderr); goto out; }
+
+    // (2/3) Buffers, one set per worker
+    job.bufs = calloc(num_workers, sizeof(*job.bufs));
+    if(!job.bufs) { fputs("memory allocation fails\n", stderr); goto out; }
+    for(i = 0; i < num_workers; i++) {
+        job.bufs[i] = des_arena_get(arena, 3 * (DES_FILES_CHUNK + 8));
+        if(!job.bufs[i]) { fputs("memory allocation fails\n", stderr); goto out; }
+    }
+
+    // (3/3) Every task on the pool
+    des_pool_run(pool, runTask, &job, job.num_units);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    t = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) * 1e-9;
+    fprintf(stderr, "%ld files, %ld tasks, %.1f MB in %.3f s (%.1f MB/s)\n",
+            job.num_files, job.num_units, job.bytes / 1e6, t, t > 0 ? job.bytes / t / 1e6 : 0);
+    rtn = job.failed ? -1 : 0;
+
+out:
+    for(i = 0; job.bufs && i < num_workers; i++) des_arena_put(arena, job.bufs[i]);
+    free(job.bufs);
+    for(i = 0; i < job.num_files; i++) {
+        free(job.files[i].in);
+        free(job.files[i].out);
+    }
+    free(job.files);
+    free(job.units);
+    return rtn;
+}
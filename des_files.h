@@ -0,0 +1,43 @@
+
+/*
+ * des_files.h
+ *
+ * Many files in one run (same format as des_stream: ECB + PKCS#5 padding)
+ *
+ * Every path is a regular file, a directory (walked recursively) or "-" for
+ * a manifest of paths on stdin, one per line. Files are cut into tasks of
+ * one des_pool_run: a file larger than DES_FILES_CHUNK is split into ranges
+ * of that size written in place with pwrite, smaller files are grouped up to
+ * DES_FILES_CHUNK bytes or DES_FILES_GROUP files per task. The pool's work
+ * stealing then balances big and small files alike.
+ *
+ * Outputs:
+ *   file / manifest entry -> out_dir/<basename>
+ *   directory             -> out_dir/<path below that directory>
+ *   Inputs that map to the same output (e.g. a/x and b/x), or whose output is
+ *   one of the input files, are not written and make the run fail.
+ */
+
+#ifndef DES_FILES_H
+#define DES_FILES_H
+
+#include "des.h"
+#include "des_pool.h"
+
+// Bytes per task, largest group of small files per task
+#define DES_FILES_CHUNK (4 * DES_POOL_CHUNK)
+#define DES_FILES_GROUP 256
+
+/*
+ * @param ctx Context from des_ctx_init
+ * @param pool Worker pool
+ * @param paths Files, directories or "-"
+ * @param num_paths Number of paths
+ * @param out_dir Output directory (created if missing)
+ * @param decrypt 0 to encrypt and pad, 1 to decrypt and strip the padding
+ * @param verify Undo one task in verify and compare with its input (0: none)
+ * @return 0, or -1 if any file failed (each reason printed to stderr)
+ */
+int des_files(const des_ctx *ctx, des_pool *pool, char **paths, int num_paths, const char *out_dir, int decrypt, int verify);
+
+#endif
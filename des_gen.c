@@ -0,0 +1,546 @@
+
+/*
+ * des_gen.c
+ *
+ * Generates des_bs_gen.h (bitsliced engine), with -p des_perm_gen.h
+ * (IP and FP byte tables, PC1 / PC2 / P as masked shifts) and with -c
+ * des_crypt_gen.h (bitsliced crypt(3) on the FIPS 46-3 tables) from des_tables.h
+ *
+ * Role of each functions:
+ *   genIndex(..):
+ *     -> Emits the plane index tables (IP, FP, E, P, key schedule, PC1).
+ *   genSbox(..):
+ *     -> Emits one S-box as a Boolean gate network.
+ *   build(..):
+ *     -> Shared BDD synthesis of a 6-input function, memoized on truth tables.
+ *   genPerm(..):
+ *     -> Emits a 64-bit permutation as 8 x 256 byte lookup tables.
+ *   genPext(..):
+ *     -> Emits the PEXT/PDEP masks of IP and FP (des_perm_bmi2.c).
+ *   genShift(..):
+ *     -> Emits a permutation as masked shifts, one per displacement, plus
+ *        a _Static_assert for every bit it moves.
+ *   genCrypt(..):
+ *     -> Emits the plane index tables and S-boxes of crypt(3).
+ * Plane conventions:
+ *   Plane i of a 64-bit block is bit i (0x1ull << i) of every lane.
+ *   bs_E[k][j]   -> R plane feeding input bit j of S-box k.
+ *   bs_P[k][m]   -> L plane receiving output bit m of S-box k.
+ *   bs_K[r][6k+j] -> key plane (bit of the PC1 output) XORed into that input in round r.
+ *   bs_PC1[p]    -> plane of the loaded 64-bit key that becomes key plane p.
+ *   bs_sK(a0..a5, d0..d3) computes table_S[K] on a0..a5 (a0 = LSB of the index)
+ *   and XORs output bit m into *dm.
+ * crypt(3) conventions (FIPS bit n of a block or key is plane 64 - n):
+ *   cr_E[t]      -> R plane of expanded bit t (before the salt swaps).
+ *   cr_K[r][t]   -> key plane XORed into expanded bit t in round r.
+ *   cr_P[k][m], cr_FP[p] -> as bs_P and bs_FP.
+ *   bs_cK(a0..a5, ..) computes S-box K+1 with a5 = first and a0 = last input bit.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "des_tables.h"
+
+#define ALL 0xffffffffffffffffull
+#define MAX_NODES 512
+#define HASH_SIZE 1024
+
+typedef long long unsigned u64;
+
+// Truth tables of the six S-box inputs
+static u64 var[6];
+
+// Memo of already built functions
+static u64 memo_f[MAX_NODES];
+static int num_memo;
+static int gates;
+
+// Emitted code (only kept for the final pass)
+static char code[64 * 1024];
+static int emitting;
+
+// Synthesis variant (bit 0: smaller cofactor first, bit 1: branch on f0 ^ f1)
+static int style;
+
+// S-boxes being synthesized, indexed by a0..a5 (table_S, or the FIPS ones for crypt)
+static int sbox[8][64];
+
+static int support(u64 f) {
+    int j, n = 0;
+    for(j = 0; j < 6; j++) {
+        if(((f & var[j]) >> (1 << j)) != (f & ~var[j])) n++;
+    }
+    return n;
+}
+
+// Hash of memo_f (entries from older builds are told apart by their stamp)
+static int hash_node[HASH_SIZE];
+static int hash_stamp[HASH_SIZE];
+static int stamp;
+
+static int lookup(u64 f) {
+    unsigned h = (unsigned)((f * 0x9e3779b97f4a7c15ull) >> 54);
+
+    for(; hash_stamp[h] == stamp; h = (h + 1) & (HASH_SIZE - 1)) {
+        if(memo_f[hash_node[h]] == f) return hash_node[h];
+    }
+    return -1;
+}
+
+static void insert(int n) {
+    unsigned h = (unsigned)((memo_f[n] * 0x9e3779b97f4a7c15ull) >> 54);
+
+    while(hash_stamp[h] == stamp) h = (h + 1) & (HASH_SIZE - 1);
+    hash_stamp[h] = stamp;
+    hash_node[h] = n;
+}
+
+/*
+ * Name of node n: a0..a5 for the inputs, t0.. for gates
+ */
+static const char *name(int n) {
+    static char buf[4][8];
+    static int next;
+    char *p = buf[next++ & 3];
+
+    if(n < 0) p[0] = '\0';
+    else if(n < 6) sprintf(p, "a%d", n);
+    else sprintf(p, "t%d", n - 6);
+    return p;
+}
+
+/*
+ * Add a gate computing f from nodes x, y, z (as used by fmt)
+ * @return memo index of the new node
+ */
+static int emit(u64 f, int cost, const char *fmt, int x, int y, int z) {
+    char line[128];
+    int n = num_memo++;
+
+    if(n >= MAX_NODES) { fputs("des_gen: too many nodes\n", stderr); exit(1); }
+    memo_f[n] = f;
+    insert(n);
+    gates += cost;
+    if(emitting) {
+        sprintf(line, "    bs_t %s = ", name(n));
+        strcat(code, line);
+        sprintf(line, fmt, name(x), name(y), name(z));
+        strcat(code, line);
+        strcat(code, ";\n");
+    }
+    return n;
+}
+
+/*
+ * Build f, branching on the variables in order[level..5]
+ * @return memo index of f
+ */
+static int build(u64 f, const int *order, int level) {
+    u64 f0, f1, m;
+    int n, g0, g1, d, j;
+
+    n = lookup(f);
+    if(n >= 0) return n;
+    n = lookup(~f);
+    if(n >= 0) return emit(f, 1, "~%s", n, -1, -1);
+
+    // Skip variables f does not depend on
+    for(;;) {
+        j = order[level];
+        m = var[j];
+        f0 = f & ~m; f0 |= f0 << (1 << j);
+        f1 = f & m;  f1 |= f1 >> (1 << j);
+        if(f0 != f1) break;
+        level++;
+    }
+
+    if(f0 == 0) {
+        g1 = build(f1, order, level + 1);
+        return emit(f, 1, "%s & %s", g1, j, -1);
+    }
+    if(f1 == 0) {
+        g0 = build(f0, order, level + 1);
+        return emit(f, 1, "%s & ~%s", g0, j, -1);
+    }
+    if(f1 == ALL) {
+        g0 = build(f0, order, level + 1);
+        return emit(f, 1, "%s | %s", g0, j, -1);
+    }
+    if(f0 == ALL) {
+        g1 = build(f1, order, level + 1);
+        return emit(f, 2, "%s | ~%s", g1, j, -1);
+    }
+    if(f1 == ~f0) {
+        g0 = build(f0, order, level + 1);
+        return emit(f, 1, "%s ^ %s", g0, j, -1);
+    }
+
+    // f = f0 ^ ((f0 ^ f1) & x) or f1 ^ ((f0 ^ f1) & ~x), reusing what already exists
+    d = lookup(f0 ^ f1);
+    if(d >= 0 && lookup(f0) >= 0) {
+        return emit(f, 2, "%s ^ (%s & %s)", lookup(f0), d, j);
+    }
+    if(d >= 0 && lookup(f1) >= 0) {
+        return emit(f, 2, "%s ^ (%s & ~%s)", lookup(f1), d, j);
+    }
+    if(style & 0x1) {
+        // Branch on the cofactor with the smaller support first
+        if(support(f1) < support(f0)) {
+            g1 = build(f1, order, level + 1);
+            if(style & 0x2) {
+                d = build(f0 ^ f1, order, level + 1);
+                return emit(f, 2, "%s ^ (%s & ~%s)", g1, d, j);
+            }
+            g0 = build(f0, order, level + 1);
+            d = emit(f0 ^ f1, 1, "%s ^ %s", g0, g1, -1);
+            return emit(f, 2, "%s ^ (%s & %s)", g0, d, j);
+        }
+    }
+    g0 = build(f0, order, level + 1);
+    if(style & 0x2) {
+        d = build(f0 ^ f1, order, level + 1);
+        return emit(f, 2, "%s ^ (%s & %s)", g0, d, j);
+    }
+    g1 = build(f1, order, level + 1);
+    d = emit(f0 ^ f1, 1, "%s ^ %s", g0, g1, -1);
+    return emit(f, 2, "%s ^ (%s & %s)", g0, d, j);
+}
+
+/*
+ * Build the four outputs of S-box k with the given variable and output orders
+ * @return number of gates
+ */
+static int buildSbox(int k, const int *order, const int *outs, int *result) {
+    u64 f;
+    int i, m, v;
+
+    num_memo = 0;
+    gates = 0;
+    code[0] = '\0';
+    stamp++;
+    for(i = 0; i < 6; i++) {
+        memo_f[num_memo] = var[i];
+        insert(num_memo);
+        num_memo++;
+    }
+    for(i = 0; i < 4; i++) {
+        m = outs[i];
+        f = 0;
+        for(v = 0; v < 64; v++) {
+            f |= (u64)((sbox[k][v] >> m) & 0x1) << v;
+        }
+        result[m] = build(f, order, 0);
+    }
+    return gates;
+}
+
+/*
+ * Emit S-box k using the cheapest variable/output order found
+ */
+static void genSbox(int k, const char *prefix, const char *label) {
+    int order[6], outs[4], best_order[6], best_outs[4], result[4];
+    int best = 1 << 30, best_style = 0;
+    int p, q, i, j, r, used, cost;
+
+    // All 4 variants x 720 variable orders x 24 output orders
+    for(p = 0; p < 4 * 720; p++) {
+        style = p / 720;
+        r = p % 720; used = 0;
+        for(i = 0; i < 6; i++) {
+            j = r % (6 - i); r /= (6 - i);
+            for(order[i] = 0; ; order[i]++) {
+                if(used & (1 << order[i])) continue;
+                if(j-- == 0) break;
+            }
+            used |= 1 << order[i];
+        }
+        for(q = 0; q < 24; q++) {
+            r = q; used = 0;
+            for(i = 0; i < 4; i++) {
+                j = r % (4 - i); r /= (4 - i);
+                for(outs[i] = 0; ; outs[i]++) {
+                    if(used & (1 << outs[i])) continue;
+                    if(j-- == 0) break;
+                }
+                used |= 1 << outs[i];
+            }
+            cost = buildSbox(k, order, outs, result);
+            if(cost < best) {
+                best = cost;
+                best_style = style;
+                memcpy(best_order, order, sizeof(order));
+                memcpy(best_outs, outs, sizeof(outs));
+            }
+        }
+    }
+
+    style = best_style;
+    emitting = 1;
+    buildSbox(k, best_order, best_outs, result);
+    emitting = 0;
+
+    printf("/* %s: %d gates */\n", label, best);
+    printf("static inline void %s%d(bs_t a0, bs_t a1, bs_t a2, bs_t a3, bs_t a4, bs_t a5,\n", prefix, k);
+    printf("                         bs_t *d0, bs_t *d1, bs_t *d2, bs_t *d3) {\n");
+    fputs(code, stdout);
+    for(i = 0; i < 4; i++) {
+        printf("    *d%d ^= %s;\n", i, name(result[i]));
+    }
+    printf("}\n\n");
+}
+
+static void printTable(const char *decl, const int *t, int n, int per_line) {
+    int i;
+    printf("%s = {", decl);
+    for(i = 0; i < n; i++) {
+        if(i % per_line == 0) printf("\n    ");
+        printf("%2d%s", t[i], i != n - 1 ? ", " : "");
+    }
+    printf("\n};\n\n");
+}
+
+/*
+ * Emit the plane index tables
+ */
+static void genIndex(void) {
+    int E[8][6], P[8][4], K[16][48], PC1[56];
+    int pinv[32];
+    int i, j, k, r, shift, pos, half, q;
+
+    // S-box k input j is expanded bit 6k+j (table_E is filled from bit 47 down)
+    for(k = 0; k < 8; k++) {
+        for(j = 0; j < 6; j++) E[k][j] = table_E[47 - (6*k + j)];
+    }
+
+    // S-box k output m is sout bit 28-4k+m, moved by table_P to bit 31-i
+    for(i = 0; i < 32; i++) pinv[table_P[i]] = 31 - i;
+    for(k = 0; k < 8; k++) {
+        for(j = 0; j < 4; j++) P[k][j] = pinv[28 - 4*k + j];
+    }
+
+    // Round r rotates both 28-bit halves of the PC1 output left by 'shift' in total
+    shift = 0;
+    for(r = 0; r < 16; r++) {
+        shift += (r == 0 || r == 7 || r == 14 || r == 15) ? 1 : 2;
+        for(i = 0; i < 48; i++) {
+            pos = table_PC2[47 - i];
+            half = pos / 28;
+            q = ((pos % 28) - shift + 28 * 2) % 28;
+            K[r][i] = half * 28 + q;
+        }
+    }
+
+    printTable("static const int bs_IP[64]", table_IP, 64, 8);
+    printTable("static const int bs_FP[64]", table_FP, 64, 8);
+    printTable("static const int bs_E[8][6]", &E[0][0], 48, 6);
+    printTable("static const int bs_P[8][4]", &P[0][0], 32, 4);
+    // PC1 output bit 55-i is key bit table_PC1[i]
+    for(i = 0; i < 56; i++) PC1[55 - i] = table_PC1[i];
+
+    printTable("static const int bs_K[16][48]", &K[0][0], 16 * 48, 12);
+    printTable("static const int bs_PC1[56]", PC1, 56, 8);
+}
+
+/*
+ * Emit a permutation (out bit i = in bit t[i]) as name[8][256]
+ * name[k][v] is the permuted word of v << 8k, so the permutation of x is the XOR
+ * of name[k][byte k of x] over the 8 bytes.
+ */
+static void genPerm(const char *name, const int *t) {
+    u64 w;
+    int i, k, v;
+
+    printf("static const long long unsigned %s[8][256] = {\n", name);
+    for(k = 0; k < 8; k++) {
+        printf("    {");
+        for(v = 0; v < 256; v++) {
+            w = 0;
+            for(i = 0; i < 64; i++) {
+                w |= ( ( ( (u64)v << (8*k) ) >> t[i] ) & 0x1 ) << i;
+            }
+            if(v % 4 == 0) printf("\n        ");
+            printf("0x%016llxull%s", w, v != 255 ? ", " : "");
+        }
+        printf("\n    }%s\n", k != 7 ? "," : "");
+    }
+    printf("};\n\n");
+}
+
+/*
+ * Emit the masks of IP as 8 PEXT on the byte-swapped input
+ * Output byte r of IP collects bit b of every input byte, from the top byte down,
+ * so it is pext(bswap(in), 0x0101010101010101 << b). FP must be the inverse of IP;
+ * des_perm_bmi2.c runs it as the matching PDEPs.
+ */
+static void genPext(void) {
+    u64 mask[8];
+    int r, c, b;
+
+    for(r = 0; r < 64; r++) {
+        if(table_FP[table_IP[r]] != r) { fputs("des_gen: FP is not the inverse of IP\n", stderr); exit(1); }
+    }
+    for(r = 0; r < 8; r++) {
+        b = table_IP[8*r] % 8;
+        for(c = 0; c < 8; c++) {
+            if(table_IP[8*r + c] != 8*(7 - c) + b) { fputs("des_gen: IP has no PEXT form\n", stderr); exit(1); }
+        }
+        mask[r] = 0x0101010101010101ull << b;
+    }
+
+    printf("static const long long unsigned table_IPpext[8] = {");
+    for(r = 0; r < 8; r++) {
+        if(r % 4 == 0) printf("\n    ");
+        printf("0x%016llxull%s", mask[r], r != 7 ? ", " : "");
+    }
+    printf("\n};\n\n");
+}
+
+/*
+ * Emit a bit permutation (out bit dst[i] = in bit src[i]) as the macro name(x)
+ * Bits moving by the same displacement share one shift and mask, so the macro is
+ * a constant expression of at most one term per displacement. Every bit is then
+ * checked at compile time against the table it came from.
+ */
+static void genShift(const char *name, const char *table, const int *src, const int *dst, int n) {
+    u64 mask[127];
+    int i, d, terms = 0;
+
+    memset(mask, 0, sizeof(mask));
+    for(i = 0; i < n; i++) {
+        mask[dst[i] - src[i] + 63] |= 0x1ull << dst[i];
+    }
+    for(d = 0; d < 127; d++) terms += mask[d] != 0;
+
+    printf("/* %s: %d bits, %d shifts */\n", table, n, terms);
+    printf("#define %s(x) ( 0", name);
+    for(d = 0; d < 127; d++) {
+        if(!mask[d]) continue;
+        if(d == 63) printf(" \\\n    | ( (x) & 0x%016llxull )", mask[d]);
+        else if(d > 63) printf(" \\\n    | ( ( (x) << %d ) & 0x%016llxull )", d - 63, mask[d]);
+        else printf(" \\\n    | ( ( (x) >> %d ) & 0x%016llxull )", 63 - d, mask[d]);
+    }
+    printf(" )\n\n");
+    for(i = 0; i < n; i++) {
+        printf("_Static_assert(%s(0x1ull << %d) == 0x1ull << %d, \"%s\");\n", name, src[i], dst[i], table);
+    }
+    printf("\n");
+}
+
+/*
+ * Emit the key schedule and P permutations (des.c) with genShift
+ */
+static void genShifts(void) {
+    int src[64], dst[64];
+    int i, g, j;
+
+    // PC1: key bit table_PC1[i] -> first key bit 55-i
+    for(i = 0; i < 56; i++) { src[i] = table_PC1[i]; dst[i] = 55 - i; }
+    genShift("DES_PERM_PC1", "table_PC1", src, dst, 56);
+
+    // PC2 bit 6g+j (round key bit table_PC2[47-6g-j]) -> bit 5-j of group g at table_SPshift[g]
+    for(g = 0; g < 8; g++) {
+        for(j = 0; j < 6; j++) {
+            src[6*g + j] = table_PC2[47 - (6*g + j)];
+            dst[6*g + j] = table_SPshift[g] + 5 - j;
+        }
+    }
+    genShift("DES_PERM_SUBKEY", "table_PC2", src, dst, 48);
+
+    // P: S-box output bit table_P[i] -> bit 31-i
+    for(i = 0; i < 32; i++) { src[i] = table_P[i]; dst[i] = 31 - i; }
+    genShift("DES_PERM_P", "table_P", src, dst, 32);
+}
+
+/*
+ * Emit the crypt(3) kernel tables and S-boxes from the FIPS 46-3 tables
+ */
+static void genCrypt(void) {
+    int E[48], P[8][4], K[16][48], FP[64], pinv[32];
+    int i, k, m, r, t, v, shift, pos, half, q;
+    char label[32];
+
+    // Expanded bit t reads half block bit table_fips_E[t] (plane index from 0)
+    for(t = 0; t < 48; t++) E[t] = table_fips_E[t] - 1;
+
+    // S-box k output m (m = 0: last bit) is f bit 4k+3-m before P, moved by P to bit i
+    for(i = 0; i < 32; i++) pinv[table_fips_P[i] - 1] = i;
+    for(k = 0; k < 8; k++) {
+        for(m = 0; m < 4; m++) P[k][m] = pinv[4*k + 3 - m];
+    }
+
+    // Round r: both halves of the PC1 output rotated left by 'shift' in total
+    shift = 0;
+    for(r = 0; r < 16; r++) {
+        shift += table_fips_shifts[r];
+        for(t = 0; t < 48; t++) {
+            pos = table_fips_PC2[t] - 1;
+            half = pos / 28;
+            q = half * 28 + (pos % 28 + shift) % 28;
+            K[r][t] = 64 - table_fips_PC1[q];
+        }
+    }
+
+    // Output plane 64-n is preoutput bit table_fips_FP[n-1] (L planes first, then R)
+    for(i = 0; i < 64; i++) FP[63 - i] = table_fips_FP[i] - 1;
+
+    printTable("static const int cr_E[48]", E, 48, 8);
+    printTable("static const int cr_P[8][4]", &P[0][0], 32, 4);
+    printTable("static const int cr_K[16][48]", &K[0][0], 16 * 48, 12);
+    printTable("static const int cr_FP[64]", FP, 64, 8);
+
+    // a5..a0 = input bits 1..6: row = a5 a0, column = a4..a1
+    for(k = 0; k < 8; k++) {
+        for(v = 0; v < 64; v++) {
+            sbox[k][v] = table_fips_S[k][16 * (((v >> 4) & 0x2) | (v & 0x1)) + ((v >> 1) & 0xf)];
+        }
+    }
+    for(k = 0; k < 8; k++) {
+        sprintf(label, "FIPS S%d", k + 1);
+        genSbox(k, "bs_c", label);
+    }
+}
+
+int main(int argc, char** argv) {
+    char label[32];
+    int i, v;
+
+    for(i = 0; i < 6; i++) {
+        var[i] = 0;
+        for(v = 0; v < 64; v++) {
+            if(v & (1 << i)) var[i] |= 0x1ull << v;
+        }
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-c") == 0) {
+        printf("/* Generated by des_gen -c from des_tables.h, do not edit */\n\n");
+        printf("#ifndef DES_CRYPT_GEN_H\n#define DES_CRYPT_GEN_H\n\n");
+        genCrypt();
+        printf("#endif\n");
+        return 0;
+    }
+
+    if(argc > 1 && strcmp(argv[1], "-p") == 0) {
+        printf("/* Generated by des_gen -p from des_tables.h, do not edit */\n\n");
+        printf("#ifndef DES_PERM_GEN_H\n#define DES_PERM_GEN_H\n\n");
+        genPerm("table_IPbyte", table_IP);
+        genPerm("table_FPbyte", table_FP);
+        genPext();
+        genShifts();
+        printf("#endif\n");
+        return 0;
+    }
+
+    printf("/* Generated by des_gen from des_tables.h, do not edit */\n\n");
+    printf("#ifndef DES_BS_GEN_H\n#define DES_BS_GEN_H\n\n");
+    genIndex();
+    memcpy(sbox, table_S, sizeof(sbox));
+    for(i = 0; i < 8; i++) {
+        sprintf(label, "table_S[%d]", i);
+        genSbox(i, "bs_s", label);
+    }
+    printf("#endif\n");
+
+    return 0;
+}
@@ -0,0 +1,31 @@
+
+/*
+ * des_io.h
+ *
+ * Positioned reads shared by des_files.c and des_range.c
+ */
+
+#ifndef DES_IO_H
+#define DES_IO_H
+
+#include <errno.h>
+#include <unistd.h>
+
+/*
+ * pread until len bytes or the end of the file (EINTR retried)
+ * @return bytes read, or -1 on a read error
+ */
+static inline long des_read_at(int fd, char *buf, long len, long offset) {
+    long done;
+    ssize_t n;
+
+    for(done = 0; done < len; done += n) {
+        n = pread(fd, buf + done, len - done, offset + done);
+        if(n < 0 && errno == EINTR) { n = 0; continue; }
+        if(n < 0) return -1;
+        if(n == 0) break;
+    }
+    return done;
+}
+
+#endif
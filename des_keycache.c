@@ -0,0 +1,219 @@
+
+/*
+ * des_keycache.c
+ *
+ * LRU cache of key schedules (see des_keycache.h)
+ *
+ * Role of each functions:
+ *   des_keycache_get(..):
+ *     -> Hash lookup in the key's shard; a hit moves the entry to the front
+ *        of the LRU list, a miss takes a free entry or evicts the last one.
+ *   hashKey(..):
+ *     -> 64-bit finalizer of MurmurHash3 (fmix64), top bits pick the shard, low
+ *        bits the bucket. Every output bit depends on every key byte, so keys
+ *        that differ in a few bytes only still spread over the buckets.
+ *   wipe(..):
+ *     -> memset the compiler cannot drop.
+ * Shards:
+ *   Entries live in one aligned array per shard and are linked by index
+ *   (LRU list and bucket chains), so a shard is allocated once and never
+ *   grows. The lookup copies the des_ctx out under the lock: an entry may be
+ *   evicted as soon as the lock is released.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "des_keycache.h"
+
+struct entry {
+    des_ctx ctx; // first: the subkeys start on a cache line
+    long long unsigned key;
+    int prev, next; // LRU list, most recent first
+    int chain; // next entry in the same bucket
+} __attribute__((aligned(64)));
+
+struct shard {
+    pthread_mutex_t lock;
+    struct entry *entries;
+    int *buckets; // first entry per bucket, -1 if empty
+    int num_buckets; // power of 2
+    int capacity, used;
+    int head, tail;
+    long long unsigned hits, misses, evictions;
+} __attribute__((aligned(64)));
+
+struct des_keycache {
+    struct shard shards[DES_KEYCACHE_SHARDS];
+    long capacity;
+};
+
+static des_keycache *default_cache;
+static pthread_once_t default_once = PTHREAD_ONCE_INIT;
+
+static void wipe(void *p, size_t len) {
+    memset(p, 0, len);
+    __asm__ __volatile__("" : : "r"(p) : "memory");
+}
+
+static long long unsigned hashKey(long long unsigned key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdull;
+    key ^= key >> 33;
+    key *= 0xc4ceb9fe1a85ec53ull;
+    key ^= key >> 33;
+    return key;
+}
+
+des_keycache *des_keycache_create(long capacity) {
+    des_keycache *kc;
+    struct shard *s;
+    int per_shard, i, j;
+
+    if(capacity < 1) return NULL;
+    per_shard = (int)((capacity + DES_KEYCACHE_SHARDS - 1) / DES_KEYCACHE_SHARDS);
+    kc = aligned_alloc(64, sizeof(*kc));
+    if(!kc) return NULL;
+    memset(kc, 0, sizeof(*kc));
+    kc->capacity = (long)per_shard * DES_KEYCACHE_SHARDS;
+
+    for(i = 0; i < DES_KEYCACHE_SHARDS; i++) {
+        s = &kc->shards[i];
+        pthread_mutex_init(&s->lock, NULL);
+        s->capacity = per_shard;
+        s->head = s->tail = -1;
+        for(s->num_buckets = 1; s->num_buckets < 2 * per_shard; s->num_buckets *= 2);
+        s->entries = aligned_alloc(64, per_shard * sizeof(*s->entries));
+        s->buckets = malloc(s->num_buckets * sizeof(*s->buckets));
+        if(!s->entries || !s->buckets) {
+            des_keycache_destroy(kc);
+            return NULL;
+        }
+        for(j = 0; j < s->num_buckets; j++) s->buckets[j] = -1;
+    }
+    return kc;
+}
+
+void des_keycache_destroy(des_keycache *kc) {
+    struct shard *s;
+    int i;
+
+    if(!kc) return;
+    for(i = 0; i < DES_KEYCACHE_SHARDS; i++) {
+        s = &kc->shards[i];
+        if(s->entries) wipe(s->entries, s->capacity * sizeof(*s->entries));
+        free(s->entries);
+        free(s->buckets);
+        pthread_mutex_destroy(&s->lock);
+    }
+    free(kc);
+}
+
+static void unlinkLru(struct shard *s, struct entry *e) {
+    if(e->prev >= 0) s->entries[e->prev].next = e->next;
+    else s->head = e->next;
+    if(e->next >= 0) s->entries[e->next].prev = e->prev;
+    else s->tail = e->prev;
+}
+
+static void pushFront(struct shard *s, int index) {
+    struct entry *e = &s->entries[index];
+
+    e->prev = -1;
+    e->next = s->head;
+    if(s->head >= 0) s->entries[s->head].prev = index;
+    s->head = index;
+    if(s->tail < 0) s->tail = index;
+}
+
+/*
+ * Take the least recently used entry out of the LRU list and its bucket
+ * @return its index
+ */
+static int evict(struct shard *s, long long unsigned hash_mask) {
+    int index = s->tail, *link;
+    struct entry *e = &s->entries[index];
+
+    unlinkLru(s, e);
+    link = &s->buckets[hashKey(e->key) & hash_mask];
+    while(*link != index) link = &s->entries[*link].chain;
+    *link = e->chain;
+    wipe(e, sizeof(*e));
+    s->evictions++;
+    return index;
+}
+
+int des_keycache_get(des_keycache *kc, const char *key, des_ctx *ctx) {
+    long long unsigned k, h, mask;
+    struct shard *s;
+    struct entry *e;
+    int index, bucket;
+
+    memcpy(&k, key, 8);
+    h = hashKey(k);
+    s = &kc->shards[h >> 60 & (DES_KEYCACHE_SHARDS - 1)];
+
+    pthread_mutex_lock(&s->lock);
+    mask = s->num_buckets - 1;
+    bucket = (int)(h & mask);
+    for(index = s->buckets[bucket]; index >= 0; index = s->entries[index].chain) {
+        e = &s->entries[index];
+        if(e->key != k) continue;
+        if(s->head != index) {
+            unlinkLru(s, e);
+            pushFront(s, index);
+        }
+        *ctx = e->ctx;
+        s->hits++;
+        pthread_mutex_unlock(&s->lock);
+        return 1;
+    }
+
+    // Miss: the schedule is computed under the lock so that a key is never set up twice
+    index = s->used < s->capacity ? s->used++ : evict(s, mask);
+    e = &s->entries[index];
+    des_ctx_init(&e->ctx, key);
+    e->key = k;
+    e->chain = s->buckets[bucket];
+    s->buckets[bucket] = index;
+    pushFront(s, index);
+    *ctx = e->ctx;
+    s->misses++;
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+void des_keycache_stats_get(des_keycache *kc, des_keycache_stats *stats) {
+    struct shard *s;
+    int i, j, index, chain;
+
+    memset(stats, 0, sizeof(*stats));
+    stats->capacity = kc->capacity;
+    for(i = 0; i < DES_KEYCACHE_SHARDS; i++) {
+        s = &kc->shards[i];
+        pthread_mutex_lock(&s->lock);
+        stats->hits += s->hits;
+        stats->misses += s->misses;
+        stats->evictions += s->evictions;
+        stats->entries += s->used;
+        for(j = 0; j < s->num_buckets; j++) {
+            chain = 0;
+            for(index = s->buckets[j]; index >= 0; index = s->entries[index].chain) chain++;
+            if(chain > stats->max_chain) stats->max_chain = chain;
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+static void initDefault(void) {
+    const char *env = getenv("DES_KEYCACHE");
+    long capacity = env ? atol(env) : DES_KEYCACHE_DEFAULT;
+
+    if(capacity > 0) default_cache = des_keycache_create(capacity);
+}
+
+des_keycache *des_keycache_default(void) {
+    pthread_once(&default_once, initDefault);
+    return default_cache;
+}
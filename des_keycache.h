@@ -0,0 +1,60 @@
+
+/*
+ * des_keycache.h
+ *
+ * LRU cache of key schedules, keyed by the 8 key bytes
+ *
+ * Usage:
+ *   des_keycache *kc = des_keycache_create(4096);
+ *   des_ctx ctx;
+ *   des_keycache_get(kc, key, &ctx);   // des_ctx_init only on a miss
+ *   des_ecb_encrypt(&ctx, in, out, len);
+ * The cache is split into DES_KEYCACHE_SHARDS shards by a hash of the key,
+ * each with its own lock and LRU list, so threads with different keys rarely
+ * meet. Entries are cache-line aligned and hold the whole des_ctx (encrypt
+ * and decrypt subkeys, and first_key for the bitsliced engine) next to the
+ * key. Evicted entries and the cache itself are zeroed before reuse / free.
+ *
+ * encryption() / decryption() go through des_keycache_default(), sized by
+ * DES_KEYCACHE=<entries> (default DES_KEYCACHE_DEFAULT, 0 turns it off).
+ */
+
+#ifndef DES_KEYCACHE_H
+#define DES_KEYCACHE_H
+
+#include "des.h"
+
+#define DES_KEYCACHE_SHARDS 16
+#define DES_KEYCACHE_DEFAULT 4096
+
+typedef struct des_keycache des_keycache;
+
+typedef struct des_keycache_stats {
+    long long unsigned hits, misses, evictions;
+    long entries, capacity;
+    int max_chain; // longest bucket chain
+} des_keycache_stats;
+
+/*
+ * @param capacity Entries in all shards together (rounded up to a multiple of the shards)
+ * @return cache, or NULL on failure
+ */
+des_keycache *des_keycache_create(long capacity);
+void des_keycache_destroy(des_keycache *kc);
+
+/*
+ * Key schedule of key, from the cache or computed and inserted
+ * @param kc Cache
+ * @param key 8-byte key
+ * @param ctx Context (output reference, a copy of the entry)
+ * @return 1 on a hit, 0 on a miss
+ */
+int des_keycache_get(des_keycache *kc, const char *key, des_ctx *ctx);
+
+// Counters summed over the shards (walks every bucket for max_chain)
+void des_keycache_stats_get(des_keycache *kc, des_keycache_stats *stats);
+
+// Process-wide cache of encryption() / decryption(), or NULL when DES_KEYCACHE=0
+des_keycache *des_keycache_default(void);
+
+#endif
@@ -0,0 +1,222 @@
+
+/*
+ * des_load.c
+ *
+ * Load generator for the des_c -S server
+ *
+ * Role of each functions:
+ *   connMain(..):
+ *     -> One connection: registers a key, sends requests one at a time and
+ *        checks every answer against des_ctx on this side.
+ *   request(..):
+ *     -> One round trip.
+ *   main(..):
+ *     -> Starts the connections, then reports throughput and latency percentiles.
+ *
+ * Usage:
+ *   des_load [-c connections] [-n requests_per_connection] [-b bytes] [-m ecb|cbc|ctr] <socket_path>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "des.h"
+#include "des_modes.h"
+#include "des_batch.h"
+#include "des_server.h"
+
+struct conn {
+    pthread_t thread;
+    int index;
+    double *latency; // seconds, one per request
+    int failed;
+};
+
+static const char *socket_path;
+static int num_requests = 1000, mode = DES_BATCH_ECB;
+static long num_bytes = 64;
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static int compareDouble(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static int ioFull(int fd, void *buf, long len, int out) {
+    long done;
+    ssize_t n;
+
+    for(done = 0; done < len; done += n) {
+        n = out ? send(fd, (char *)buf + done, len - done, MSG_NOSIGNAL) : read(fd, (char *)buf + done, len - done);
+        if(n < 0 && errno == EINTR) { n = 0; continue; }
+        if(n <= 0) return -1;
+    }
+    return 0;
+}
+
+/*
+ * @param data In: request data, out: response data (len bytes)
+ * @return status of the response, or -EIO
+ */
+static int request(int fd, des_req_hdr *hdr, char *data, char *iv) {
+    des_resp_hdr resp;
+
+    if(ioFull(fd, hdr, sizeof(*hdr), 1) != 0 || ioFull(fd, data, hdr->len, 1) != 0) return -EIO;
+    if(ioFull(fd, &resp, sizeof(resp), 0) != 0 || resp.id != hdr->id || resp.len > hdr->len) return -EIO;
+    if(ioFull(fd, data, resp.len, 0) != 0) return -EIO;
+    memcpy(iv, resp.iv, 8);
+    return resp.status;
+}
+
+static void *connMain(void *p) {
+    struct conn *c = p;
+    struct sockaddr_un addr;
+    des_req_hdr hdr;
+    des_ctx ctx;
+    char key[8], iv[8], local_iv[8], *buf, *expect;
+    int fd, handle, r, i;
+    double t;
+
+    buf = malloc(num_bytes);
+    expect = malloc(num_bytes);
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, socket_path, sizeof(addr.sun_path) - 1);
+    if(!buf || !expect || fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        perror("connecting");
+        c->failed = 1;
+        goto done;
+    }
+
+    // (1/2) One key per connection, so the server batches across keys
+    for(i = 0; i < 8; i++) key[i] = (char)(0x13 * c->index + 0x31 * i + 1);
+    des_ctx_init(&ctx, key);
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.op = DES_OP_KEY;
+    hdr.len = 8;
+    memcpy(buf, key, 8);
+    handle = request(fd, &hdr, buf, iv);
+    if(handle < 0) {
+        fprintf(stderr, "registering key: %s\n", strerror(-handle));
+        c->failed = 1;
+        goto done;
+    }
+
+    // (2/2) Encrypt, check against the local des_ctx
+    memset(local_iv, 0, 8);
+    for(r = 0; r < num_requests; r++) {
+        for(i = 0; i < num_bytes; i++) buf[i] = (char)(r + 7 * i + c->index);
+        hdr.id = r + 1;
+        hdr.op = DES_OP_ENCRYPT;
+        hdr.mode = mode;
+        hdr.handle = handle;
+        hdr.len = (uint32_t)num_bytes;
+        memcpy(hdr.iv, local_iv, 8);
+
+        if(mode == DES_BATCH_CTR) des_ctr_crypt(&ctx, buf, expect, (int)num_bytes, local_iv);
+        else if(mode == DES_BATCH_CBC) des_cbc_encrypt(&ctx, buf, expect, (int)num_bytes, local_iv);
+        else des_ecb_encrypt(&ctx, buf, expect, (int)num_bytes);
+
+        t = seconds();
+        i = request(fd, &hdr, buf, iv);
+        c->latency[r] = seconds() - t;
+        if(i != 0 || memcmp(buf, expect, num_bytes) != 0 || (mode != DES_BATCH_ECB && memcmp(iv, local_iv, 8) != 0)) {
+            fprintf(stderr, "connection %d, request %d: %s\n", c->index, r, i < 0 ? strerror(-i) : "wrong answer");
+            c->failed = 1;
+            break;
+        }
+    }
+
+done:
+    if(fd >= 0) close(fd);
+    free(buf);
+    free(expect);
+    return NULL;
+}
+
+static void usage(void) {
+    printf("des_load [-c connections] [-n requests] [-b bytes] [-m ecb|cbc|ctr] <socket_path>\n");
+    printf("  -c: concurrent connections, one key each (default 16)\n");
+    printf("  -n: requests per connection (default 1000)\n");
+    printf("  -b: bytes per request (default 64)\n");
+    printf("  -m: mode (default ecb)\n");
+}
+
+int main(int argc, char **argv) {
+    struct conn *conns;
+    double *all, t;
+    int num_conns = 16, failed = 0, opt, i;
+    long total;
+
+    while((opt = getopt(argc, argv, "c:n:b:m:")) != -1) {
+        switch(opt) {
+        case 'c':
+            num_conns = atoi(optarg);
+            break;
+        case 'n':
+            num_requests = atoi(optarg);
+            break;
+        case 'b':
+            num_bytes = atol(optarg);
+            break;
+        case 'm':
+            if(strcmp(optarg, "ecb") == 0) mode = DES_BATCH_ECB;
+            else if(strcmp(optarg, "cbc") == 0) mode = DES_BATCH_CBC;
+            else if(strcmp(optarg, "ctr") == 0) mode = DES_BATCH_CTR;
+            else { usage(); exit(1); }
+            break;
+        default:
+            usage();
+            exit(1);
+        }
+    }
+    if(argc - optind < 1 || num_conns < 1 || num_requests < 1 || num_bytes < 1 || num_bytes > DES_SERVER_MAX_LEN
+       || (mode != DES_BATCH_CTR && num_bytes % 8 != 0)) {
+        usage();
+        exit(1);
+    }
+    socket_path = argv[optind];
+
+    total = (long)num_conns * num_requests;
+    conns = calloc(num_conns, sizeof(*conns));
+    all = malloc(total * sizeof(*all));
+    if(!conns || !all) { fputs("memory allocation fails\n", stderr); exit(1); }
+
+    t = seconds();
+    for(i = 0; i < num_conns; i++) {
+        conns[i].index = i;
+        conns[i].latency = all + (long)i * num_requests;
+        if(pthread_create(&conns[i].thread, NULL, connMain, &conns[i]) != 0) {
+            fputs("thread creation fails\n", stderr);
+            exit(1);
+        }
+    }
+    for(i = 0; i < num_conns; i++) {
+        pthread_join(conns[i].thread, NULL);
+        failed |= conns[i].failed;
+    }
+    t = seconds() - t;
+    if(failed) return 1;
+
+    qsort(all, total, sizeof(*all), compareDouble);
+    printf("%d connections, %ld requests of %ld bytes in %.3f s\n", num_conns, total, num_bytes, t);
+    printf("%.0f req/s, %.2f MB/s\n", total / t, total * num_bytes / t / 1e6);
+    printf("latency us: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f\n",
+           all[total / 2] * 1e6, all[total * 9 / 10] * 1e6, all[total * 99 / 100] * 1e6, all[total - 1] * 1e6);
+    free(all);
+    free(conns);
+    return 0;
+}
@@ -0,0 +1,190 @@
+
+/*
+ * des_mac.c
+ *
+ * ISO 9797-1 MAC algorithms 1 and 3 over the bitsliced engine (see des_mac.h)
+ *
+ * Role of each functions:
+ *   macChains(..):
+ *     -> CBC chains, one lane per message; a lane whose message is done takes
+ *        the next one at once, so long and short messages mix freely.
+ *   macOutput(..):
+ *     -> ALG3 output transform of the finished chains, des_bs_width() messages
+ *        per decryption and encryption pass.
+ *   macSerial(..):
+ *     -> The same per message through des_ctx (bitsliced engine switched off,
+ *        or too few messages to fill half of the lanes).
+ *   getBlock(..):
+ *     -> Block k of the padded message, without copying the message.
+ * Words:
+ *   As in des_batch.c, a chaining value is the word the kernel returns, which
+ *   des_ecb_encrypt stores little-endian; des_ecb_decrypt loads that word back
+ *   as is, so the ALG3 transform runs on words with no byte shuffling.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "des.h"
+#include "des_bs.h"
+#include "des_mac.h"
+#include "des_block.h"
+#include "des_keycache.h"
+
+/*
+ * @return number of blocks of the padded message (at least 1)
+ */
+static inline int numBlocks(int len, int pad) {
+    if(pad == DES_MAC_PAD2) return len / 8 + 1;
+    return len == 0 ? 1 : (len + 7) / 8;
+}
+
+/*
+ * Block k of the padded message
+ * @param tmp 8-byte scratch for the last block
+ * @return the block (in the message itself when it is whole)
+ */
+static inline const char *getBlock(const des_mac_msg *m, int k, int pad, char *tmp) {
+    int rest = m->len - 8 * k;
+
+    if(rest >= 8) return m->in + 8 * k;
+    memset(tmp, 0, 8);
+    if(rest > 0) memcpy(tmp, m->in + 8 * k, rest);
+    if(pad == DES_MAC_PAD2) tmp[rest > 0 ? rest : 0] = (char)0x80;
+    return tmp;
+}
+
+/*
+ * Last CBC block of every message, as a kernel word
+ */
+static void macChains(des_mac_msg *msgs, int num_msgs, int pad, long long unsigned *chains) {
+    long long unsigned blocks[DES_BS_MAX_WIDTH], keys[DES_BS_MAX_WIDTH];
+    long long unsigned chain[DES_BS_MAX_WIDTH]; // previous cipher block, as its bytes load
+    int lane_msg[DES_BS_MAX_WIDTH], lane_block[DES_BS_MAX_WIDTH], lane_blocks[DES_BS_MAX_WIDTH];
+    int width, next, active, i;
+    char tmp[8], stored[8];
+    des_mac_msg *m;
+
+    width = des_bs_width();
+    for(i = 0; i < width; i++) lane_msg[i] = -1;
+    next = 0;
+
+    for(;;) {
+        // (1/3) Idle lanes take the next message, gather one block per lane
+        active = 0;
+        for(i = 0; i < width; i++) {
+            if(lane_msg[i] < 0 && next < num_msgs) {
+                lane_msg[i] = next++;
+                lane_block[i] = 0;
+                lane_blocks[i] = numBlocks(msgs[lane_msg[i]].len, pad);
+                chain[i] = 0; // zero IV
+            }
+            if(lane_msg[i] < 0) {
+                blocks[i] = 0;
+                keys[i] = 0;
+                continue;
+            }
+            m = &msgs[lane_msg[i]];
+            blocks[i] = des_load_block(getBlock(m, lane_block[i], pad, tmp), 1) ^ chain[i];
+            keys[i] = des_load_block(m->key, 1);
+            active++;
+        }
+        if(active == 0) break;
+
+        // (2/3) One pass for all chains
+        des_bs_crypt_keys(blocks, keys, 0);
+
+        // (3/3) The cipher block is the next chaining value
+        for(i = 0; i < width; i++) {
+            if(lane_msg[i] < 0) continue;
+            if(++lane_block[i] == lane_blocks[i]) {
+                chains[lane_msg[i]] = blocks[i];
+                lane_msg[i] = -1;
+                continue;
+            }
+            des_store_block(stored, blocks[i], 0);
+            chain[i] = des_load_block(stored, 1);
+        }
+    }
+}
+
+/*
+ * ALG3: chain = E_K(D_K'(chain)) for every message
+ */
+static void macOutput(des_mac_msg *msgs, int num_msgs, long long unsigned *chains) {
+    long long unsigned blocks[DES_BS_MAX_WIDTH], keys[DES_BS_MAX_WIDTH];
+    int width, first, n, i;
+
+    width = des_bs_width();
+    for(first = 0; first < num_msgs; first += width) {
+        n = num_msgs - first < width ? num_msgs - first : width;
+        for(i = 0; i < width; i++) {
+            blocks[i] = i < n ? chains[first + i] : 0;
+            keys[i] = i < n ? des_load_block(msgs[first + i].key + 8, 1) : 0;
+        }
+        des_bs_crypt_keys(blocks, keys, 1);
+
+        // des_ecb_decrypt stores big-endian and des_ecb_encrypt loads big-endian: same word
+        for(i = 0; i < width; i++) keys[i] = i < n ? des_load_block(msgs[first + i].key, 1) : 0;
+        des_bs_crypt_keys(blocks, keys, 0);
+        for(i = 0; i < n; i++) chains[first + i] = blocks[i];
+    }
+}
+
+static void macSerial(des_mac_msg *msgs, int num_msgs, int alg, int pad) {
+    des_keycache *kc = des_keycache_default();
+    des_ctx ctx, ctx2;
+    char chain[8], tmp[8];
+    const char *block;
+    int i, k, j, n;
+
+    for(i = 0; i < num_msgs; i++) {
+        if(kc) des_keycache_get(kc, msgs[i].key, &ctx);
+        else des_ctx_init(&ctx, msgs[i].key);
+
+        memset(chain, 0, 8);
+        n = numBlocks(msgs[i].len, pad);
+        for(k = 0; k < n; k++) {
+            block = getBlock(&msgs[i], k, pad, tmp);
+            for(j = 0; j < 8; j++) chain[j] ^= block[j];
+            des_ecb_encrypt(&ctx, chain, chain, 8);
+        }
+
+        if(alg == DES_MAC_ALG3) {
+            if(kc) des_keycache_get(kc, msgs[i].key + 8, &ctx2);
+            else des_ctx_init(&ctx2, msgs[i].key + 8);
+            des_ecb_decrypt(&ctx2, chain, chain, 8);
+            des_ecb_encrypt(&ctx, chain, chain, 8);
+        }
+        memcpy(msgs[i].mac, chain, 8);
+    }
+}
+
+/*
+ * MAC of every message with its own key
+ */
+int des_mac_batch(des_mac_msg *msgs, int num_msgs, int alg, int pad) {
+    long long unsigned *chains;
+    int i;
+
+    if(alg != DES_MAC_ALG1 && alg != DES_MAC_ALG3) return -1;
+    if(pad != DES_MAC_PAD1 && pad != DES_MAC_PAD2) return -1;
+    if(num_msgs <= 0) return 0;
+
+    // Without memory for the chaining values the serial path still works
+    chains = 2 * num_msgs >= des_bs_width() && des_bs_width() ? malloc(num_msgs * sizeof(*chains)) : NULL;
+    if(!chains) {
+        macSerial(msgs, num_msgs, alg, pad);
+        return 0;
+    }
+    macChains(msgs, num_msgs, pad, chains);
+    if(alg == DES_MAC_ALG3) macOutput(msgs, num_msgs, chains);
+    for(i = 0; i < num_msgs; i++) des_store_block(msgs[i].mac, chains[i], 0);
+    free(chains);
+    return 0;
+}
+
+int des_mac(const char *key, const char *in, int len, int alg, int pad, char *mac) {
+    des_mac_msg m = { key, in, len, mac };
+    return des_mac_batch(&m, 1, alg, pad);
+}
@@ -0,0 +1,51 @@
+
+/*
+ * des_mac.h
+ *
+ * ISO 9797-1 CBC-MACs of many short messages per call
+ *
+ * Usage:
+ *   des_mac_msg msgs[n] = {{key, in, len, mac}, ..};
+ *   des_mac_batch(msgs, n, DES_MAC_ALG3, DES_MAC_PAD1); // retail MAC (ANSI X9.19)
+ * Algorithms:
+ *   DES_MAC_ALG1 -> CBC-MAC under an 8-byte key, zero IV: the last cipher block
+ *   DES_MAC_ALG3 -> ALG1 under K, then the last block is decrypted under K' and
+ *                   encrypted again under K (16-byte key K || K')
+ * Padding:
+ *   DES_MAC_PAD1 -> zero bytes up to a whole block (an empty message is one zero block)
+ *   DES_MAC_PAD2 -> 0x80, then zero bytes up to a whole block
+ * A CBC chain is serial, so the messages are interleaved instead: every lane of
+ * the bitsliced engine carries the chain of one message with its own key, and
+ * takes the next message as soon as its own is done. The MACs are the same as
+ * des_cbc_encrypt of the padded message (and des_ecb_* for the ALG3 output
+ * transform) with the cipher of des.h.
+ */
+
+#ifndef DES_MAC_H
+#define DES_MAC_H
+
+enum { DES_MAC_ALG1 = 1, DES_MAC_ALG3 = 3 };
+enum { DES_MAC_PAD1 = 1, DES_MAC_PAD2 = 2 };
+
+typedef struct des_mac_msg {
+    const char *key; // 8 bytes (ALG1) or 16 bytes (ALG3)
+    const char *in;
+    int len; // any length, 0 included
+    char *mac; // 8 bytes (output reference), truncate as the protocol wants
+} des_mac_msg;
+
+/*
+ * @param msgs Messages
+ * @param num_msgs Number of messages
+ * @param alg DES_MAC_ALG1 or DES_MAC_ALG3
+ * @param pad DES_MAC_PAD1 or DES_MAC_PAD2
+ * @return 0, or -1 for an unknown algorithm or padding
+ */
+int des_mac_batch(des_mac_msg *msgs, int num_msgs, int alg, int pad);
+
+/*
+ * One message, same arguments as a des_mac_msg
+ */
+int des_mac(const char *key, const char *in, int len, int alg, int pad, char *mac);
+
+#endif
@@ -0,0 +1,150 @@
+
+/*
+ * des_map.c
+ *
+ * Zero-copy file encryption through mmap
+ *
+ * Role of each functions:
+ *   des_map_file(..):
+ *     -> Maps the files, runs ECB between the mappings, fixes the file size.
+ *   mapFile(..):
+ *     -> MAP_SHARED mapping with sequential / huge page hints.
+ *   cryptRegion(..):
+ *     -> ECB over a mapped region, on the pool or in DES_POOL_CHUNK pieces.
+ * In place:
+ *   Also taken when out_path is the input file itself (same device and inode).
+ *   Encryption first grows the file by the padding, decryption shrinks it
+ *   afterwards. If the padding check fails, the region is encrypted again so
+ *   the file is left as it was.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "des_map.h"
+#include "des_block.h"
+
+static char *mapFile(int fd, long size, int prot) {
+    char *p;
+
+    p = mmap(NULL, size, prot, MAP_SHARED, fd, 0);
+    if(p == MAP_FAILED) {
+        perror("mapping file");
+        return NULL;
+    }
+    madvise(p, size, MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    madvise(p, size, MADV_HUGEPAGE);
+#endif
+    return p;
+}
+
+static void cryptRegion(const des_ctx *ctx, des_pool *pool, const char *in, char *out, long len, int decrypt) {
+    long done, n;
+
+    if(pool) {
+        if(decrypt) des_pool_ecb_decrypt(pool, ctx, in, out, len);
+        else des_pool_ecb_encrypt(pool, ctx, in, out, len);
+        return;
+    }
+    for(done = 0; done < len; done += n) {
+        n = len - done;
+        if(n > DES_POOL_CHUNK) n = DES_POOL_CHUNK;
+        if(decrypt) des_ecb_decrypt(ctx, in + done, out + done, (int)n);
+        else des_ecb_encrypt(ctx, in + done, out + done, (int)n);
+    }
+}
+
+/*
+ * Encrypt (and pad) or decrypt (and unpad) in_path -> out_path, or in place
+ */
+int des_map_file(const des_ctx *ctx, des_pool *pool, const char *in_path, const char *out_path, int decrypt) {
+    struct stat st, st_out;
+    int fd_in, fd_out;
+    long size, out_size, whole;
+    char *src = NULL, *dst = NULL;
+    char last[8];
+    int pad, rtn = -1;
+
+    fd_in = open(in_path, out_path ? O_RDONLY : O_RDWR);
+    if(fd_in < 0) { perror("opening file"); return -1; }
+    if(fstat(fd_in, &st) != 0 || !S_ISREG(st.st_mode)) {
+        fputs("input is not a regular file\n", stderr);
+        close(fd_in);
+        return -1;
+    }
+    size = st.st_size;
+
+    // (1/3) Output size: one padding block more / the same until unpadded
+    if(!decrypt) {
+        pad = 8 - size % 8;
+        out_size = size + pad;
+    } else {
+        if(size == 0 || size % 8 != 0) {
+            fputs("input is not a multiple of 8 bytes\n", stderr);
+            close(fd_in);
+            return -1;
+        }
+        out_size = size;
+    }
+
+    // (2/3) Map input and output
+    fd_out = fd_in;
+    if(out_path) {
+        // Not truncated before the check: the output may be the input under another name
+        fd_out = open(out_path, O_RDWR | O_CREAT, 0644);
+        if(fd_out < 0) { perror("opening output"); close(fd_in); return -1; }
+        if(fstat(fd_out, &st_out) != 0) { perror("opening output"); goto out; }
+        if(st_out.st_dev == st.st_dev && st_out.st_ino == st.st_ino) {
+            close(fd_out);
+            close(fd_in);
+            return des_map_file(ctx, pool, in_path, NULL, decrypt);
+        }
+        if(ftruncate(fd_out, 0) != 0) { perror("sizing output"); goto out; }
+    }
+    if(ftruncate(fd_out, out_size) != 0) { perror("sizing output"); goto out; }
+    dst = mapFile(fd_out, out_size, PROT_READ | PROT_WRITE);
+    if(!dst) goto out;
+    if(!out_path) {
+        src = dst;
+    } else if(size > 0) {
+        src = mapFile(fd_in, size, PROT_READ);
+        if(!src) goto out;
+    }
+
+    // (3/3) ECB between the mappings
+    if(!decrypt) {
+        whole = size - size % 8;
+        cryptRegion(ctx, pool, src, dst, whole, 0);
+        memcpy(last, src + whole, size % 8);
+        memset(last + size % 8, pad, pad);
+        des_ecb_encrypt(ctx, last, dst + whole, 8);
+        rtn = 0;
+    } else {
+        cryptRegion(ctx, pool, src, dst, size, 1);
+        pad = des_get_pad(dst + size - 8);
+        if(pad < 0) {
+            fputs("bad padding (wrong key or damaged input)\n", stderr);
+            if(!out_path) cryptRegion(ctx, pool, dst, dst, size, 0);
+        } else {
+            out_size = size - pad;
+            rtn = 0;
+        }
+    }
+
+out:
+    if(src && src != dst) munmap(src, size);
+    if(dst) munmap(dst, decrypt ? size : out_size);
+    if(rtn == 0 && decrypt && ftruncate(fd_out, out_size) != 0) {
+        perror("sizing output");
+        rtn = -1;
+    }
+    if(out_path && close(fd_out) != 0) { perror("closing output"); rtn = -1; }
+    close(fd_in);
+    return rtn;
+}
@@ -0,0 +1,28 @@
+
+/*
+ * des_map.h
+ *
+ * Zero-copy file encryption through mmap
+ *
+ * Same format as des_stream (ECB + PKCS#5 padding), without read/write copies:
+ * the input is mapped read-only and the output file is mapped and written in
+ * place, or a single file is transformed inside one MAP_SHARED mapping.
+ */
+
+#ifndef DES_MAP_H
+#define DES_MAP_H
+
+#include "des.h"
+#include "des_pool.h"
+
+/*
+ * @param ctx Context from des_ctx_init
+ * @param pool Worker pool (page-aligned DES_POOL_CHUNK regions per task), or NULL
+ * @param in_path Input file
+ * @param out_path Output file, or NULL to transform in_path in place (also done when it is in_path)
+ * @param decrypt 0 to encrypt and pad, 1 to decrypt and strip the padding
+ * @return 0, or -1 after printing the reason to stderr
+ */
+int des_map_file(const des_ctx *ctx, des_pool *pool, const char *in_path, const char *out_path, int decrypt);
+
+#endif
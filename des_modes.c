@@ -0,0 +1,399 @@
+
+/*
+ * des_modes.c
+ *
+ * CBC, CFB, OFB and CTR modes
+ *
+ * Role of each functions:
+ *   cbcEncrypt(..), cfbEncrypt(..), ofbCrypt(..):
+ *     -> Serial modes, one block per ECB call.
+ *   cbcDecrypt(..), cfbDecrypt(..), ctrCrypt(..):
+ *     -> Every block depends only on known input, so DES_MODE_BATCH blocks at a
+ *        time go through one ECB call (bitsliced engine + NUM_PARALLEL loop).
+ *   des_*(..), des3_*(..):
+ *     -> The modes above with des_ecb_* or des3_ecb_* as the block cipher.
+ *   des_cbc_encrypt_multi(..):
+ *     -> Serial CBC of many streams, one block of each stream per ECB call.
+ *   des_pool_cbc_decrypt(..), des_pool_ctr_crypt(..):
+ *     -> The batched modes split into DES_POOL_CHUNK tasks.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "des_modes.h"
+#include "des_bs.h"
+
+// Blocks per ECB call in the batched modes (a whole number of bitsliced batches)
+#define DES_MODE_BATCH DES_BS_MAX_WIDTH
+
+/*
+ * ECB of one cipher (des_ctx or des3_ctx), so every mode below serves both
+ */
+typedef int (*ecb_fn)(const void *ctx, const char *in, char *out, int input_len);
+
+static int desEncrypt(const void *ctx, const char *in, char *out, int input_len) {
+    return des_ecb_encrypt(ctx, in, out, input_len);
+}
+
+static int desDecrypt(const void *ctx, const char *in, char *out, int input_len) {
+    return des_ecb_decrypt(ctx, in, out, input_len);
+}
+
+static int des3Encrypt(const void *ctx, const char *in, char *out, int input_len) {
+    return des3_ecb_encrypt(ctx, in, out, input_len);
+}
+
+static int des3Decrypt(const void *ctx, const char *in, char *out, int input_len) {
+    return des3_ecb_decrypt(ctx, in, out, input_len);
+}
+
+static inline long long unsigned getWord(const char *p) {
+    long long unsigned w;
+    memcpy(&w, p, 8);
+    return w;
+}
+
+static inline void putWord(char *p, long long unsigned w) {
+    memcpy(p, &w, 8);
+}
+
+/*
+ * 8-byte counter block as a big-endian number
+ */
+static long long unsigned getCounter(const char *iv) {
+    long long unsigned ctr = 0;
+    int j;
+
+    for(j = 0; j < 8; j++) {
+        ctr <<= 8;
+        ctr ^= iv[j] & 0xff;
+    }
+    return ctr;
+}
+
+static void putCounter(char *iv, long long unsigned ctr) {
+    int j;
+
+    for(j = 7; j >= 0; j--) {
+        iv[j] = ctr & 0xff;
+        ctr >>= 8;
+    }
+}
+
+/*
+ * Partial last block: out = in ^ E(block) for n < 8 bytes
+ */
+static void cryptTail(const void *ctx, ecb_fn enc, const char *in, char *out, int n, const char *block) {
+    char ks[8];
+    int j;
+
+    enc(ctx, block, ks, 8);
+    for(j = 0; j < n; j++) out[j] = in[j] ^ ks[j];
+}
+
+/*
+ * CBC encrypt in -> out
+ * @param ctx Context for enc
+ * @param enc ECB encryption of the cipher
+ * @param in Input plain text
+ * @param out Output cipher text
+ * @param input_len Length of in (multiple of 8)
+ * @param iv 8-byte IV, replaced by the last cipher block (input & output reference)
+ */
+static int cbcEncrypt(const void *ctx, ecb_fn enc, const char *in, char *out, int input_len, char *iv) {
+    char chain[8];
+    int count;
+
+    memcpy(chain, iv, 8);
+    for(count = 0; count + 8 <= input_len; count += 8) {
+        putWord(chain, getWord(chain) ^ getWord(in + count));
+        enc(ctx, chain, chain, 8);
+        memcpy(out + count, chain, 8);
+    }
+    memcpy(iv, chain, 8);
+    return 0;
+}
+
+/*
+ * CBC decrypt in -> out
+ * P[i] = D(C[i]) ^ C[i-1] needs no earlier output, so whole batches are decrypted
+ * at once. The XOR walks each batch backwards so that in == out works.
+ * @param ctx Context for dec
+ * @param dec ECB decryption of the cipher
+ * @param in Input cipher text
+ * @param out Output plain text
+ * @param input_len Length of in (multiple of 8)
+ * @param iv 8-byte IV, replaced by the last cipher block (input & output reference)
+ */
+static int cbcDecrypt(const void *ctx, ecb_fn dec, const char *in, char *out, int input_len, char *iv) {
+    char buf[8 * DES_MODE_BATCH];
+    char chain[8];
+    int count, num, i;
+
+    for(count = 0; count + 8 <= input_len; count += 8 * num) {
+        num = (input_len - count) / 8;
+        if(num > DES_MODE_BATCH) num = DES_MODE_BATCH;
+
+        dec(ctx, in + count, buf, 8 * num);
+        memcpy(chain, in + count + 8 * (num - 1), 8);
+        for(i = num - 1; i > 0; i--) {
+            putWord(out + count + 8 * i, getWord(buf + 8 * i) ^ getWord(in + count + 8 * (i - 1)));
+        }
+        putWord(out + count, getWord(buf) ^ getWord(iv));
+        memcpy(iv, chain, 8);
+    }
+    return 0;
+}
+
+/*
+ * CFB encrypt in -> out
+ * @param iv 8-byte IV, replaced by the last cipher block (input & output reference)
+ * Other parameters as for des_cbc_encrypt, input_len may end in a partial block.
+ */
+static int cfbEncrypt(const void *ctx, ecb_fn enc, const char *in, char *out, int input_len, char *iv) {
+    char chain[8];
+    int count;
+
+    memcpy(chain, iv, 8);
+    for(count = 0; count + 8 <= input_len; count += 8) {
+        enc(ctx, chain, chain, 8);
+        putWord(chain, getWord(chain) ^ getWord(in + count));
+        memcpy(out + count, chain, 8);
+    }
+    if(count < input_len) cryptTail(ctx, enc, in + count, out + count, input_len - count, chain);
+    memcpy(iv, chain, 8);
+    return 0;
+}
+
+/*
+ * CFB decrypt in -> out
+ * The key stream E(C[i-1]) comes from cipher text only, so it is made in batches.
+ * @param iv 8-byte IV, replaced by the last cipher block (input & output reference)
+ * Other parameters as for des_cbc_decrypt, input_len may end in a partial block.
+ */
+static int cfbDecrypt(const void *ctx, ecb_fn enc, const char *in, char *out, int input_len, char *iv) {
+    char buf[8 * DES_MODE_BATCH];
+    int count, num, i;
+
+    for(count = 0; count + 8 <= input_len; count += 8 * num) {
+        num = (input_len - count) / 8;
+        if(num > DES_MODE_BATCH) num = DES_MODE_BATCH;
+
+        memcpy(buf, iv, 8);
+        memcpy(buf + 8, in + count, 8 * (num - 1));
+        memcpy(iv, in + count + 8 * (num - 1), 8);
+        enc(ctx, buf, buf, 8 * num);
+        for(i = 0; i < num; i++) {
+            putWord(out + count + 8 * i, getWord(buf + 8 * i) ^ getWord(in + count + 8 * i));
+        }
+    }
+    if(count < input_len) cryptTail(ctx, enc, in + count, out + count, input_len - count, iv);
+    return 0;
+}
+
+/*
+ * OFB encrypt or decrypt in -> out
+ * @param iv 8-byte IV, replaced by the last key stream block (input & output reference)
+ * Other parameters as for des_cfb_encrypt.
+ */
+static int ofbCrypt(const void *ctx, ecb_fn enc, const char *in, char *out, int input_len, char *iv) {
+    char ks[8];
+    int count;
+
+    memcpy(ks, iv, 8);
+    for(count = 0; count + 8 <= input_len; count += 8) {
+        enc(ctx, ks, ks, 8);
+        putWord(out + count, getWord(ks) ^ getWord(in + count));
+    }
+    if(count < input_len) cryptTail(ctx, enc, in + count, out + count, input_len - count, ks);
+    memcpy(iv, ks, 8);
+    return 0;
+}
+
+/*
+ * CTR encrypt or decrypt in -> out
+ * Counter blocks are written DES_MODE_BATCH at a time and encrypted in one ECB call.
+ * @param iv 8-byte initial counter block, advanced by one per block used (input & output reference)
+ * Other parameters as for des_cfb_encrypt.
+ */
+static int ctrCrypt(const void *ctx, ecb_fn enc, const char *in, char *out, int input_len, char *iv) {
+    char buf[8 * DES_MODE_BATCH];
+    long long unsigned ctr;
+    int count, num, full, i;
+
+    ctr = getCounter(iv);
+    for(count = 0; count < input_len; count += 8 * num) {
+        num = (input_len - count + 7) / 8;
+        if(num > DES_MODE_BATCH) num = DES_MODE_BATCH;
+
+        for(i = 0; i < num; i++) {
+            putCounter(buf + 8 * i, ctr++);
+        }
+        enc(ctx, buf, buf, 8 * num);
+        full = (input_len - count) / 8;
+        if(full > num) full = num;
+        for(i = 0; i < full; i++) {
+            putWord(out + count + 8 * i, getWord(buf + 8 * i) ^ getWord(in + count + 8 * i));
+        }
+        // Partial last block
+        for(i = 8 * full; i < 8 * num && count + i < input_len; i++) {
+            out[count + i] = in[count + i] ^ buf[i];
+        }
+    }
+    putCounter(iv, ctr);
+    return 0;
+}
+
+int des_cbc_encrypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv) {
+    return cbcEncrypt(ctx, desEncrypt, in, out, input_len, iv);
+}
+
+int des_cbc_decrypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv) {
+    return cbcDecrypt(ctx, desDecrypt, in, out, input_len, iv);
+}
+
+int des_cfb_encrypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv) {
+    return cfbEncrypt(ctx, desEncrypt, in, out, input_len, iv);
+}
+
+int des_cfb_decrypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv) {
+    return cfbDecrypt(ctx, desEncrypt, in, out, input_len, iv);
+}
+
+int des_ofb_crypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv) {
+    return ofbCrypt(ctx, desEncrypt, in, out, input_len, iv);
+}
+
+int des_ctr_crypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv) {
+    return ctrCrypt(ctx, desEncrypt, in, out, input_len, iv);
+}
+
+int des3_cbc_encrypt(const des3_ctx *ctx, const char *in, char *out, int input_len, char *iv) {
+    return cbcEncrypt(ctx, des3Encrypt, in, out, input_len, iv);
+}
+
+int des3_cbc_decrypt(const des3_ctx *ctx, const char *in, char *out, int input_len, char *iv) {
+    return cbcDecrypt(ctx, des3Decrypt, in, out, input_len, iv);
+}
+
+int des3_ctr_crypt(const des3_ctx *ctx, const char *in, char *out, int input_len, char *iv) {
+    return ctrCrypt(ctx, des3Encrypt, in, out, input_len, iv);
+}
+
+/*
+ * CBC encrypt several streams with one key
+ * Step k takes block k of every stream that still has one, so up to
+ * DES_MODE_BATCH chains advance per ECB call.
+ */
+int des_cbc_encrypt_multi(const des_ctx *ctx, int num_streams, const char **in, char **out, char **iv, const int *input_len) {
+    char buf[8 * DES_MODE_BATCH];
+    int active[DES_MODE_BATCH];
+    int first, last, count, num, s, i;
+
+    for(first = 0; first < num_streams; first += DES_MODE_BATCH) {
+        last = first + DES_MODE_BATCH;
+        if(last > num_streams) last = num_streams;
+
+        for(count = 0; ; count += 8) {
+            // (1/3) Gather block 'count' of every stream, XORed with its chain
+            num = 0;
+            for(s = first; s < last; s++) {
+                if(count + 8 > input_len[s]) continue;
+                putWord(buf + 8 * num, getWord(iv[s]) ^ getWord(in[s] + count));
+                active[num++] = s;
+            }
+            if(num == 0) break;
+
+            // (2/3) One ECB call for all of them
+            des_ecb_encrypt(ctx, buf, buf, 8 * num);
+
+            // (3/3) Scatter, the cipher block is the next chain value
+            for(i = 0; i < num; i++) {
+                memcpy(out[active[i]] + count, buf + 8 * i, 8);
+                memcpy(iv[active[i]], buf + 8 * i, 8);
+            }
+        }
+    }
+    return 0;
+}
+
+struct mode_job {
+    const des_ctx *ctx;
+    const char *in;
+    char *out;
+    long input_len;
+    char *ivs; // 8 bytes per task
+};
+
+static void cbcTask(void *arg, long index, int worker) {
+    struct mode_job *job = arg;
+    long offset = index * DES_POOL_CHUNK;
+    long len = job->input_len - offset;
+
+    if(len > DES_POOL_CHUNK) len = DES_POOL_CHUNK;
+    des_cbc_decrypt(job->ctx, job->in + offset, job->out + offset, (int)len, job->ivs + 8 * index);
+}
+
+static void ctrTask(void *arg, long index, int worker) {
+    struct mode_job *job = arg;
+    long offset = index * DES_POOL_CHUNK;
+    long len = job->input_len - offset;
+    char iv[8];
+
+    if(len > DES_POOL_CHUNK) len = DES_POOL_CHUNK;
+    putCounter(iv, getCounter(job->ivs) + offset / 8);
+    des_ctr_crypt(job->ctx, job->in + offset, job->out + offset, (int)len, iv);
+}
+
+/*
+ * CBC decrypt in -> out over the pool
+ * Each chunk is chained from the last cipher block of the chunk before it, saved
+ * up front so that in == out works.
+ * @param pool Worker pool
+ * Other parameters as for des_cbc_decrypt.
+ * @return 0, or -1 if memory runs out
+ */
+int des_pool_cbc_decrypt(des_pool *pool, const des_ctx *ctx, const char *in, char *out, long input_len, char *iv) {
+    struct mode_job job;
+    long num_tasks, t;
+
+    input_len -= input_len % 8;
+    if(input_len == 0) return 0;
+    num_tasks = (input_len + DES_POOL_CHUNK - 1) / DES_POOL_CHUNK;
+    job.ivs = malloc(8 * num_tasks);
+    if(!job.ivs) return -1;
+    memcpy(job.ivs, iv, 8);
+    for(t = 1; t < num_tasks; t++) {
+        memcpy(job.ivs + 8 * t, in + t * DES_POOL_CHUNK - 8, 8);
+    }
+    memcpy(iv, in + input_len - 8, 8);
+
+    job.ctx = ctx;
+    job.in = in;
+    job.out = out;
+    job.input_len = input_len;
+    des_pool_run(pool, cbcTask, &job, num_tasks);
+    free(job.ivs);
+    return 0;
+}
+
+/*
+ * CTR encrypt or decrypt in -> out over the pool
+ * Chunk i starts at counter + i * DES_POOL_CHUNK / 8.
+ * @param pool Worker pool
+ * Other parameters as for des_ctr_crypt.
+ */
+int des_pool_ctr_crypt(des_pool *pool, const des_ctx *ctx, const char *in, char *out, long input_len, char *iv) {
+    struct mode_job job;
+
+    job.ctx = ctx;
+    job.in = in;
+    job.out = out;
+    job.input_len = input_len;
+    job.ivs = iv;
+    des_pool_run(pool, ctrTask, &job, (input_len + DES_POOL_CHUNK - 1) / DES_POOL_CHUNK);
+    putCounter(iv, getCounter(iv) + (input_len + 7) / 8);
+    return 0;
+}
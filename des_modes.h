@@ -0,0 +1,55 @@
+
+/*
+ * des_modes.h
+ *
+ * Chaining modes on top of des_ecb_encrypt/des_ecb_decrypt
+ *
+ * Usage:
+ *   char iv[8] = {..};
+ *   des_cbc_encrypt(&ctx, in, out, len, iv);   // iv now holds the chaining value
+ *   des_cbc_encrypt(&ctx, in2, out2, len2, iv); // ... so the next call continues
+ * All modes work on bytes: blocks are XORed byte by byte with the IV / key stream,
+ * and the CTR counter is the 8-byte IV read as a big-endian number.
+ * CBC lengths are multiples of 8. CFB, OFB and CTR take any length, but only the
+ * last call of a message may end in a partial block.
+ * in and out may be the same buffer.
+ */
+
+#ifndef DES_MODES_H
+#define DES_MODES_H
+
+#include "des.h"
+#include "des_pool.h"
+
+// CBC: encryption is serial, decryption runs batches through ECB
+int des_cbc_encrypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv);
+int des_cbc_decrypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv);
+
+// CFB (64-bit feedback): encryption is serial, decryption runs batches through ECB
+int des_cfb_encrypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv);
+int des_cfb_decrypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv);
+
+// OFB and CTR: the same call encrypts and decrypts
+int des_ofb_crypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv);
+int des_ctr_crypt(const des_ctx *ctx, const char *in, char *out, int input_len, char *iv);
+
+// Triple-DES (des3_ctx from des3_ctx_init)
+int des3_cbc_encrypt(const des3_ctx *ctx, const char *in, char *out, int input_len, char *iv);
+int des3_cbc_decrypt(const des3_ctx *ctx, const char *in, char *out, int input_len, char *iv);
+int des3_ctr_crypt(const des3_ctx *ctx, const char *in, char *out, int input_len, char *iv);
+
+/*
+ * CBC encryption of independent streams, interleaved so every step runs one
+ * block of each stream through ECB together
+ * @param ctx Context from des_ctx_init (shared by all streams)
+ * @param num_streams Number of streams
+ * @param in, out, iv Per-stream buffers as for des_cbc_encrypt
+ * @param input_len Per-stream lengths (multiples of 8, may differ)
+ */
+int des_cbc_encrypt_multi(const des_ctx *ctx, int num_streams, const char **in, char **out, char **iv, const int *input_len);
+
+// The parallel modes over the pool, one task per DES_POOL_CHUNK (same bytes as above)
+int des_pool_cbc_decrypt(des_pool *pool, const des_ctx *ctx, const char *in, char *out, long input_len, char *iv);
+int des_pool_ctr_crypt(des_pool *pool, const des_ctx *ctx, const char *in, char *out, long input_len, char *iv);
+
+#endif
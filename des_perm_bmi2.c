@@ -0,0 +1,38 @@
+
+/*
+ * des_perm_bmi2.c
+ *
+ * IP and FP with BMI2 PEXT/PDEP, for CPUs where des_kernel_bmi2() is set
+ * Same results as getIP/getFP in des.c (masks from des_gen -p).
+ */
+
+#include <immintrin.h>
+
+#include "des_bs.h"
+#include "des_perm_gen.h"
+
+/*
+ * Output byte r is pext(bswap(in), table_IPpext[r])
+ */
+void des_ip_bmi2(long long unsigned *out, long long unsigned in) {
+    long long unsigned w = __builtin_bswap64(in);
+    int r;
+
+    *out = 0;
+    for(r = 0; r < 8; r++) {
+        *out |= (long long unsigned)_pext_u64(w, table_IPpext[r]) << (8*r);
+    }
+}
+
+/*
+ * Inverse of des_ip_bmi2: every byte goes back with pdep, then one bswap
+ */
+void des_fp_bmi2(long long unsigned *out, long long unsigned in) {
+    long long unsigned w = 0;
+    int r;
+
+    for(r = 0; r < 8; r++) {
+        w |= _pdep_u64((in >> (8*r)) & 0xff, table_IPpext[r]);
+    }
+    *out = __builtin_bswap64(w);
+}
@@ -0,0 +1,269 @@
+
+/*
+ * des_pool.c
+ *
+ * Persistent worker pool for bulk DES
+ *
+ * Role of each functions:
+ *   des_pool_create(..):
+ *     -> Starts the workers, each pinned to one CPU of the process affinity mask.
+ *   des_pool_run(..):
+ *     -> Runs task 0..num_tasks-1 over the workers and waits for all of them.
+ *   des_pool_ecb_encrypt(..), des_pool_ecb_decrypt(..):
+ *     -> ECB with one task per DES_POOL_CHUNK bytes.
+ * Queues:
+ *   Each worker owns a range [head, tail) of task indices. It takes tasks from
+ *   head; an idle worker steals from the tail of the next non-empty range.
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "des_pool.h"
+#include "des_stats.h"
+
+struct des_queue {
+    pthread_mutex_t lock;
+    long head, tail;
+};
+
+struct des_worker {
+    des_pool *pool;
+    int index;
+    int cpu;
+};
+
+struct des_pool {
+    int num_threads;
+    pthread_t *threads;
+    struct des_worker *workers;
+    struct des_queue *queues;
+
+    // Current job, published under lock
+    pthread_mutex_t lock;
+    pthread_cond_t start, done;
+    long generation;
+    int running;
+    int stop;
+    des_pool_task task;
+    void *arg;
+};
+
+static long takeTask(struct des_queue *q, int steal) {
+    long index = -1;
+
+    pthread_mutex_lock(&q->lock);
+    if(q->head < q->tail) {
+        index = steal ? --q->tail : q->head++;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return index;
+}
+
+static void *workerMain(void *p) {
+    struct des_worker *w = p;
+    des_pool *pool = w->pool;
+    long seen = 0, index;
+    int i;
+
+#ifdef __linux__
+    cpu_set_t set;
+    if(w->cpu >= 0) {
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    }
+#endif
+
+    for(;;) {
+        pthread_mutex_lock(&pool->lock);
+        while(!pool->stop && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+        if(pool->stop) break;
+
+        // Own range first, then steal from the others
+        while((index = takeTask(&pool->queues[w->index], 0)) >= 0) {
+            pool->task(pool->arg, index, w->index);
+        }
+        for(i = 1; i < pool->num_threads; i++) {
+            struct des_queue *victim = &pool->queues[(w->index + i) % pool->num_threads];
+            while((index = takeTask(victim, 1)) >= 0) {
+                pool->task(pool->arg, index, w->index);
+            }
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        if(--pool->running == 0) pthread_cond_signal(&pool->done);
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Start a pool
+ * @param num_threads Number of workers (at least 1)
+ * @return pool, or NULL on failure
+ */
+des_pool *des_pool_create(int num_threads) {
+    des_pool *pool;
+    int cpus[CPU_SETSIZE];
+    int num_cpus = 0;
+    int i;
+
+    if(num_threads < 1) num_threads = 1;
+    pool = calloc(1, sizeof(*pool));
+    if(!pool) return NULL;
+    pool->num_threads = num_threads;
+    pool->threads = calloc(num_threads, sizeof(*pool->threads));
+    pool->workers = calloc(num_threads, sizeof(*pool->workers));
+    pool->queues = calloc(num_threads, sizeof(*pool->queues));
+    if(!pool->threads || !pool->workers || !pool->queues) {
+        free(pool->threads); free(pool->workers); free(pool->queues); free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    // CPUs we may run on, in order
+#ifdef __linux__
+    cpu_set_t set;
+    if(sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for(i = 0; i < CPU_SETSIZE; i++) {
+            if(CPU_ISSET(i, &set)) cpus[num_cpus++] = i;
+        }
+    }
+#endif
+
+    for(i = 0; i < num_threads; i++) {
+        pthread_mutex_init(&pool->queues[i].lock, NULL);
+        pool->workers[i].pool = pool;
+        pool->workers[i].index = i;
+        pool->workers[i].cpu = num_cpus > 0 ? cpus[i % num_cpus] : -1;
+        if(pthread_create(&pool->threads[i], NULL, workerMain, &pool->workers[i]) != 0) {
+            pool->num_threads = i;
+            des_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+int des_pool_size(const des_pool *pool) {
+    return pool->num_threads;
+}
+
+/*
+ * Run task(arg, i, worker) for i = 0 .. num_tasks-1 and wait for all of them
+ * Worker w starts with the w-th contiguous share of the indices.
+ */
+void des_pool_run(des_pool *pool, des_pool_task task, void *arg, long num_tasks) {
+    int i;
+    DES_STAT_DECL;
+
+    if(num_tasks <= 0) return;
+    for(i = 0; i < pool->num_threads; i++) {
+        pthread_mutex_lock(&pool->queues[i].lock);
+        pool->queues[i].head = num_tasks * i / pool->num_threads;
+        pool->queues[i].tail = num_tasks * (i + 1) / pool->num_threads;
+        pthread_mutex_unlock(&pool->queues[i].lock);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->task = task;
+    pool->arg = arg;
+    pool->running = pool->num_threads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    DES_STAT_START();
+    while(pool->running > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    DES_STAT_LAP(DES_STAGE_STALL);
+}
+
+/*
+ * Stop the workers and free the pool
+ */
+void des_pool_destroy(des_pool *pool) {
+    int i;
+
+    if(!pool) return;
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+    for(i = 0; i < pool->num_threads; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+    free(pool->threads);
+    free(pool->workers);
+    free(pool->queues);
+    free(pool);
+}
+
+struct ecb_job {
+    const des_ctx *ctx;
+    const char *in;
+    char *out;
+    long input_len;
+    int decrypt;
+};
+
+static void ecbTask(void *arg, long index, int worker) {
+    struct ecb_job *job = arg;
+    long offset = index * DES_POOL_CHUNK;
+    long len = job->input_len - offset;
+
+    if(len > DES_POOL_CHUNK) len = DES_POOL_CHUNK;
+    if(job->decrypt) {
+        des_ecb_decrypt(job->ctx, job->in + offset, job->out + offset, (int)len);
+    } else {
+        des_ecb_encrypt(job->ctx, job->in + offset, job->out + offset, (int)len);
+    }
+}
+
+static int ecbPool(des_pool *pool, const des_ctx *ctx, const char *in, char *out, long input_len, int decrypt) {
+    struct ecb_job job;
+
+    job.ctx = ctx;
+    job.in = in;
+    job.out = out;
+    job.input_len = input_len;
+    job.decrypt = decrypt;
+    des_pool_run(pool, ecbTask, &job, (input_len + DES_POOL_CHUNK - 1) / DES_POOL_CHUNK);
+    return 0;
+}
+
+/*
+ * ECB encrypt in -> out over the pool
+ * @param pool Worker pool
+ * @param ctx Context from des_ctx_init
+ * @param in Input plain text
+ * @param out Output cipher text
+ * @param input_len Length of in
+ */
+int des_pool_ecb_encrypt(des_pool *pool, const des_ctx *ctx, const char *in, char *out, long input_len) {
+    return ecbPool(pool, ctx, in, out, input_len, 0);
+}
+
+/*
+ * ECB decrypt in -> out over the pool
+ * @param pool Worker pool
+ * @param ctx Context from des_ctx_init
+ * @param in Input cipher text
+ * @param out Output plain text
+ * @param input_len Length of in
+ */
+int des_pool_ecb_decrypt(des_pool *pool, const des_ctx *ctx, const char *in, char *out, long input_len) {
+    return ecbPool(pool, ctx, in, out, input_len, 1);
+}
@@ -0,0 +1,43 @@
+
+/*
+ * des_pool.h
+ *
+ * Persistent worker pool for bulk DES
+ *
+ * Usage:
+ *   des_pool *pool = des_pool_create(n);
+ *   des_pool_ecb_encrypt(pool, &ctx, in, out, len);   // any number of times
+ *   des_pool_destroy(pool);
+ * Work is cut into DES_POOL_CHUNK-byte chunks. Every worker starts on its own
+ * contiguous share of the chunks and steals from the back of the others' when
+ * it runs out, so chunk i lands on the same pinned worker run after run.
+ */
+
+#ifndef DES_POOL_H
+#define DES_POOL_H
+
+#include "des.h"
+
+// Chunk size: fits in L2 with its output, multiple of every bitsliced batch
+#define DES_POOL_CHUNK (256 * 1024)
+
+typedef struct des_pool des_pool;
+
+/*
+ * One task of des_pool_run
+ * @param arg Argument given to des_pool_run
+ * @param index Task index (0 .. num_tasks - 1)
+ * @param worker Index of the worker running it
+ */
+typedef void (*des_pool_task)(void *arg, long index, int worker);
+
+des_pool *des_pool_create(int num_threads);
+int des_pool_size(const des_pool *pool);
+void des_pool_run(des_pool *pool, des_pool_task task, void *arg, long num_tasks);
+void des_pool_destroy(des_pool *pool);
+
+// ECB over the pool, one task per chunk (input_len as for des_ecb_encrypt)
+int des_pool_ecb_encrypt(des_pool *pool, const des_ctx *ctx, const char *in, char *out, long input_len);
+int des_pool_ecb_decrypt(des_pool *pool, const des_ctx *ctx, const char *in, char *out, long input_len);
+
+#endif
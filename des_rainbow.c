@@ -0,0 +1,425 @@
+
+/*
+ * des_rainbow.c
+ *
+ * Rainbow table generation and lookup over the worker pool (see des_rainbow.h)
+ *
+ * Role of each functions:
+ *   des_rainbow_build(..):
+ *     -> Chains on the pool, then sort, merged chains dropped, endpoint index
+ *        and file written through a temporary name.
+ *   buildTask(..):
+ *     -> DES_RAINBOW_TASK chains, des_bs_width() chains per kernel pass: every
+ *        lane has its own key and the same plain text.
+ *   des_rainbow_lookup(..), lookupTask(..):
+ *     -> One candidate chain per chain position; task i takes the positions
+ *        i, i + num_tasks, .. from the cheap end (positions near the endpoint
+ *        need few encryptions), a lane whose chain is done takes the next one.
+ *   checkEnd(..):
+ *     -> Endpoint lookup, then the matching chains are walked from their start
+ *        key to the position to tell the key from a false alarm.
+ *   startKey(..), reduce(..):
+ *     -> Start key of a chain number and reduction of step j.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "des.h"
+#include "des_bs.h"
+#include "des_rainbow.h"
+#include "des_search.h"
+#include "des_block.h"
+
+#define KEY_MASK (DES_SEARCH_SPACE - 1)
+
+// Lookup tasks per worker, so that uneven chains even out
+#define LOOKUP_TASKS_PER_WORKER 4
+
+struct des_rainbow {
+    void *map;
+    size_t size;
+    const des_rainbow_hdr *hdr;
+    const uint32_t *index;
+    const des_rainbow_entry *entries;
+    long long unsigned plain; // loaded block
+};
+
+struct chain {
+    long long unsigned end;
+    long long unsigned start;
+};
+
+struct build {
+    long long unsigned plain, salt, num_chains;
+    int width, chain_len;
+    struct chain *chains;
+};
+
+struct lookup {
+    const des_rainbow *rt;
+    long long unsigned cipher, salt;
+    int width, chain_len, num_tasks;
+    volatile int found;
+    long long unsigned key;
+    pthread_mutex_t lock;
+    long long unsigned *encryptions, *false_alarms; // per worker
+};
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static long long unsigned tableSalt(int table) {
+    return (long long unsigned)table * 0x9e3779b97f4a7c15ull;
+}
+
+/*
+ * Odd multiplier: distinct chain numbers get distinct, spread out start keys
+ */
+static inline long long unsigned startKey(long long unsigned n, long long unsigned salt) {
+    return (n * 0x5851f42d4c957f2dull + salt) & KEY_MASK;
+}
+
+static inline long long unsigned reduce(long long unsigned cipher, int j, long long unsigned salt) {
+    return (cipher ^ salt ^ (long long unsigned)j * 0xd6e8feb86659fd93ull) & KEY_MASK;
+}
+
+/*
+ * Cipher text word of plain under one key index, through the SP path
+ */
+static long long unsigned encryptOne(long long unsigned plain, long long unsigned key_index) {
+    char key[8], block[8];
+    des_ctx ctx;
+    int j;
+
+    // Key bytes 1..7 big-endian, byte 0 left 00; the block as des_ecb_encrypt loads it
+    for(j = 7; j >= 0; j--) {
+        key[j] = key_index & 0xff;
+        key_index >>= 8;
+        block[j] = plain & 0xff;
+        plain >>= 8;
+    }
+    des_ctx_init(&ctx, key);
+    des_ecb_encrypt(&ctx, block, block, 8);
+    return des_load_block(block, 0);
+}
+
+static void buildTask(void *arg, long index, int worker) {
+    struct build *b = arg;
+    long long unsigned blocks[DES_BS_MAX_WIDTH], keys[DES_BS_MAX_WIDTH];
+    long long unsigned first, last, base;
+    int n, l, j;
+    (void)worker;
+
+    first = (long long unsigned)index * DES_RAINBOW_TASK;
+    last = first + DES_RAINBOW_TASK < b->num_chains ? first + DES_RAINBOW_TASK : b->num_chains;
+
+    for(base = first; base < last; base += b->width) {
+        n = last - base < (long long unsigned)b->width ? (int)(last - base) : b->width;
+        for(l = 0; l < b->width; l++) keys[l] = startKey(l < n ? base + l : 0, b->salt);
+        for(j = 0; j < b->chain_len; j++) {
+            // A key index is its key word: byte 0 (the top byte) is 00
+            for(l = 0; l < b->width; l++) blocks[l] = b->plain;
+            des_bs_crypt_keys(blocks, keys, 0);
+            for(l = 0; l < b->width; l++) keys[l] = reduce(blocks[l], j, b->salt);
+        }
+        for(l = 0; l < n; l++) {
+            b->chains[base + l].end = keys[l];
+            b->chains[base + l].start = base + l;
+        }
+    }
+}
+
+static int compareChain(const void *a, const void *b) {
+    const struct chain *x = a, *y = b;
+
+    if(x->end != y->end) return x->end < y->end ? -1 : 1;
+    return (x->start > y->start) - (x->start < y->start);
+}
+
+/*
+ * Sorted, deduplicated chains -> table file
+ */
+static int writeTable(const char *path, des_rainbow_hdr *hdr, const struct chain *chains, long long unsigned n) {
+    long long unsigned i, num_buckets = 1ull << hdr->index_bits;
+    uint32_t *index;
+    des_rainbow_entry e;
+    char tmp[4096];
+    FILE *f;
+    long long unsigned b;
+    int shift = 56 - hdr->index_bits, fail = 0;
+
+    index = malloc((num_buckets + 1) * sizeof(*index));
+    if(!index) { fputs("mem allocation fails\n", stderr); return -1; }
+    for(i = 0, b = 0; b <= num_buckets; b++) {
+        while(i < n && (chains[i].end >> shift) < b) i++;
+        index[b] = (uint32_t)i;
+    }
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "wb");
+    if(!f) { perror(tmp); free(index); return -1; }
+    fail |= fwrite(hdr, sizeof(*hdr), 1, f) != 1;
+    fail |= fwrite(index, sizeof(*index), num_buckets + 1, f) != num_buckets + 1;
+    for(i = 0; i < n && !fail; i++) {
+        e.start = (uint32_t)chains[i].start;
+        e.end = (uint32_t)(chains[i].end >> (24 - hdr->index_bits));
+        fail |= fwrite(&e, sizeof(e), 1, f) != 1;
+    }
+    free(index);
+    if(fclose(f) != 0) fail = 1;
+    if(fail || rename(tmp, path) != 0) {
+        perror("writing table");
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Build a table of num_chains chains of chain_len keys
+ */
+int des_rainbow_build(des_pool *pool, const char *path, const char *plain,
+                      int chain_len, long long unsigned num_chains, int table) {
+    struct build b;
+    des_rainbow_hdr hdr;
+    long long unsigned i, n;
+    double t0, t1, t2;
+    long size;
+
+    b.width = des_bs_width();
+    if(b.width == 0) { fputs("rainbow tables need the bitsliced engine\n", stderr); return -1; }
+    if(chain_len < 1 || num_chains < 1 || num_chains > UINT32_MAX || table < 0) {
+        fputs("chain length and number of chains must be positive (at most 2^32 - 1 chains)\n", stderr);
+        return -1;
+    }
+    b.plain = des_load_block(plain, 1);
+    b.salt = tableSalt(table);
+    b.chain_len = chain_len;
+    b.num_chains = num_chains;
+    b.chains = malloc(num_chains * sizeof(*b.chains));
+    if(!b.chains) { fputs("mem allocation fails\n", stderr); return -1; }
+
+    // (1/3) Chains
+    t0 = seconds();
+    des_pool_run(pool, buildTask, &b, (long)((num_chains + DES_RAINBOW_TASK - 1) / DES_RAINBOW_TASK));
+    t1 = seconds();
+
+    // (2/3) Sort by endpoint, keep one chain per endpoint
+    qsort(b.chains, num_chains, sizeof(*b.chains), compareChain);
+    for(i = n = 0; i < num_chains; i++) {
+        if(n > 0 && b.chains[n - 1].end == b.chains[i].end) continue;
+        b.chains[n++] = b.chains[i];
+    }
+
+    // (3/3) About 4 entries per bucket
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, DES_RAINBOW_MAGIC, 8);
+    memcpy(hdr.plain, plain, 8);
+    hdr.num_chains = n;
+    hdr.built_chains = num_chains;
+    hdr.chain_len = chain_len;
+    hdr.table = table;
+    for(hdr.index_bits = 0; hdr.index_bits < 24 && (4ull << hdr.index_bits) < n; hdr.index_bits++);
+    if(writeTable(path, &hdr, b.chains, n) != 0) {
+        free(b.chains);
+        return -1;
+    }
+    t2 = seconds();
+    free(b.chains);
+
+    size = (long)sizeof(hdr) + 4 * ((1L << hdr.index_bits) + 1) + (long)(n * sizeof(des_rainbow_entry));
+    fprintf(stderr, "%llu chains x %d in %.2f s (%.2f Mkeys/s), sorted and written in %.2f s\n",
+            num_chains, chain_len, t1 - t0, (double)num_chains * chain_len / (t1 - t0) / 1e6, t2 - t1);
+    fprintf(stderr, "%llu distinct endpoints, %ld bytes (%.2f per chain), up to %.3g keys (%.2g%% of the key space)\n",
+            n, size, (double)size / n, (double)n * chain_len, 100.0 * n * chain_len / DES_SEARCH_SPACE);
+    return 0;
+}
+
+des_rainbow *des_rainbow_open(const char *path) {
+    des_rainbow *rt;
+    struct stat st;
+    size_t want;
+    int fd;
+
+    rt = calloc(1, sizeof(*rt));
+    if(!rt) { fputs("mem allocation fails\n", stderr); return NULL; }
+    fd = open(path, O_RDONLY);
+    if(fd < 0 || fstat(fd, &st) != 0) {
+        perror(path);
+        if(fd >= 0) close(fd);
+        free(rt);
+        return NULL;
+    }
+    rt->size = st.st_size;
+    rt->map = rt->size >= sizeof(des_rainbow_hdr) ? mmap(NULL, rt->size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    close(fd);
+    if(rt->map == MAP_FAILED) {
+        fprintf(stderr, "%s: not a rainbow table\n", path);
+        free(rt);
+        return NULL;
+    }
+
+    rt->hdr = rt->map;
+    want = 0;
+    if(memcmp(rt->hdr->magic, DES_RAINBOW_MAGIC, 8) == 0 && rt->hdr->index_bits <= 24) {
+        want = sizeof(des_rainbow_hdr) + 4 * (((size_t)1 << rt->hdr->index_bits) + 1)
+             + rt->hdr->num_chains * sizeof(des_rainbow_entry);
+    }
+    if(want == 0 || want != rt->size || rt->hdr->chain_len < 1) {
+        fprintf(stderr, "%s: not a rainbow table (or truncated)\n", path);
+        munmap(rt->map, rt->size);
+        free(rt);
+        return NULL;
+    }
+    rt->index = (const uint32_t *)(rt->hdr + 1);
+    rt->entries = (const des_rainbow_entry *)(rt->index + ((size_t)1 << rt->hdr->index_bits) + 1);
+    rt->plain = des_load_block(rt->hdr->plain, 1);
+    madvise(rt->map, rt->size, MADV_RANDOM);
+    return rt;
+}
+
+void des_rainbow_close(des_rainbow *rt) {
+    if(!rt) return;
+    munmap(rt->map, rt->size);
+    free(rt);
+}
+
+const des_rainbow_hdr *des_rainbow_header(const des_rainbow *rt) {
+    return rt->hdr;
+}
+
+/*
+ * Candidate endpoint of position p: look it up, and walk every matching chain
+ */
+static void checkEnd(struct lookup *s, long long unsigned end, int p, int worker) {
+    const des_rainbow *rt = s->rt;
+    int bits = rt->hdr->index_bits;
+    long long unsigned bucket = end >> (56 - bits);
+    uint32_t fp = (uint32_t)(end >> (24 - bits));
+    uint32_t lo = rt->index[bucket], hi = rt->index[bucket + 1], mid;
+    long long unsigned key;
+    int j;
+
+    // First entry of the bucket with this fingerprint
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(rt->entries[mid].end < fp) lo = mid + 1;
+        else hi = mid;
+    }
+    for(; lo < rt->index[bucket + 1] && rt->entries[lo].end == fp && !s->found; lo++) {
+        key = startKey(rt->entries[lo].start, s->salt);
+        for(j = 0; j < p; j++) key = reduce(encryptOne(rt->plain, key), j, s->salt);
+        s->encryptions[worker] += p + 1;
+        if(encryptOne(rt->plain, key) != s->cipher) {
+            s->false_alarms[worker]++;
+            continue;
+        }
+        pthread_mutex_lock(&s->lock);
+        if(!s->found) {
+            s->key = key;
+            s->found = 1;
+        }
+        pthread_mutex_unlock(&s->lock);
+    }
+}
+
+static void lookupTask(void *arg, long index, int worker) {
+    struct lookup *s = arg;
+    long long unsigned blocks[DES_BS_MAX_WIDTH], keys[DES_BS_MAX_WIDTH];
+    int pos[DES_BS_MAX_WIDTH], step[DES_BS_MAX_WIDTH];
+    int next = (int)index, active, l, p;
+
+    for(l = 0; l < s->width; l++) pos[l] = -1;
+    while(!s->found) {
+        // (1/3) Idle lanes take the next position, counted from the endpoint
+        active = 0;
+        for(l = 0; l < s->width; l++) {
+            while(pos[l] < 0 && next < s->chain_len && !s->found) {
+                p = s->chain_len - 1 - next;
+                next += s->num_tasks;
+                keys[l] = reduce(s->cipher, p, s->salt);
+                if(p + 1 == s->chain_len) {
+                    checkEnd(s, keys[l], p, worker);
+                    continue;
+                }
+                pos[l] = p;
+                step[l] = p + 1;
+            }
+            if(pos[l] < 0) keys[l] = 0;
+            else active++;
+        }
+        if(active == 0) break;
+
+        // (2/3) One step of every candidate chain
+        for(l = 0; l < s->width; l++) blocks[l] = s->rt->plain;
+        des_bs_crypt_keys(blocks, keys, 0);
+        s->encryptions[worker] += active;
+
+        // (3/3) Chains that reached their endpoint are looked up
+        for(l = 0; l < s->width; l++) {
+            if(pos[l] < 0) continue;
+            keys[l] = reduce(blocks[l], step[l], s->salt);
+            if(++step[l] < s->chain_len) continue;
+            checkEnd(s, keys[l], pos[l], worker);
+            pos[l] = -1;
+        }
+    }
+}
+
+/*
+ * Look cipher up in every position of the table's chains
+ */
+int des_rainbow_lookup(const des_rainbow *rt, des_pool *pool, const char *cipher,
+                       long long unsigned *key_index, des_rainbow_stats *stats) {
+    struct lookup s;
+    int num_threads, i;
+    double t0;
+
+    memset(&s, 0, sizeof(s));
+    s.width = des_bs_width();
+    if(s.width == 0) { fputs("rainbow tables need the bitsliced engine\n", stderr); return -1; }
+    s.rt = rt;
+    s.cipher = des_load_block(cipher, 0);
+    s.salt = tableSalt(rt->hdr->table);
+    s.chain_len = rt->hdr->chain_len;
+    num_threads = des_pool_size(pool);
+    s.num_tasks = num_threads * LOOKUP_TASKS_PER_WORKER;
+    if(s.num_tasks > s.chain_len) s.num_tasks = s.chain_len;
+    s.encryptions = calloc(num_threads, sizeof(*s.encryptions));
+    s.false_alarms = calloc(num_threads, sizeof(*s.false_alarms));
+    if(!s.encryptions || !s.false_alarms) {
+        free(s.encryptions);
+        free(s.false_alarms);
+        fputs("mem allocation fails\n", stderr);
+        return -1;
+    }
+    pthread_mutex_init(&s.lock, NULL);
+
+    t0 = seconds();
+    des_pool_run(pool, lookupTask, &s, s.num_tasks);
+    if(stats) {
+        memset(stats, 0, sizeof(*stats));
+        stats->seconds = seconds() - t0;
+        for(i = 0; i < num_threads; i++) {
+            stats->encryptions += s.encryptions[i];
+            stats->false_alarms += s.false_alarms[i];
+        }
+    }
+    if(s.found) *key_index = s.key;
+
+    pthread_mutex_destroy(&s.lock);
+    free(s.encryptions);
+    free(s.false_alarms);
+    return s.found;
+}
@@ -0,0 +1,89 @@
+
+/*
+ * des_rainbow.h
+ *
+ * Rainbow tables (time-memory tradeoff) for one chosen plain text
+ *
+ * Chains:
+ *   k_0 = start key of chain n, k_j+1 = R_j(E_k_j(plain)), endpoint = k_chain_len
+ *   Keys are key indices as in des_search.h (key bytes 1..7). R_j keeps the low
+ *   56 bits of the cipher text word after mixing in the table number and the
+ *   step j, so two chains only merge when they collide at the same step.
+ *   A table covers roughly num_chains * chain_len keys; several tables with
+ *   different numbers cover more.
+ * File (native byte order, mapped read-only by des_rainbow_open):
+ *   des_rainbow_hdr
+ *   uint32_t index[(1 << index_bits) + 1]  first entry of each endpoint bucket
+ *   des_rainbow_entry entries[num_chains]   sorted by endpoint, merged chains dropped
+ *   The bucket is the top index_bits of the 56-bit endpoint, the entry keeps
+ *   the next 32 bits and the chain number: 8 bytes per chain. The dropped low
+ *   bits only cost false alarms, which the lookup checks anyway.
+ */
+
+#ifndef DES_RAINBOW_H
+#define DES_RAINBOW_H
+
+#include <stdint.h>
+
+#include "des_pool.h"
+
+#define DES_RAINBOW_MAGIC "DESRBW01"
+
+// Chains per pool task when building
+#define DES_RAINBOW_TASK 4096
+
+typedef struct des_rainbow_hdr {
+    char magic[8];
+    char plain[8];
+    uint64_t num_chains; // entries in the file
+    uint64_t built_chains; // chains generated, numbers 0 .. built_chains - 1
+    uint32_t chain_len;
+    uint32_t table;
+    uint32_t index_bits;
+    uint32_t reserved[5];
+} des_rainbow_hdr;
+
+typedef struct des_rainbow_entry {
+    uint32_t start; // chain number
+    uint32_t end; // endpoint bits below the bucket
+} des_rainbow_entry;
+
+typedef struct des_rainbow des_rainbow;
+
+typedef struct des_rainbow_stats {
+    long long unsigned encryptions;
+    long long unsigned false_alarms;
+    double seconds;
+} des_rainbow_stats;
+
+/*
+ * Generate num_chains chains on the pool, sort them and write the table
+ * Needs 16 bytes of memory per chain while building. Build rate and table
+ * size are printed to stderr.
+ * @param plain 8-byte chosen plain text
+ * @param table Table number (0, 1, ..), selects the start keys and reductions
+ * @return 0, or -1 after printing the reason to stderr
+ */
+int des_rainbow_build(des_pool *pool, const char *path, const char *plain,
+                      int chain_len, long long unsigned num_chains, int table);
+
+/*
+ * @return the mapped table, or NULL after printing the reason to stderr
+ */
+des_rainbow *des_rainbow_open(const char *path);
+void des_rainbow_close(des_rainbow *rt);
+const des_rainbow_hdr *des_rainbow_header(const des_rainbow *rt);
+
+/*
+ * Find a key that encrypts the table's plain text to cipher
+ * Every chain position is tried at once, spread over the pool and the lanes
+ * of the bitsliced engine.
+ * @param cipher 8-byte cipher text
+ * @param key_index Key index found (output reference)
+ * @param stats Cost of the lookup, or NULL (output reference)
+ * @return 1 if found, 0 if the key is not covered, -1 after printing the reason
+ */
+int des_rainbow_lookup(const des_rainbow *rt, des_pool *pool, const char *cipher,
+                       long long unsigned *key_index, des_rainbow_stats *stats);
+
+#endif
@@ -0,0 +1,113 @@
+
+/*
+ * des_range.c
+ *
+ * Random-access reads from an encrypted file (see des_range.h)
+ *
+ * Role of each functions:
+ *   des_range_read(..):
+ *     -> Clips the range to the plain text, then reads and decrypts the
+ *        covering blocks DES_POOL_CHUNK bytes at a time.
+ *   plainSize(..):
+ *     -> Plain text length (ECB: from the padding of the last block).
+ * Reads go through des_read_at (des_io.h).
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "des_range.h"
+#include "des_modes.h"
+#include "des_pool.h"
+#include "des_block.h"
+#include "des_io.h"
+
+/*
+ * @return plain text length, or -1 after printing the reason
+ */
+static long plainSize(const des_ctx *ctx, int fd, int mode) {
+    struct stat st;
+    char last[8];
+    long size;
+    int pad;
+
+    if(fstat(fd, &st) != 0) { perror("reading file size"); return -1; }
+    size = st.st_size;
+    if(mode == DES_RANGE_CTR) return size;
+
+    if(size == 0 || size % 8 != 0) {
+        fputs("input is not a multiple of 8 bytes\n", stderr);
+        return -1;
+    }
+    if(des_read_at(fd, last, 8, size - 8) != 8) { perror("reading file"); return -1; }
+    des_ecb_decrypt(ctx, last, last, 8);
+    pad = des_get_pad(last);
+    if(pad < 0) {
+        fputs("bad padding (wrong key or damaged input)\n", stderr);
+        return -1;
+    }
+    return size - pad;
+}
+
+/*
+ * 8-byte counter block as a big-endian number, plus blocks
+ */
+static void addCounter(char *out, const char *iv, long long unsigned blocks) {
+    long long unsigned ctr = 0;
+    int j;
+
+    for(j = 0; j < 8; j++) ctr = ctr << 8 | (iv[j] & 0xff);
+    ctr += blocks;
+    for(j = 7; j >= 0; j--) {
+        out[j] = ctr & 0xff;
+        ctr >>= 8;
+    }
+}
+
+long des_range_read(const des_ctx *ctx, int fd, int mode, const char *iv, long offset, long len, char *out) {
+    long size, first, end, pos, n, skip, take, done = 0;
+    char ctr[8], *buf;
+
+    if(mode != DES_RANGE_ECB && mode != DES_RANGE_CTR) { fputs("unknown mode\n", stderr); return -1; }
+    if(offset < 0 || len < 0) { fputs("bad range\n", stderr); return -1; }
+
+    // (1/2) Clip to the plain text, widen to whole blocks
+    size = plainSize(ctx, fd, mode);
+    if(size < 0) return -1;
+    if(offset >= size || len == 0) return 0;
+    if(len > size - offset) len = size - offset;
+    first = offset - offset % 8;
+    end = offset + len;
+
+    buf = malloc(end - first < DES_POOL_CHUNK ? end - first + 8 : DES_POOL_CHUNK);
+    if(!buf) { fputs("memory allocation fails\n", stderr); return -1; }
+
+    // (2/2) Covering blocks a chunk at a time
+    for(pos = first; pos < end; pos += n) {
+        n = end - pos;
+        if(n > DES_POOL_CHUNK) n = DES_POOL_CHUNK;
+        if(mode == DES_RANGE_ECB) n = (n + 7) & ~7L; // ECB text always ends on a block
+        if(des_read_at(fd, buf, n, pos) != n) {
+            fputs("short read (file changed?)\n", stderr);
+            free(buf);
+            return -1;
+        }
+        if(mode == DES_RANGE_ECB) {
+            des_ecb_decrypt(ctx, buf, buf, (int)n);
+        } else {
+            addCounter(ctr, iv, pos / 8);
+            des_ctr_crypt(ctx, buf, buf, (int)n, ctr);
+        }
+
+        skip = pos < offset ? offset - pos : 0;
+        take = (pos + n < end ? n : end - pos) - skip;
+        memcpy(out + done, buf + skip, take);
+        done += take;
+    }
+    free(buf);
+    return done;
+}
@@ -0,0 +1,35 @@
+
+/*
+ * des_range.h
+ *
+ * Random-access reads from an encrypted file
+ *
+ * ECB and CTR blocks do not depend on each other, so plain text bytes
+ * [offset, offset + len) only need the cipher blocks that cover them:
+ *   DES_RANGE_ECB -> the des_stream format (ECB + PKCS#5 padding); the last
+ *                    block is decrypted as well to know where the padding starts
+ *   DES_RANGE_CTR -> des_ctr_crypt output of the whole file from counter iv,
+ *                    no padding; block k uses counter iv + k
+ * The cost depends on len, not on the size of the file.
+ */
+
+#ifndef DES_RANGE_H
+#define DES_RANGE_H
+
+#include "des.h"
+
+enum { DES_RANGE_ECB, DES_RANGE_CTR };
+
+/*
+ * @param ctx Context from des_ctx_init
+ * @param fd Encrypted file (read with pread, the file offset is not used)
+ * @param mode DES_RANGE_ECB or DES_RANGE_CTR
+ * @param iv Initial counter block (DES_RANGE_CTR only)
+ * @param offset, len Plain text range
+ * @param out At least len bytes
+ * @return bytes read (less than len at the end of the plain text), or -1
+ *         after printing the reason to stderr
+ */
+long des_range_read(const des_ctx *ctx, int fd, int mode, const char *iv, long offset, long len, char *out);
+
+#endif
@@ -0,0 +1,289 @@
+
+/*
+ * des_search.c
+ *
+ * Exhaustive key search over the worker pool
+ *
+ * Role of each functions:
+ *   des_search(..):
+ *     -> Runs the range round by round, reports keys/s per worker and
+ *        writes the checkpoint after every round.
+ *   searchTask(..):
+ *     -> DES_SEARCH_TASK consecutive key indices, des_bs_width() keys per
+ *        kernel pass (des_bs_search).
+ *   initPlanes(..), setPlanes(..):
+ *     -> Key planes of consecutive key indices: the low bits of the index vary
+ *        across lanes in fixed patterns, the others are broadcast.
+ *   readCheckpoint(..), writeCheckpoint(..):
+ *     -> Resume state.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "des_search.h"
+#include "des_bs.h"
+#include "des_tables.h"
+#include "des_block.h"
+
+// Most keys kept between two checkpoints
+#define DES_SEARCH_MAX_FOUND 64
+
+struct search {
+    long long unsigned plain, cipher; // loaded blocks
+    long long unsigned start, end; // this round
+    int width, words, lane_bits;
+
+    // plane_bit[p]: key index bit feeding bit p of the PC1 output
+    int plane_bit[56];
+    // Lane patterns of the low key index bits
+    long long unsigned pattern[16][DES_BS_MAX_WIDTH / 64];
+
+    long long unsigned *tested; // per worker
+    pthread_mutex_t lock;
+    long long unsigned found[DES_SEARCH_MAX_FOUND];
+    int num_found;
+};
+
+/*
+ * Lane layout of the kernels: bit b of word g in a plane is lane b * words + g,
+ * and lane l tests key index base + l.
+ */
+static void initPlanes(struct search *s) {
+    int i, r, g, b;
+
+    // PC1 output bit 55 - i is key bit table_PC1[i]
+    for(i = 0; i < 56; i++) {
+        s->plane_bit[55 - i] = table_PC1[i];
+    }
+
+    for(s->lane_bits = 0; (1 << s->lane_bits) < s->width; s->lane_bits++);
+    for(r = 0; r < s->lane_bits; r++) {
+        for(g = 0; g < s->words; g++) {
+            s->pattern[r][g] = 0;
+            for(b = 0; b < 64; b++) {
+                if((((b * s->words) + g) >> r) & 0x1) s->pattern[r][g] |= 0x1ull << b;
+            }
+        }
+    }
+}
+
+/*
+ * Key planes of base .. base + width - 1 (base is a multiple of width)
+ */
+static void setPlanes(const struct search *s, long long unsigned *kp, long long unsigned base) {
+    long long unsigned fill;
+    int p, r, g;
+
+    for(p = 0; p < 56; p++) {
+        r = s->plane_bit[p];
+        if(r < s->lane_bits) {
+            memcpy(kp + p * s->words, s->pattern[r], s->words * sizeof(*kp));
+        } else {
+            fill = 0 - ( ( base >> r ) & 0x1 );
+            for(g = 0; g < s->words; g++) kp[p * s->words + g] = fill;
+        }
+    }
+}
+
+static void searchTask(void *arg, long index, int worker) {
+    struct search *s = arg;
+    long long unsigned kp[56 * DES_BS_MAX_WIDTH / 64], match[DES_BS_MAX_WIDTH / 64];
+    long long unsigned lo, hi, base, key;
+    int g, b;
+
+    lo = s->start + (long long unsigned)index * DES_SEARCH_TASK;
+    hi = lo + DES_SEARCH_TASK < s->end ? lo + DES_SEARCH_TASK : s->end;
+
+    for(base = lo - lo % s->width; base < hi; base += s->width) {
+        setPlanes(s, kp, base);
+        if(!des_bs_search(kp, s->plain, s->cipher, match)) continue;
+
+        // Rare: collect the matching lanes inside [lo, hi)
+        for(g = 0; g < s->words; g++) {
+            for(b = 0; b < 64; b++) {
+                if(!((match[g] >> b) & 0x1)) continue;
+                key = base + b * s->words + g;
+                if(key < lo || key >= hi) continue;
+                pthread_mutex_lock(&s->lock);
+                if(s->num_found < DES_SEARCH_MAX_FOUND) s->found[s->num_found++] = key;
+                pthread_mutex_unlock(&s->lock);
+            }
+        }
+    }
+    s->tested[worker] += hi - lo;
+}
+
+static void putHex(FILE *f, const char *label, const char *bytes) {
+    int j;
+
+    fprintf(f, "%s ", label);
+    for(j = 0; j < 8; j++) fprintf(f, "%02X", bytes[j] & 0xff);
+    fprintf(f, "\n");
+}
+
+// Key of a key index (byte 0 left 00)
+static void getKey(char *key, long long unsigned index) {
+    int j;
+
+    key[0] = 0;
+    for(j = 7; j >= 1; j--) {
+        key[j] = index & 0xff;
+        index >>= 8;
+    }
+}
+
+/*
+ * Rewrite the checkpoint through a temporary file, so an interruption leaves
+ * either the old or the new one
+ */
+static int writeCheckpoint(const char *path, const char *plain, const char *cipher,
+                           long long unsigned end, long long unsigned next,
+                           const long long unsigned *found, int num_found) {
+    char tmp[4096], key[8];
+    FILE *f;
+    int i;
+
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "w");
+    if(!f) { perror("writing checkpoint"); return -1; }
+    putHex(f, "plain", plain);
+    putHex(f, "cipher", cipher);
+    fprintf(f, "end %014llX\nnext %014llX\n", end, next);
+    for(i = 0; i < num_found; i++) {
+        getKey(key, found[i]);
+        putHex(f, "found", key);
+    }
+    if(fclose(f) != 0 || rename(tmp, path) != 0) {
+        perror("writing checkpoint");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * @return 1 if resumed, 0 if there is no checkpoint yet, -1 if it belongs to another search
+ */
+static int readCheckpoint(const char *path, const char *plain, const char *cipher,
+                          long long unsigned *end, long long unsigned *next,
+                          long long unsigned *found, int *num_found) {
+    char line[256], label[16], hex[32], want[17];
+    long long unsigned value;
+    FILE *f;
+    int j, rtn = 1;
+
+    f = fopen(path, "r");
+    if(!f) return 0;
+    while(fgets(line, sizeof(line), f)) {
+        if(sscanf(line, "%15s %31s", label, hex) != 2) continue;
+        value = strtoull(hex, NULL, 16);
+        if(strcmp(label, "plain") == 0 || strcmp(label, "cipher") == 0) {
+            for(j = 0; j < 8; j++) {
+                sprintf(want + 2 * j, "%02X", (label[0] == 'p' ? plain : cipher)[j] & 0xff);
+            }
+            if(strcmp(hex, want) != 0) rtn = -1;
+        } else if(strcmp(label, "end") == 0) {
+            *end = value;
+        } else if(strcmp(label, "next") == 0) {
+            *next = value;
+        } else if(strcmp(label, "found") == 0 && *num_found < DES_SEARCH_MAX_FOUND) {
+            found[(*num_found)++] = value & (DES_SEARCH_SPACE - 1);
+        }
+    }
+    fclose(f);
+    if(rtn < 0) fprintf(stderr, "%s is the checkpoint of another plain / cipher text pair\n", path);
+    return rtn;
+}
+
+static double seconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+/*
+ * Search [start, end) for keys that encrypt plain to cipher
+ */
+int des_search(des_pool *pool, const char *plain, const char *cipher,
+               long long unsigned start, long long unsigned end,
+               const char *checkpoint_path, int find_all) {
+    struct search s;
+    long long unsigned next, round_keys, done;
+    long long unsigned found[DES_SEARCH_MAX_FOUND];
+    int num_found = 0, num_threads, reported = 0, failed = 0;
+    long num_tasks;
+    double t0, t1;
+    char key[8];
+    int i;
+
+    memset(&s, 0, sizeof(s));
+    s.width = des_bs_width();
+    if(s.width == 0) { fputs("key search needs the bitsliced engine\n", stderr); return -1; }
+    s.words = s.width / 64;
+    s.plain = des_load_block(plain, 1);
+    s.cipher = des_load_block(cipher, 0);
+    initPlanes(&s);
+
+    if(end > DES_SEARCH_SPACE) end = DES_SEARCH_SPACE;
+    next = start;
+    if(checkpoint_path) {
+        i = readCheckpoint(checkpoint_path, plain, cipher, &end, &next, found, &num_found);
+        if(i < 0) return -1;
+        if(i > 0) fprintf(stderr, "resuming at %014llX of %014llX, %d key(s) found so far\n", next, end, num_found);
+    }
+
+    num_threads = des_pool_size(pool);
+    s.tested = calloc(num_threads, sizeof(*s.tested));
+    if(!s.tested) { fputs("mem allocation fails\n", stderr); return -1; }
+    pthread_mutex_init(&s.lock, NULL);
+    round_keys = DES_SEARCH_TASK * num_threads * DES_SEARCH_ROUND;
+
+    for(i = 0; i < num_found; i++) {
+        getKey(key, found[i]);
+        putHex(stdout, "found", key);
+    }
+    reported = num_found;
+
+    while(next < end && (find_all || num_found == 0)) {
+        s.start = next;
+        s.end = end - next < round_keys ? end : next + round_keys;
+        num_tasks = (long)((s.end - s.start + DES_SEARCH_TASK - 1) / DES_SEARCH_TASK);
+        memset(s.tested, 0, num_threads * sizeof(*s.tested));
+        s.num_found = 0;
+
+        t0 = seconds();
+        des_pool_run(pool, searchTask, &s, num_tasks);
+        t1 = seconds();
+        next = s.end;
+
+        for(i = 0; i < s.num_found && num_found < DES_SEARCH_MAX_FOUND; i++) {
+            found[num_found++] = s.found[i];
+        }
+        for(; reported < num_found; reported++) {
+            getKey(key, found[reported]);
+            putHex(stdout, "found", key);
+        }
+        fflush(stdout);
+
+        // Progress and per-worker rate
+        done = 0;
+        for(i = 0; i < num_threads; i++) done += s.tested[i];
+        fprintf(stderr, "%014llX / %014llX  %.1f Mkeys/s  (", next, end, done / (t1 - t0) / 1e6);
+        for(i = 0; i < num_threads; i++) {
+            fprintf(stderr, "%s%.1f", i ? " " : "", s.tested[i] / (t1 - t0) / 1e6);
+        }
+        fprintf(stderr, " per worker)\n");
+
+        if(checkpoint_path && writeCheckpoint(checkpoint_path, plain, cipher, end, next, found, num_found) != 0) {
+            failed = 1;
+            break;
+        }
+    }
+
+    free(s.tested);
+    pthread_mutex_destroy(&s.lock);
+    return failed ? -1 : num_found;
+}
@@ -0,0 +1,40 @@
+
+/*
+ * des_search.h
+ *
+ * Exhaustive key search from one known plain / cipher text pair
+ *
+ * Key space:
+ *   PC1 (table_PC1) reads bits 0..55 of the key, i.e. key bytes 1..7, and
+ *   skips byte 0 where this implementation keeps its 8 parity bits. A key
+ *   index is the big-endian value of key bytes 1..7 (0 .. 2^56 - 1); found
+ *   keys are printed with byte 0 = 00, any other value there is the same key.
+ * Checkpoint file (text, rewritten atomically after every round):
+ *   plain <hex>, cipher <hex>, end <index>, next <index>, found <key> ...
+ */
+
+#ifndef DES_SEARCH_H
+#define DES_SEARCH_H
+
+#include "des_pool.h"
+
+#define DES_SEARCH_SPACE (1ull << 56)
+
+// Keys per pool task, and tasks per worker between checkpoints
+#define DES_SEARCH_TASK (1ull << 24)
+#define DES_SEARCH_ROUND 4
+
+/*
+ * @param pool Worker pool (one task per DES_SEARCH_TASK keys)
+ * @param plain 8-byte known plain text
+ * @param cipher 8-byte cipher text of plain
+ * @param start, end Key index range [start, end)
+ * @param checkpoint_path Checkpoint to resume from and keep updated, or NULL
+ * @param find_all 0 to stop after the round that found a key, 1 to cover the whole range
+ * @return number of keys found (printed to stdout), or -1 after printing the reason to stderr
+ */
+int des_search(des_pool *pool, const char *plain, const char *cipher,
+               long long unsigned start, long long unsigned end,
+               const char *checkpoint_path, int find_all);
+
+#endif
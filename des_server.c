@@ -0,0 +1,362 @@
+
+/*
+ * des_server.c
+ *
+ * Local encryption daemon on a Unix domain socket
+ *
+ * Role of each functions:
+ *   des_server_run(..):
+ *     -> Binds the socket, starts the batcher and one thread per connection.
+ *   connMain(..):
+ *     -> Reads a request, serves it (queued or direct), writes the response.
+ *   batcherMain(..):
+ *     -> Takes the whole queue once it fills a bitsliced batch or its oldest
+ *        request reaches the deadline, and runs it as key-agile batches.
+ *   addKey(..), releaseKeys(..):
+ *     -> Key handles: the key bytes for des_batch, a des_ctx for direct requests.
+ *        A key registered again gets the same handle; each connection holds one
+ *        reference per handle it registered and drops them when it closes.
+ * Queue:
+ *   Requests are linked in arrival order under srv.lock; the batcher marks
+ *   them done and wakes the connection threads through srv.done.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include "des.h"
+#include "des_bs.h"
+#include "des_modes.h"
+#include "des_batch.h"
+#include "des_server.h"
+
+struct request {
+    struct request *next;
+    des_req_hdr hdr;
+    char *data;
+    long long unsigned arrival; // ns
+    int status;
+    int done;
+};
+
+struct server {
+    pthread_mutex_t lock;
+    pthread_cond_t pending, done;
+    struct request *head, *tail;
+    long pending_blocks;
+    long long unsigned deadline; // ns
+
+    // Key handles (published under lock), refs[handle] == 0: free slot
+    char keys[DES_SERVER_KEYS][8];
+    des_ctx ctxs[DES_SERVER_KEYS];
+    int refs[DES_SERVER_KEYS];
+    int num_keys; // slots ever used
+};
+
+// Handles a connection holds a reference to, one bit each
+typedef unsigned char held_keys[DES_SERVER_KEYS / 8];
+
+static struct server srv;
+
+static long long unsigned now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+static int readFull(int fd, void *buf, long len) {
+    long got;
+    ssize_t n;
+
+    for(got = 0; got < len; got += n) {
+        n = read(fd, (char *)buf + got, len - got);
+        if(n < 0 && errno == EINTR) { n = 0; continue; }
+        if(n <= 0) return -1;
+    }
+    return 0;
+}
+
+static int writeFull(int fd, const void *buf, long len) {
+    long done;
+    ssize_t n;
+
+    for(done = 0; done < len; done += n) {
+        n = send(fd, (const char *)buf + done, len - done, MSG_NOSIGNAL);
+        if(n < 0 && errno == EINTR) { n = 0; continue; }
+        if(n <= 0) return -1;
+    }
+    return 0;
+}
+
+static int isHeld(const held_keys held, int handle) {
+    return handle >= 0 && handle < DES_SERVER_KEYS && (held[handle / 8] >> (handle % 8) & 1);
+}
+
+/*
+ * Handle of key, shared with every connection that registered the same bytes
+ * @param held Handles of the calling connection (updated)
+ * @return handle, or -ENOSPC
+ */
+static int addKey(const char *key, held_keys held) {
+    int handle, free_slot = -1;
+
+    pthread_mutex_lock(&srv.lock);
+    for(handle = 0; handle < srv.num_keys; handle++) {
+        if(srv.refs[handle] == 0) {
+            if(free_slot < 0) free_slot = handle;
+            continue;
+        }
+        if(memcmp(srv.keys[handle], key, 8) == 0) break;
+    }
+    if(handle == srv.num_keys) {
+        if(free_slot >= 0) handle = free_slot;
+        else if(srv.num_keys < DES_SERVER_KEYS) srv.num_keys++;
+        else handle = -ENOSPC;
+        if(handle >= 0) {
+            memcpy(srv.keys[handle], key, 8);
+            des_ctx_init(&srv.ctxs[handle], key);
+        }
+    }
+    if(handle >= 0 && !isHeld(held, handle)) {
+        held[handle / 8] |= 1 << (handle % 8);
+        srv.refs[handle]++;
+    }
+    pthread_mutex_unlock(&srv.lock);
+    return handle;
+}
+
+/*
+ * Drop the references of a closing connection, a slot nobody holds is wiped
+ */
+static void releaseKeys(const held_keys held) {
+    int handle;
+
+    pthread_mutex_lock(&srv.lock);
+    for(handle = 0; handle < srv.num_keys; handle++) {
+        if(!isHeld(held, handle) || --srv.refs[handle] > 0) continue;
+        memset(srv.keys[handle], 0, 8);
+        memset(&srv.ctxs[handle], 0, sizeof(srv.ctxs[handle]));
+    }
+    pthread_mutex_unlock(&srv.lock);
+}
+
+/*
+ * Large request on the calling thread, same bytes as des_batch
+ */
+static void serveDirect(struct request *r) {
+    const des_ctx *ctx = &srv.ctxs[r->hdr.handle];
+    int len = (int)r->hdr.len;
+
+    if(r->hdr.mode == DES_BATCH_CTR) des_ctr_crypt(ctx, r->data, r->data, len, r->hdr.iv);
+    else if(r->hdr.mode == DES_BATCH_CBC && r->hdr.op == DES_OP_DECRYPT) des_cbc_decrypt(ctx, r->data, r->data, len, r->hdr.iv);
+    else if(r->hdr.mode == DES_BATCH_CBC) des_cbc_encrypt(ctx, r->data, r->data, len, r->hdr.iv);
+    else if(r->hdr.op == DES_OP_DECRYPT) des_ecb_decrypt(ctx, r->data, r->data, len);
+    else des_ecb_encrypt(ctx, r->data, r->data, len);
+}
+
+/*
+ * Queue a small request and wait for the batcher
+ */
+static void serveQueued(struct request *r) {
+    r->next = NULL;
+    r->done = 0;
+    r->arrival = now();
+
+    pthread_mutex_lock(&srv.lock);
+    if(srv.tail) srv.tail->next = r;
+    else srv.head = r;
+    srv.tail = r;
+    srv.pending_blocks += (r->hdr.len + 7) / 8;
+    pthread_cond_signal(&srv.pending);
+    while(!r->done) pthread_cond_wait(&srv.done, &srv.lock);
+    pthread_mutex_unlock(&srv.lock);
+}
+
+/*
+ * Run a list of requests: one des_batch call per (direction, mode)
+ */
+static void runBatch(struct request *list) {
+    des_batch_msg *msgs;
+    struct request *r;
+    int op, mode, n, count = 0;
+
+    for(r = list; r; r = r->next) count++;
+    msgs = malloc(count * sizeof(*msgs));
+    if(!msgs) {
+        for(r = list; r; r = r->next) r->status = -ENOMEM;
+        return;
+    }
+
+    for(op = DES_OP_ENCRYPT; op <= DES_OP_DECRYPT; op++) {
+        for(mode = DES_BATCH_ECB; mode <= DES_BATCH_CTR; mode++) {
+            n = 0;
+            for(r = list; r; r = r->next) {
+                if(r->hdr.op != op || r->hdr.mode != mode) continue;
+                msgs[n].key = srv.keys[r->hdr.handle];
+                msgs[n].iv = r->hdr.iv;
+                msgs[n].in = r->data;
+                msgs[n].out = r->data;
+                msgs[n].len = (int)r->hdr.len;
+                n++;
+            }
+            if(n == 0) continue;
+            if(op == DES_OP_ENCRYPT) des_batch_encrypt(msgs, n, mode);
+            else des_batch_decrypt(msgs, n, mode);
+        }
+    }
+    free(msgs);
+}
+
+static void *batcherMain(void *p) {
+    struct request *list;
+    struct timespec until;
+    long long unsigned due, width;
+    (void)p;
+
+    pthread_mutex_lock(&srv.lock);
+    for(;;) {
+        while(!srv.head) pthread_cond_wait(&srv.pending, &srv.lock);
+
+        // (1/3) Wait for a full batch, but not past the deadline of the oldest request
+        width = des_bs_width() > 0 ? des_bs_width() : 1;
+        due = srv.head->arrival + srv.deadline;
+        while(srv.pending_blocks < (long)width && now() < due) {
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += (long)(due - now() < 1000000000ull ? due - now() : 999999999ull);
+            if(until.tv_nsec >= 1000000000L) { until.tv_sec++; until.tv_nsec -= 1000000000L; }
+            pthread_cond_timedwait(&srv.pending, &srv.lock, &until);
+        }
+
+        // (2/3) Take the whole queue
+        list = srv.head;
+        srv.head = srv.tail = NULL;
+        srv.pending_blocks = 0;
+        pthread_mutex_unlock(&srv.lock);
+
+        runBatch(list);
+
+        // (3/3) Hand every request back
+        pthread_mutex_lock(&srv.lock);
+        for(; list; list = list->next) list->done = 1;
+        pthread_cond_broadcast(&srv.done);
+    }
+    return NULL;
+}
+
+static void *connMain(void *p) {
+    int fd = (int)(long)p;
+    struct request r;
+    des_resp_hdr resp;
+    held_keys held;
+    char *buf = NULL;
+    long cap = 0;
+
+    memset(held, 0, sizeof(held));
+
+    while(readFull(fd, &r.hdr, sizeof(r.hdr)) == 0) {
+        r.status = 0;
+        if(r.hdr.len > DES_SERVER_MAX_LEN) break;
+        if(r.hdr.len > cap) {
+            free(buf);
+            cap = r.hdr.len;
+            buf = malloc(cap);
+            if(!buf) break;
+        }
+        r.data = buf;
+        if(readFull(fd, r.data, r.hdr.len) != 0) break;
+
+        if(r.hdr.op == DES_OP_KEY) {
+            r.status = r.hdr.len == 8 ? addKey(r.data, held) : -EINVAL;
+            r.hdr.len = 0;
+        } else if((r.hdr.op != DES_OP_ENCRYPT && r.hdr.op != DES_OP_DECRYPT) || r.hdr.mode > DES_BATCH_CTR
+                  || (r.hdr.mode != DES_BATCH_CTR && r.hdr.len % 8 != 0)) {
+            r.status = -EINVAL;
+            r.hdr.len = 0;
+        } else if(!isHeld(held, r.hdr.handle)) {
+            // The connection's own reference keeps the slot from being reused
+            r.status = -ENOENT;
+            r.hdr.len = 0;
+        } else if(r.hdr.len >= DES_SERVER_DIRECT) {
+            serveDirect(&r);
+        } else if(r.hdr.len > 0) {
+            serveQueued(&r);
+        }
+
+        resp.id = r.hdr.id;
+        resp.status = r.status;
+        // A failed request never echoes its data (the client's plain text)
+        resp.len = r.status < 0 ? 0 : r.hdr.len;
+        memcpy(resp.iv, r.hdr.iv, 8);
+        if(writeFull(fd, &resp, sizeof(resp)) != 0 || writeFull(fd, r.data, resp.len) != 0) break;
+    }
+    releaseKeys(held);
+    free(buf);
+    close(fd);
+    return NULL;
+}
+
+int des_server_run(const char *path, long deadline_us) {
+    struct sockaddr_un addr;
+    struct stat st;
+    pthread_attr_t attr;
+    pthread_t thread;
+    int listen_fd, fd;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(strlen(path) >= sizeof(addr.sun_path)) { fputs("socket path too long\n", stderr); return -1; }
+    strcpy(addr.sun_path, path);
+
+    pthread_mutex_init(&srv.lock, NULL);
+    pthread_cond_init(&srv.pending, NULL);
+    pthread_cond_init(&srv.done, NULL);
+    srv.deadline = deadline_us * 1000ull;
+
+    // Only an old socket is replaced, never a file that happens to have the name
+    if(lstat(path, &st) == 0) {
+        if(!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "binding socket: %s: %s\n", path, strerror(EADDRINUSE));
+            return -1;
+        }
+        unlink(path);
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0) { perror("socket"); return -1; }
+    if(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 || listen(listen_fd, 128) != 0) {
+        perror("binding socket");
+        close(listen_fd);
+        return -1;
+    }
+
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if(pthread_create(&thread, &attr, batcherMain, NULL) != 0) {
+        fputs("thread creation fails\n", stderr);
+        close(listen_fd);
+        return -1;
+    }
+
+    for(;;) {
+        fd = accept(listen_fd, NULL, NULL);
+        if(fd < 0) {
+            if(errno == EINTR || errno == ECONNABORTED) continue;
+            perror("accept");
+            break;
+        }
+        if(pthread_create(&thread, &attr, connMain, (void *)(long)fd) != 0) {
+            fputs("thread creation fails\n", stderr);
+            close(fd);
+        }
+    }
+    close(listen_fd);
+    return -1;
+}
@@ -0,0 +1,66 @@
+
+/*
+ * des_server.h
+ *
+ * Local encryption daemon on a Unix domain socket
+ *
+ * Protocol (native byte order, the socket is local):
+ *   request  = des_req_hdr, then len bytes of data
+ *   response = des_resp_hdr, then len bytes of data
+ *   DES_OP_KEY:     data is an 8-byte key, status is its handle; the handle
+ *                   is valid on this connection until it closes, and the same
+ *                   key bytes get the same handle on every connection
+ *   DES_OP_ENCRYPT,
+ *   DES_OP_DECRYPT: data is transformed under the key of 'handle' in 'mode'
+ *                   (des_batch.h), iv comes back updated as by des_modes.h
+ * status < 0 is -errno (EINVAL: bad header, ENOENT: handle not registered on
+ * this connection, ENOSPC: DES_SERVER_KEYS distinct keys already held by open
+ * connections, ENOMEM), and then the response carries no data. Requests on
+ * one connection are answered in order; open
+ * more connections for more concurrency.
+ *
+ * Coalescing:
+ *   Requests below DES_SERVER_DIRECT bytes wait in one queue until it holds
+ *   des_bs_width() blocks or the oldest has waited the deadline, then go
+ *   through des_batch_encrypt / des_batch_decrypt together. Larger ones run
+ *   at once on their connection thread with the cached des_ctx.
+ */
+
+#ifndef DES_SERVER_H
+#define DES_SERVER_H
+
+#include <stdint.h>
+
+enum { DES_OP_KEY, DES_OP_ENCRYPT, DES_OP_DECRYPT };
+
+// Distinct keys held at once, largest request, smallest request that skips the queue
+#define DES_SERVER_KEYS 4096
+#define DES_SERVER_MAX_LEN (16 * 1024 * 1024)
+#define DES_SERVER_DIRECT (64 * 1024)
+
+typedef struct des_req_hdr {
+    uint32_t id; // echoed in the response
+    uint8_t op;
+    uint8_t mode; // DES_BATCH_ECB, DES_BATCH_CBC or DES_BATCH_CTR
+    uint16_t reserved;
+    int32_t handle;
+    uint32_t len;
+    char iv[8];
+} des_req_hdr;
+
+typedef struct des_resp_hdr {
+    uint32_t id;
+    int32_t status;
+    uint32_t len;
+    char iv[8];
+} des_resp_hdr;
+
+/*
+ * Serve on path until the process is killed
+ * @param path Socket path (an old socket there is replaced, any other file is kept and fails with EADDRINUSE)
+ * @param deadline_us Longest a small request waits for others to fill a batch
+ * @return -1 after printing the reason to stderr (setup failed)
+ */
+int des_server_run(const char *path, long deadline_us);
+
+#endif
@@ -0,0 +1,272 @@
+
+/*
+ * des_stats.c
+ *
+ * Per-stage counters and timers (only with -DDES_STATS, see des_stats.h)
+ *
+ * Role of each functions:
+ *   des_stat_start(..), des_stat_lap(..), des_stat_bytes(..):
+ *     -> Charge time (and hardware events) to a stage of the calling thread.
+ *   des_stats_dump(..):
+ *     -> Every thread seen so far and the totals as JSON.
+ *   self(..):
+ *     -> Counters of the calling thread, registered on first use.
+ *   initStats(..):
+ *     -> Once per process: atexit dump, SIGUSR1 dump thread.
+ * Threads:
+ *   Counters are only written by their own thread and are never freed, so the
+ *   dump also covers threads that have ended (pool workers, stream stages).
+ *   A dump while threads are running reads counters that may be a lap behind.
+ * SIGUSR1:
+ *   The handler only writes a byte to a pipe; a thread blocked on the pipe
+ *   does the dump.
+ */
+
+#ifdef DES_STATS
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "des_stats.h"
+
+struct thread_stats {
+    struct thread_stats *next;
+    int index;
+    long tid;
+    int perf_fd; // group leader of DES_STATS_EVENTS counters, or -1
+    long long unsigned cycles[DES_STAGES];
+    long long unsigned laps[DES_STAGES];
+    long long unsigned events[DES_STAGES][DES_STATS_EVENTS];
+    long long unsigned bytes, blocks;
+};
+
+static const char *stage_names[DES_STAGES] = {
+    "key", "load", "ip", "rounds", "swap", "fp", "store", "bitsliced", "stall"
+};
+
+static const char *event_names[DES_STATS_EVENTS] = {
+    "hw_cycles", "instructions", "cache_misses"
+};
+
+static struct thread_stats *all_threads;
+static int num_threads;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static __thread struct thread_stats *my_stats;
+static int use_perf;
+static int dump_pipe[2] = { -1, -1 };
+
+static long long unsigned timestamp(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000ull + t.tv_nsec;
+#endif
+}
+
+/*
+ * Write the JSON to DES_STATS_OUT, or stderr
+ */
+static void dumpOut(void) {
+    const char *path = getenv("DES_STATS_OUT");
+    FILE *f;
+
+    if(!path || strcmp(path, "-") == 0) {
+        des_stats_dump(stderr);
+        return;
+    }
+    f = fopen(path, "w");
+    if(!f) { perror("opening DES_STATS_OUT"); return; }
+    des_stats_dump(f);
+    fclose(f);
+}
+
+static void onSignal(int sig) {
+    char c = 0;
+    (void)sig;
+    if(write(dump_pipe[1], &c, 1) < 0) return;
+}
+
+static void *dumpMain(void *p) {
+    char c;
+    (void)p;
+    while(read(dump_pipe[0], &c, 1) > 0) dumpOut();
+    return NULL;
+}
+
+static void initStats(void) {
+    struct sigaction sa;
+    pthread_t thread;
+    const char *env = getenv("DES_STATS_PERF");
+
+    use_perf = env && strcmp(env, "0") != 0;
+    atexit(dumpOut);
+
+    if(pipe(dump_pipe) != 0) return;
+    if(pthread_create(&thread, NULL, dumpMain, NULL) != 0) return;
+    pthread_detach(thread);
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = onSignal;
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &sa, NULL);
+}
+
+/*
+ * Open cycles, instructions and cache misses of the calling thread as one group
+ * @return group leader, or -1 (perf_event_paranoid, no PMU in a VM ..)
+ */
+static int openPerf(void) {
+    static const long long unsigned configs[DES_STATS_EVENTS] = {
+        PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS, PERF_COUNT_HW_CACHE_MISSES
+    };
+    struct perf_event_attr attr;
+    int i, fd, leader = -1;
+
+    for(i = 0; i < DES_STATS_EVENTS; i++) {
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.read_format = PERF_FORMAT_GROUP;
+        attr.disabled = i == 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = (int)syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+        if(fd < 0) {
+            if(leader >= 0) close(leader);
+            return -1;
+        }
+        if(i == 0) leader = fd;
+    }
+    ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    return leader;
+}
+
+static struct thread_stats *self(void) {
+    struct thread_stats *s = my_stats;
+
+    if(s) return s;
+    pthread_once(&stats_once, initStats);
+    s = calloc(1, sizeof(*s));
+    if(!s) abort();
+    s->tid = syscall(__NR_gettid);
+    s->perf_fd = use_perf ? openPerf() : -1;
+
+    pthread_mutex_lock(&stats_lock);
+    s->index = num_threads++;
+    s->next = all_threads;
+    all_threads = s;
+    pthread_mutex_unlock(&stats_lock);
+    my_stats = s;
+    return s;
+}
+
+static void readEvents(struct thread_stats *s, long long unsigned *ev) {
+    long long unsigned buf[1 + DES_STATS_EVENTS];
+
+    if(s->perf_fd < 0 || read(s->perf_fd, buf, sizeof(buf)) != sizeof(buf)) {
+        memset(ev, 0, DES_STATS_EVENTS * sizeof(*ev));
+        return;
+    }
+    memcpy(ev, buf + 1, DES_STATS_EVENTS * sizeof(*ev));
+}
+
+void des_stat_start(des_stat_mark *m) {
+    struct thread_stats *s = self();
+
+    if(s->perf_fd >= 0) readEvents(s, m->ev);
+    m->t = timestamp();
+}
+
+/*
+ * Charge everything since the last start / lap to stage, and start again
+ */
+void des_stat_lap(des_stat_mark *m, int stage) {
+    struct thread_stats *s = self();
+    long long unsigned t = timestamp(), ev[DES_STATS_EVENTS];
+    int i;
+
+    s->cycles[stage] += t - m->t;
+    s->laps[stage]++;
+    if(s->perf_fd >= 0) {
+        readEvents(s, ev);
+        for(i = 0; i < DES_STATS_EVENTS; i++) {
+            s->events[stage][i] += ev[i] - m->ev[i];
+            m->ev[i] = ev[i];
+        }
+    }
+    m->t = timestamp();
+}
+
+void des_stat_bytes(long bytes) {
+    struct thread_stats *s = self();
+
+    s->bytes += bytes;
+    s->blocks += bytes / 8;
+}
+
+static void dumpStages(FILE *f, const long long unsigned *cycles, const long long unsigned *laps,
+                       long long unsigned (*events)[DES_STATS_EVENTS], int perf) {
+    int k, e;
+
+    fprintf(f, "\"stages\": {");
+    for(k = 0; k < DES_STAGES; k++) {
+        fprintf(f, "%s\n      \"%s\": {\"laps\": %llu, \"cycles\": %llu", k ? "," : "", stage_names[k], laps[k], cycles[k]);
+        for(e = 0; perf && e < DES_STATS_EVENTS; e++) {
+            fprintf(f, ", \"%s\": %llu", event_names[e], events[k][e]);
+        }
+        fprintf(f, "}");
+    }
+    fprintf(f, "\n    }");
+}
+
+/*
+ * Write every thread's counters and the totals as one JSON object
+ * Cycles are rdtsc ticks (nanoseconds where there is no rdtsc).
+ * @return 0
+ */
+int des_stats_dump(FILE *f) {
+    struct thread_stats *s, total;
+    int k, e, perf = 0;
+
+    memset(&total, 0, sizeof(total));
+    pthread_mutex_lock(&stats_lock);
+    fprintf(f, "{\n  \"threads\": [");
+    for(s = all_threads; s; s = s->next) {
+        fprintf(f, "%s\n    {\"thread\": %d, \"tid\": %ld, \"bytes\": %llu, \"blocks\": %llu, ",
+                s != all_threads ? "," : "", s->index, s->tid, s->bytes, s->blocks);
+        dumpStages(f, s->cycles, s->laps, s->events, s->perf_fd >= 0);
+        fprintf(f, "}");
+
+        perf |= s->perf_fd >= 0;
+        total.bytes += s->bytes;
+        total.blocks += s->blocks;
+        for(k = 0; k < DES_STAGES; k++) {
+            total.cycles[k] += s->cycles[k];
+            total.laps[k] += s->laps[k];
+            for(e = 0; e < DES_STATS_EVENTS; e++) total.events[k][e] += s->events[k][e];
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+
+    fprintf(f, "\n  ],\n  \"total\": {\"bytes\": %llu, \"blocks\": %llu, ", total.bytes, total.blocks);
+    dumpStages(f, total.cycles, total.laps, total.events, perf);
+    fprintf(f, "}\n}\n");
+    fflush(f);
+    return 0;
+}
+
+#endif
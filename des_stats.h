@@ -0,0 +1,72 @@
+
+/*
+ * des_stats.h
+ *
+ * Per-stage counters and timers (build with 'make STATS=1', i.e. -DDES_STATS)
+ *
+ * Usage:
+ *   DES_STAT_DECL;                  // one mark per function
+ *   DES_STAT_START();
+ *   ... load ...
+ *   DES_STAT_LAP(DES_STAGE_LOAD);   // time since the last mark goes to the stage
+ *   ... IP ...
+ *   DES_STAT_LAP(DES_STAGE_IP);
+ *   DES_STAT_BYTES(len);            // bytes and blocks done by this thread
+ * Every thread has its own counters, so a lap is a timestamp and a few adds.
+ * Without DES_STATS all of this compiles to nothing.
+ *
+ * Export (JSON, see des_stats.c):
+ *   DES_STATS_OUT=<path>  -> written at exit and on SIGUSR1 (default: stderr)
+ *   DES_STATS_PERF=1      -> also cycles, instructions and cache misses per
+ *                            stage from perf_event_open (one read() per lap)
+ */
+
+#ifndef DES_STATS_H
+#define DES_STATS_H
+
+#include <stdio.h>
+
+// Stages of des.c, numbered there (1/9) .. (9/9), plus the ones around them
+enum des_stage {
+    DES_STAGE_KEY,       // (1/9), (4/9), (5/9) key schedule
+    DES_STAGE_LOAD,      // (2/9) cut input
+    DES_STAGE_IP,        // (3/9)
+    DES_STAGE_ROUNDS,    // (6/9)
+    DES_STAGE_SWAP,      // (7/9)
+    DES_STAGE_FP,        // (8/9)
+    DES_STAGE_STORE,     // (9/9)
+    DES_STAGE_BITSLICED, // IP .. FP of whole batches in the bitsliced engine
+    DES_STAGE_STALL,     // waiting on another thread (pool, stream and aio pipelines)
+    DES_STAGES
+};
+
+// Hardware events per stage with DES_STATS_PERF (cycles, instructions, cache misses)
+#define DES_STATS_EVENTS 3
+
+#ifdef DES_STATS
+
+typedef struct des_stat_mark {
+    long long unsigned t;
+    long long unsigned ev[DES_STATS_EVENTS];
+} des_stat_mark;
+
+void des_stat_start(des_stat_mark *m);
+void des_stat_lap(des_stat_mark *m, int stage);
+void des_stat_bytes(long bytes);
+int des_stats_dump(FILE *f);
+
+#define DES_STAT_DECL des_stat_mark des_stat_m
+#define DES_STAT_START() des_stat_start(&des_stat_m)
+#define DES_STAT_LAP(stage) des_stat_lap(&des_stat_m, (stage))
+#define DES_STAT_BYTES(n) des_stat_bytes(n)
+
+#else
+
+#define DES_STAT_DECL int des_stat_unused __attribute__((unused))
+#define DES_STAT_START() ((void)0)
+#define DES_STAT_LAP(stage) ((void)0)
+#define DES_STAT_BYTES(n) ((void)0)
+
+#endif
+
+#endif
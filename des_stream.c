@@ -0,0 +1,252 @@
+
+/*
+ * des_stream.c
+ *
+ * Streaming ECB between two file descriptors in constant memory
+ *
+ * Role of each functions:
+ *   des_stream(..):
+ *     -> Runs the pipeline; the calling thread is the compute stage.
+ *   readerMain(..):
+ *     -> Fills slots from fd_in. A slot is handed over only once the next read
+ *        shows whether it is the last one, so the padding is always in the last slot.
+ *   writerMain(..):
+ *     -> Drains computed slots to fd_out in order and frees them.
+ * Slots:
+ *   Chunk number n lives in slots[n % DES_STREAM_SLOTS] and goes
+ *   FREE -> READ -> DONE -> FREE, so reading, computing and writing overlap.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "des_stream.h"
+#include "des_stats.h"
+#include "des_arena.h"
+#include "des_block.h"
+
+enum { SLOT_FREE, SLOT_READ, SLOT_DONE };
+
+struct slot {
+    char *data; // DES_STREAM_CHUNK + 8 bytes (room for the padding)
+    long len;
+    int last;
+    int state;
+};
+
+struct stream {
+    struct slot slots[DES_STREAM_SLOTS];
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int fd_in, fd_out;
+    int failed;
+};
+
+/*
+ * Wait until chunk seq's slot reaches state
+ * @return slot, or NULL once the stream failed
+ */
+static struct slot *waitSlot(struct stream *st, long seq, int state) {
+    struct slot *slot = &st->slots[seq % DES_STREAM_SLOTS];
+    DES_STAT_DECL;
+
+    pthread_mutex_lock(&st->lock);
+    if(!st->failed && slot->state != state) {
+        DES_STAT_START();
+        while(!st->failed && slot->state != state) {
+            pthread_cond_wait(&st->cond, &st->lock);
+        }
+        DES_STAT_LAP(DES_STAGE_STALL);
+    }
+    if(st->failed) slot = NULL;
+    pthread_mutex_unlock(&st->lock);
+    return slot;
+}
+
+static void setSlot(struct stream *st, struct slot *slot, int state) {
+    pthread_mutex_lock(&st->lock);
+    slot->state = state;
+    pthread_cond_broadcast(&st->cond);
+    pthread_mutex_unlock(&st->lock);
+}
+
+static void fail(struct stream *st) {
+    pthread_mutex_lock(&st->lock);
+    st->failed = 1;
+    pthread_cond_broadcast(&st->cond);
+    pthread_mutex_unlock(&st->lock);
+}
+
+/*
+ * Read into slot until it is full or the input ends
+ * Only the read itself can be cancelled (see des_stream).
+ * @return 0 if full, 1 at end of input, -1 on error
+ */
+static int fill(struct stream *st, struct slot *slot) {
+    ssize_t n;
+
+    slot->len = 0;
+    while(slot->len < DES_STREAM_CHUNK) {
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        n = read(st->fd_in, slot->data + slot->len, DES_STREAM_CHUNK - slot->len);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        if(n < 0) {
+            if(errno == EINTR) continue;
+            perror("reading input");
+            return -1;
+        }
+        if(n == 0) return 1;
+        slot->len += n;
+    }
+    return 0;
+}
+
+static void *readerMain(void *p) {
+    struct stream *st = p;
+    struct slot *cur, *next;
+    long seq = 0;
+    int eof, next_eof;
+
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+    cur = waitSlot(st, seq, SLOT_FREE);
+    if(!cur) return NULL;
+    eof = fill(st, cur);
+    for(;;) {
+        if(eof < 0) { fail(st); return NULL; }
+        if(eof) break;
+
+        // cur is full: it is the last chunk only if nothing follows
+        next = waitSlot(st, seq + 1, SLOT_FREE);
+        if(!next) return NULL;
+        next_eof = fill(st, next);
+        if(next_eof < 0) { fail(st); return NULL; }
+        if(next_eof && next->len == 0) break;
+
+        cur->last = 0;
+        setSlot(st, cur, SLOT_READ);
+        seq++;
+        cur = next;
+        eof = next_eof;
+    }
+    cur->last = 1;
+    setSlot(st, cur, SLOT_READ);
+    return NULL;
+}
+
+static void *writerMain(void *p) {
+    struct stream *st = p;
+    struct slot *slot;
+    long seq, done;
+    ssize_t n;
+    int last;
+
+    for(seq = 0; ; seq++) {
+        slot = waitSlot(st, seq, SLOT_DONE);
+        if(!slot) return NULL;
+        for(done = 0; done < slot->len; done += n) {
+            n = write(st->fd_out, slot->data + done, slot->len - done);
+            if(n < 0) {
+                if(errno == EINTR) { n = 0; continue; }
+                perror("writing output");
+                fail(st);
+                return NULL;
+            }
+        }
+        last = slot->last;
+        setSlot(st, slot, SLOT_FREE);
+        if(last) return NULL;
+    }
+}
+
+/*
+ * Encrypt (and pad) or decrypt (and unpad) fd_in -> fd_out
+ */
+int des_stream(const des_ctx *ctx, des_pool *pool, int fd_in, int fd_out, int decrypt) {
+    struct stream st;
+    struct slot *slot;
+    des_arena *arena = des_arena_default();
+    pthread_t reader, writer;
+    long seq;
+    int i, pad, last, rtn = 0;
+
+    memset(&st, 0, sizeof(st));
+    st.fd_in = fd_in;
+    st.fd_out = fd_out;
+    pthread_mutex_init(&st.lock, NULL);
+    pthread_cond_init(&st.cond, NULL);
+    for(i = 0; i < DES_STREAM_SLOTS; i++) {
+        st.slots[i].data = des_arena_get(arena, DES_STREAM_CHUNK + 8);
+        if(!st.slots[i].data) {
+            fputs("mem allocation fails\n", stderr);
+            while(i-- > 0) des_arena_put(arena, st.slots[i].data);
+            return -1;
+        }
+    }
+
+    if(pthread_create(&reader, NULL, readerMain, &st) != 0) {
+        fputs("thread creation fails\n", stderr);
+        for(i = 0; i < DES_STREAM_SLOTS; i++) des_arena_put(arena, st.slots[i].data);
+        return -1;
+    }
+    if(pthread_create(&writer, NULL, writerMain, &st) != 0) {
+        fputs("thread creation fails\n", stderr);
+        fail(&st);
+        pthread_cancel(reader);
+        pthread_join(reader, NULL);
+        for(i = 0; i < DES_STREAM_SLOTS; i++) des_arena_put(arena, st.slots[i].data);
+        return -1;
+    }
+
+    // Compute stage
+    for(seq = 0; ; seq++) {
+        slot = waitSlot(&st, seq, SLOT_READ);
+        if(!slot) { rtn = -1; break; }
+        last = slot->last;
+
+        if(!decrypt) {
+            // PKCS#5 padding on the last chunk
+            if(last) {
+                pad = 8 - slot->len % 8;
+                memset(slot->data + slot->len, pad, pad);
+                slot->len += pad;
+            }
+            if(pool) des_pool_ecb_encrypt(pool, ctx, slot->data, slot->data, slot->len);
+            else des_ecb_encrypt(ctx, slot->data, slot->data, (int)slot->len);
+        } else {
+            if(slot->len % 8 != 0) {
+                fputs("input is not a multiple of 8 bytes\n", stderr);
+                fail(&st); rtn = -1; break;
+            }
+            if(pool) des_pool_ecb_decrypt(pool, ctx, slot->data, slot->data, slot->len);
+            else des_ecb_decrypt(ctx, slot->data, slot->data, (int)slot->len);
+            if(last) {
+                pad = slot->len >= 8 ? des_get_pad(slot->data + slot->len - 8) : -1;
+                if(pad < 0) {
+                    fputs("bad padding (wrong key or damaged input)\n", stderr);
+                    fail(&st); rtn = -1; break;
+                }
+                slot->len -= pad;
+            }
+        }
+
+        setSlot(&st, slot, SLOT_DONE);
+        if(last) break;
+    }
+
+    // The writer ends after the last chunk or on failure, the reader may still sit in read()
+    pthread_join(writer, NULL);
+    if(st.failed) {
+        rtn = -1;
+        pthread_cancel(reader);
+    }
+    pthread_join(reader, NULL);
+
+    for(i = 0; i < DES_STREAM_SLOTS; i++) des_arena_put(arena, st.slots[i].data);
+    pthread_mutex_destroy(&st.lock);
+    pthread_cond_destroy(&st.cond);
+    return rtn;
+}
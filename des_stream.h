@@ -0,0 +1,32 @@
+
+/*
+ * des_stream.h
+ *
+ * Streaming ECB between two file descriptors in constant memory
+ *
+ * Stream format:
+ *   ECB blocks of the data followed by PKCS#5 padding: 1 to 8 bytes, each
+ *   holding the number of padding bytes, so the length is always a multiple of 8.
+ */
+
+#ifndef DES_STREAM_H
+#define DES_STREAM_H
+
+#include "des.h"
+#include "des_pool.h"
+
+// Bytes per chunk and chunks in flight (read / compute / write)
+#define DES_STREAM_CHUNK (4 * DES_POOL_CHUNK)
+#define DES_STREAM_SLOTS 4
+
+/*
+ * @param ctx Context from des_ctx_init
+ * @param pool Worker pool for the compute stage, or NULL for the calling thread
+ * @param fd_in Input, read until EOF (pipes work)
+ * @param fd_out Output
+ * @param decrypt 0 to encrypt and pad, 1 to decrypt and strip the padding
+ * @return 0, or -1 after printing the reason to stderr
+ */
+int des_stream(const des_ctx *ctx, des_pool *pool, int fd_in, int fd_out, int decrypt);
+
+#endif